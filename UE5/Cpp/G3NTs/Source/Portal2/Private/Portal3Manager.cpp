@@ -16,6 +16,105 @@
 #include "Components/CapsuleComponent.h"
 #include "PortalSurface.h"
 #include "SceneView.h"
+#include "Async/ParallelFor.h"
+#include "PortalWorldSubsystem.h"
+#include "PortalMath.h"
+#include "PortalStats.h"
+#include "PortalResolutionTiers.h"
+#include "PortalViewExtension.h"
+#include "Engine/LocalPlayer.h"
+#include "Engine/Level.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<int32> CVarPortalCaptureMaxPerFrame(
+	TEXT("Portal.Capture.MaxPerFrame"),
+	4,
+	TEXT("Maximum number of portal scene captures per frame. Portals the player is about to walk through are always captured."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPortalCaptureBudgetMs(
+	TEXT("Portal.Capture.BudgetMs"),
+	0.f,
+	TEXT("Game thread time budget for portal scene captures per frame, in milliseconds. 0 only uses Portal.Capture.MaxPerFrame."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPortalCaptureLowPriorityInterval(
+	TEXT("Portal.Capture.LowPriorityInterval"),
+	0.1f,
+	TEXT("Minimum seconds between two captures of a portal that covers only a small part of the screen."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarPortalCaptureSkipUnchanged(
+	TEXT("Portal.Capture.SkipUnchanged"),
+	1,
+	TEXT("Skip the capture of a portal when the view through it, and every movable primitive and portal in that view, did not change since its last render."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPortalCaptureMaxSkipSeconds(
+	TEXT("Portal.Capture.MaxSkipSeconds"),
+	1.f,
+	TEXT("Maximum seconds a portal capture is skipped as unchanged. Catches changes the capture hash does not track, such as lights and animated materials. Views with skinned meshes or particles are never skipped."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPortalImpostorDistance(
+	TEXT("Portal.Impostor.Distance"),
+	4000.f,
+	TEXT("Portals further from the camera than this show a static snapshot instead of a live capture. 0 disables impostors."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPortalImpostorMinCoverage(
+	TEXT("Portal.Impostor.MinCoverage"),
+	0.004f,
+	TEXT("Portals covering less of the screen than this fraction show a static snapshot instead of a live capture."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarPortalCaptureCullPrimitives(
+	TEXT("Portal.Capture.CullPrimitives"),
+	1,
+	TEXT("Cull the primitives of the world against the frustum seen through each portal on the CPU, and only render the survivors in the portal capture."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarPortalCaptureObliqueNearPlane(
+	TEXT("Portal.Capture.ObliqueNearPlane"),
+	0,
+	TEXT("Clip the portal captures with an oblique near plane on the exit portal instead of the global clip plane. Portals whose capture is too close to the exit portal keep the clip plane."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarPortalCaptureCropToScreen(
+	TEXT("Portal.Capture.CropToScreen"),
+	1,
+	TEXT("Only capture the rectangle of the screen a portal covers, with a smaller render target, instead of the whole view."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarPortalCaptureLateLatch(
+	TEXT("Portal.Capture.LateLatch"),
+	0,
+	TEXT("Run the scheduled portal captures right before the game view is rendered, with its final camera pose, instead of in TG_PostUpdateWork."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPortalRenderTargetBudgetMB(
+	TEXT("Portal.RenderTargets.BudgetMB"),
+	64.f,
+	TEXT("Memory ceiling of all portal render targets in megabytes. Over the ceiling the least important portals get a lower resolution. 0 disables the ceiling."),
+	ECVF_Default);
+
+/**
+ * Prints the render target memory of every portal in the world.
+ * Usage: Portal.RenderTargets
+ */
+static FAutoConsoleCommandWithWorld GPortalRenderTargetsCommand(
+	TEXT("Portal.RenderTargets"),
+	TEXT("Prints the total portal render target memory and the breakdown per portal."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		UPortalWorldSubsystem* PortalSubsystem = World ? World->GetSubsystem<UPortalWorldSubsystem>() : nullptr;
+		if (PortalSubsystem == nullptr || PortalSubsystem->GetManager() == nullptr)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Portal.RenderTargets: no portal manager in this world"));
+			return;
+		}
+		PortalSubsystem->GetManager()->DumpRenderTargetBudget();
+	}));
 
 APortal3Manager::APortal3Manager()
 {
@@ -26,6 +125,7 @@ APortal3Manager::APortal3Manager()
 	SecondaryActorTick.TickGroup = TG_PostPhysics;
 
 	bCloneState = false;
+	UsedPortalSlots = 0;
 }
 
 void APortal3Manager::BeginPlay()
@@ -34,10 +134,56 @@ void APortal3Manager::BeginPlay()
 
 	PlayerController = UGameplayStatics::GetPlayerController(GetWorld(), 0);
 
+	/**
+	 * Registering with the world subsystem hands over all portals and agents that began play before the manager.
+	 * Everything spawned or destroyed after this registers itself, portals and agents are never looked up in the world.
+	 */
+	if (UPortalWorldSubsystem* PortalSubsystem = GetWorld()->GetSubsystem<UPortalWorldSubsystem>())
+	{
+		PortalSubsystem->SetManager(this);
+	}
+
+	/**
+	 * The primitive cache is the one place the world is walked, once. From then on spawned and destroyed actors,
+	 * and the actors of streamed in and out levels, keep it up to date.
+	 */
+	INC_DWORD_STAT(STAT_PortalWorldScans);
+	for (TActorIterator<AActor> It(GetWorld()); It; ++It)
+	{
+		PrimitiveCache.AddActor(*It);
+	}
+	ActorSpawnedHandle = GetWorld()->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &APortal3Manager::OnWorldActorSpawned));
+	ActorDestroyedHandle = GetWorld()->AddOnActorDestroyedHandler(FOnActorDestroyed::FDelegate::CreateUObject(this, &APortal3Manager::OnWorldActorDestroyed));
+	LevelAddedHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &APortal3Manager::OnLevelAddedToWorld);
+	LevelRemovedHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &APortal3Manager::OnLevelRemovedFromWorld);
+
+	ViewExtension = FSceneViewExtensions::NewExtension<FPortalViewExtension>(GetWorld(), this);
+
 	// problem for shipping build: viewport size is zero for first view frames
 	UpdateViewportSize();
 }
 
+void APortal3Manager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UPortalWorldSubsystem* PortalSubsystem = GetWorld()->GetSubsystem<UPortalWorldSubsystem>())
+	{
+		PortalSubsystem->ClearManager(this);
+	}
+	RenderTargetPool.Reset();
+
+	GetWorld()->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+	GetWorld()->RemoveOnActorDestroyedHandler(ActorDestroyedHandle);
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedHandle);
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedHandle);
+	PrimitiveCache.Reset();
+
+	// the extensions only hold weak references, releasing ours unregisters it
+	ViewExtension.Reset();
+	LateLatchedCaptures.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
+
 void APortal3Manager::RegisterActorTickFunctions(bool bRegister)
 {
 	Super::RegisterActorTickFunctions(bRegister);
@@ -72,162 +218,867 @@ void APortal3Manager::TickActor(float DeltaSeconds, ELevelTick TickType, FActorT
 	 */
 	if (ThisTickFunction.TickGroup == TG_PostPhysics)
 	{
-		TeleportActorsCheck();
+		RunPipelineStage(EPortalPipelineStage::Gather);
+		RunPipelineStage(EPortalPipelineStage::Classify);
+		RunPipelineStage(EPortalPipelineStage::Teleport);
 	}
 	else if (ThisTickFunction.TickGroup == TG_PostUpdateWork)
 	{
-		CloneOrUpdateAllActors();
+		RunPipelineStage(EPortalPipelineStage::CloneSync);
 		ResetRotationControllerSlerp(DeltaSeconds);
+		RunPipelineStage(EPortalPipelineStage::Capture);
+	}
+}
+
+/**
+ * Runs a single stage of the per frame pipeline. Stages that run out of order are skipped,
+ * for example the clone sync stage in a frame where the teleport stages did not run.
+ *
+ * @param Stage The stage to run.
+ */
+void APortal3Manager::RunPipelineStage(EPortalPipelineStage Stage)
+{
+	if (!FramePipeline.BeginStage(Stage))
+	{
+		return;
+	}
+
+	switch (Stage)
+	{
+	case EPortalPipelineStage::Gather:
+		GatherAgents();
+		break;
+	case EPortalPipelineStage::Classify:
+		ClassifyAgents();
+		break;
+	case EPortalPipelineStage::Teleport:
+		ApplyTeleports();
+		break;
+	case EPortalPipelineStage::CloneSync:
+		SyncClones();
+		break;
+	case EPortalPipelineStage::Capture:
 		UpdatePortals();
+		break;
+	default:
+		break;
 	}
 }
 
 /**
- * Finds all actors of a specified subclass in the world that inherit from a given base class.
- * This function uses UGameplayStatics::GetAllActorsOfClass to gather all actors of the specified BaseClass,
- * then attempts to cast each found actor to SubClass. If successful, it adds the casted actor pointer to
- * an array which is returned at the end.
+ * Updates the capture state of all portals in the PortalList.
  *
- * @tparam SubClass The subclass of AActor to search for.
- * @param World The world context to search for actors.
- * @param BaseClass The base class from which SubClass inherits.
- * @return An array of pointers to actors of SubClass found in the world. May be empty if none are found.
+ * Every linked portal that passes CheckPortalNeedsUpdate becomes a capture candidate. The capture scheduler then picks
+ * the candidates that fit in the per frame budget, and only those get their screen capture updated this frame.
  */
-template<typename SubClass>
-TArray<SubClass*> APortal3Manager::FindAllActorsInWorld(UWorld* World, TSubclassOf<AActor> BaseClass)
+void APortal3Manager::UpdatePortals()
 {
-	TArray<SubClass*> ActorList;
-	TArray<AActor*> Actors;
-	UGameplayStatics::GetAllActorsOfClass(World, BaseClass, Actors);
+	APlayerCameraManager* CameraManager = PlayerController->PlayerCameraManager;
+	const FTransform CameraTransform = CameraManager->GetTransform();
+	const double CurrentTime = GetWorld()->GetTimeSeconds();
+
+	// the camera matrices and frustum are the same for every portal, so they are retrieved once per frame
+	const FMatrix ViewProjectionMatrix = GetCameraProjectionMatrix(CameraManager, true);
+	const FMatrix ProjectionMatrix = GetCameraProjectionMatrix(CameraManager, false);
+
+	FConvexVolume CameraFrustum;
+	GetViewFrustumBounds(CameraFrustum, ViewProjectionMatrix, true);
+
+	// the traces of the previous frame are finished by now, this frame's line of sight checks read their results
+	ConsumeVisibilityTraces();
+
+	// late latched captures of the last frame that never saw a rendered view were not captured, they must not be skipped as unchanged
+	for (const TWeakObjectPtr<APortalV3>& LateLatchedPortal : LateLatchedCaptures)
+	{
+		if (APortalV3* Portal = LateLatchedPortal.Get())
+		{
+			Portal->CaptureHash = 0;
+		}
+	}
+	LateLatchedCaptures.Reset();
+
+	// the culling and the capture hash both read the bounds of the movable primitives
+	NumCapturedPrimitives = 0;
+	if (CVarPortalCaptureCullPrimitives.GetValueOnGameThread() != 0 || CVarPortalCaptureSkipUnchanged.GetValueOnGameThread() != 0)
+	{
+		PrimitiveCache.UpdateMovableBounds();
+	}
+
+	CaptureCandidates.Reset();
+	BudgetEntries.Reset();
+	int32 NumImpostors = 0;
+	const bool bCropToScreen = CVarPortalCaptureCropToScreen.GetValueOnGameThread() != 0;
+	for (int32 PortalIndex = 0; PortalIndex < PortalList.Num(); ++PortalIndex)
+	{
+		APortalV3* Portal = PortalList[PortalIndex];
+		if (Portal->LinkedPortal == nullptr)
+		{
+			Portal->NullScreenCapture();
+			AddLockedBudgetEntry(PortalIndex, true);
+			continue;
+		}
+
+		FTransform PortalTransform = Portal->GetActorTransform();
+		const FPortalCornerArray PortalCorners = Portal->GetPortalBounds();
+		if (!CheckPortalNeedsUpdate(Portal, PortalTransform, CameraTransform, CameraFrustum, PortalCorners))
+		{
+			AddLockedBudgetEntry(PortalIndex, true);
+			continue;
+		}
+
+		FPortalCaptureCandidate& Candidate = CaptureCandidates.AddDefaulted_GetRef();
+		Candidate.PortalIndex = PortalIndex;
+		Candidate.ScreenCoverage = FPortalMath::ComputeScreenCoverage(ViewProjectionMatrix, PortalCorners);
+		Candidate.Distance = FVector::Distance(CameraTransform.GetLocation(), PortalTransform.GetLocation());
+		Candidate.TimeSinceCapture = Portal->LastCaptureTime < 0.0 ? TNumericLimits<float>::Max() : (float)(CurrentTime - Portal->LastCaptureTime);
+		Candidate.bForceCapture = PlayerPortalDistance(PortalTransform, CameraTransform);
+
+		if (UpdateImpostor(Portal, Candidate))
+		{
+			CaptureCandidates.Pop(EAllowShrinking::No);
+			AddLockedBudgetEntry(PortalIndex, false);
+			++NumImpostors;
+			continue;
+		}
+
+		Portal->UpdateResolutionTier(Candidate.ScreenCoverage);
+
+		// the render target size follows the crop, it is leased together with the tier below
+		Portal->CaptureRect = bCropToScreen
+			? FPortalMath::SelectCaptureRect(FPortalMath::ComputeScreenRect(ViewProjectionMatrix, PortalCorners), Portal->CaptureRect, CaptureRectGridSteps)
+			: FBox2D(FVector2D(-1.0), FVector2D(1.0));
+
+		FPortalRenderTargetBudgetEntry& Entry = BudgetEntries.AddDefaulted_GetRef();
+		Entry.PortalIndex = PortalIndex;
+		Entry.Importance = Candidate.ScreenCoverage;
+		Entry.AspectRatio = Portal->GetTextureAspectRatio();
+		Entry.CropFraction = Portal->GetCaptureRectFraction();
+		Entry.Tier = Portal->ResolutionTier;
+	}
+
+	// the memory ceiling can only lower the tier the screen coverage asks for
+	RenderTargetBudget.BudgetBytes = (int64)(CVarPortalRenderTargetBudgetMB.GetValueOnGameThread() * 1024.0 * 1024.0);
+	SET_MEMORY_STAT(STAT_PortalRenderTargetBudgetMemory, RenderTargetBudget.Enforce(BudgetEntries));
+
+	/**
+	 * Linked and visible portals lease their texture targets here, and lease new ones when the resolution tier or viewport changed.
+	 * New targets have no content yet, they have to be captured this frame or the portal shows black.
+	 * The candidates and the unlocked budget entries were added in the same order.
+	 */
+	int32 CandidateIndex = 0;
+	for (const FPortalRenderTargetBudgetEntry& Entry : BudgetEntries)
+	{
+		if (Entry.bLocked)
+		{
+			// the portal leases new targets and is captured again when it comes back into view
+			if (Entry.bReleased)
+			{
+				APortalV3* Portal = PortalList[Entry.PortalIndex];
+				Portal->ReleaseTextureTargets(RenderTargetPool);
+				Portal->bShowingImpostor = false;
+			}
+			continue;
+		}
+
+		APortalV3* Portal = PortalList[Entry.PortalIndex];
+		Portal->ResolutionTier = Entry.Tier;
+		if (Portal->AcquireTextureTargets(RenderTargetPool))
+		{
+			CaptureCandidates[CandidateIndex].bForceCapture = true;
+		}
+		++CandidateIndex;
+	}
 
-	for (AActor* Actor : Actors)
+	/**
+	 * Portals showing the same image as at their last render are dropped before scheduling, so the capture budget goes to
+	 * the portals that changed. A skipped portal counts as captured for the scheduler, its texture is up to date.
+	 */
+	const bool bSkipUnchanged = CVarPortalCaptureSkipUnchanged.GetValueOnGameThread() != 0;
+	const double MaxSkipSeconds = CVarPortalCaptureMaxSkipSeconds.GetValueOnGameThread();
+	const int32 NumVisible = CaptureCandidates.Num();
+	CandidateCaptureHashes.SetNumZeroed(PortalList.Num(), EAllowShrinking::No);
+
+	int32 NumKept = 0;
+	for (const FPortalCaptureCandidate& Candidate : CaptureCandidates)
 	{
-		if (SubClass* ActorSubclass = Cast<SubClass>(Actor))
+		APortalV3* Portal = PortalList[Candidate.PortalIndex];
+		const uint32 CaptureHash = ComputeCaptureHash(Portal, CameraTransform, ProjectionMatrix, CameraFrustum);
+		CandidateCaptureHashes[Candidate.PortalIndex] = CaptureHash;
+
+		if (bSkipUnchanged && CaptureHash != 0 && CaptureHash == Portal->CaptureHash && CurrentTime - Portal->LastRenderTime < MaxSkipSeconds)
 		{
-			ActorList.Add(ActorSubclass);
+			Portal->LastCaptureTime = CurrentTime;
+			continue;
+		}
+		CaptureCandidates[NumKept++] = Candidate;
+	}
+	CaptureCandidates.SetNum(NumKept, EAllowShrinking::No);
+
+	CaptureScheduler.Settings.MaxCapturesPerFrame = CVarPortalCaptureMaxPerFrame.GetValueOnGameThread();
+	CaptureScheduler.Settings.BudgetMilliseconds = CVarPortalCaptureBudgetMs.GetValueOnGameThread();
+	CaptureScheduler.Settings.LowPriorityInterval = CVarPortalCaptureLowPriorityInterval.GetValueOnGameThread();
+	CaptureScheduler.Schedule(CaptureCandidates, ScheduledCaptures);
+
+	/**
+	 * With late latching the scheduled portals are captured in OnBeginRenderView, with the camera pose that is presented.
+	 * The schedule, the crop rectangle and the bookkeeping below still come from the camera of this tick.
+	 */
+	const bool bLateLatch = CVarPortalCaptureLateLatch.GetValueOnGameThread() != 0 && ViewExtension.IsValid();
+	for (int32 PortalIndex : ScheduledCaptures)
+	{
+		APortalV3* Portal = PortalList[PortalIndex];
+
+		if (bLateLatch)
+		{
+			LateLatchedCaptures.Add(Portal);
 		}
 		else
 		{
-			UE_LOG(LogTemp, Error, TEXT("Casting BaseClass Actor to SubClass Failed! - Make sure to set the correct BaseClass"));
+			/**
+			 * Only the game thread part of the capture is measured, the render itself happens later on the render thread.
+			 * It is still a good relative measure of the capture cost, which is what the millisecond budget needs.
+			 */
+			const double StartTime = FPlatformTime::Seconds();
+			UpdatePortalCapture(Portal, CameraTransform, ViewProjectionMatrix, ProjectionMatrix);
+			CaptureScheduler.ReportCaptureCost((FPlatformTime::Seconds() - StartTime) * 1000.0);
 		}
+
+		Portal->LastCaptureTime = CurrentTime;
+		Portal->LastRenderTime = CurrentTime;
+		Portal->CaptureHash = CandidateCaptureHashes[PortalIndex];
+		++Portal->CaptureCount;
+	}
+
+	if (!bLateLatch && ScheduledCaptures.Num() > 0)
+	{
+		CaptureLatency.RecordCapturePose(CameraTransform);
 	}
 
-	return ActorList;
+	SET_DWORD_STAT(STAT_PortalCachedPrimitives, PrimitiveCache.Num());
+	SET_DWORD_STAT(STAT_PortalCapturedPrimitives, NumCapturedPrimitives);
+	SET_DWORD_STAT(STAT_PortalImpostors, NumImpostors);
+	SET_DWORD_STAT(STAT_PortalCapturesSkipped, NumVisible - NumKept);
+	SET_FLOAT_STAT(STAT_PortalCapturesSkippedFraction, NumVisible > 0 ? (float)(NumVisible - NumKept) / NumVisible : 0.f);
+	SET_DWORD_STAT(STAT_PortalCaptures, ScheduledCaptures.Num());
+	SET_DWORD_STAT(STAT_PortalCapturesDeferred, CaptureCandidates.Num() - ScheduledCaptures.Num());
 }
 
 /**
- * Updates the capture state of all portals in the PortalList.
+ * Switches a visible portal between live capture and an impostor snapshot, based on its distance and screen coverage.
+ * Leaving the impostor needs the portal to be clearly closer or larger than the thresholds, so a portal at the threshold
+ * does not switch every frame.
+ *
+ * @param Portal The visible portal.
+ * @param Candidate The capture candidate of the portal, forced to capture when the portal leaves the impostor.
+ * @return True if the portal shows an impostor this frame and is not captured live.
+ */
+bool APortal3Manager::UpdateImpostor(APortalV3* Portal, FPortalCaptureCandidate& Candidate)
+{
+	const float ImpostorDistance = CVarPortalImpostorDistance.GetValueOnGameThread();
+	const float ImpostorCoverage = CVarPortalImpostorMinCoverage.GetValueOnGameThread();
+
+	const bool bFar = ImpostorDistance > 0.f && (Candidate.Distance > ImpostorDistance || Candidate.ScreenCoverage < ImpostorCoverage);
+	const bool bClearlyNear = ImpostorDistance <= 0.f || (Candidate.Distance < ImpostorDistance * 0.8f && Candidate.ScreenCoverage > ImpostorCoverage * 1.25f);
+
+	if (Portal->bShowingImpostor)
+	{
+		if (bClearlyNear || Candidate.bForceCapture)
+		{
+			// back to live capture, the texture still holds the snapshot and has to be replaced this frame
+			Portal->bShowingImpostor = false;
+			Candidate.bForceCapture = true;
+			return false;
+		}
+
+		// a new linked portal makes the snapshot show the wrong place
+		if (!Portal->IsImpostorValid())
+		{
+			Portal->CaptureImpostor(RenderTargetPool, ImpostorViewDistance);
+		}
+		return true;
+	}
+
+	if (bFar && !Candidate.bForceCapture)
+	{
+		Portal->CaptureImpostor(RenderTargetPool, ImpostorViewDistance);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Hashes everything that decides what a portal capture shows: the capture view converted through the portal pair,
+ * the projection, and the movable primitives and other portals whose bounds overlap the destination view.
+ * When the hash equals the one of the last render, the texture still shows the right image and the capture can be skipped.
+ * Animating primitives change the image without moving, so a view with a skinned mesh or particle system in it is never skipped.
+ *
+ * @param Portal The portal to hash.
+ * @param Camera The current transform of the camera.
+ * @param ProjectionMatrix The projection matrix of the camera.
+ * @param CameraFrustum The view frustum of the camera, the destination view is tested by converting objects back through the portal pair.
+ * @return The capture hash, 0 if an animating primitive is seen through the portal and the capture cannot be skipped.
+ */
+uint32 APortal3Manager::ComputeCaptureHash(APortalV3* Portal, const FTransform& Camera, const FMatrix& ProjectionMatrix, const FConvexVolume& CameraFrustum)
+{
+	/**
+	 * Transforms are quantized before hashing, to a hundredth of a unit and 1e-5 of a quaternion component,
+	 * so floating point noise of a camera standing still does not count as a change.
+	 */
+	auto HashTransform = [](uint32 Hash, const FVector& Location, const FQuat& Rotation)
+	{
+		Hash = HashCombineFast(Hash, GetTypeHash(FIntVector(FMath::RoundToInt(Location.X * 100.0), FMath::RoundToInt(Location.Y * 100.0), FMath::RoundToInt(Location.Z * 100.0))));
+		Hash = HashCombineFast(Hash, GetTypeHash(FIntVector4(FMath::RoundToInt(Rotation.X * 1e5), FMath::RoundToInt(Rotation.Y * 1e5), FMath::RoundToInt(Rotation.Z * 1e5), FMath::RoundToInt(Rotation.W * 1e5))));
+		return Hash;
+	};
+
+	// the capture view covers the camera and both portal transforms at once
+	const FPortalPairTransform& PairTransform = Portal->GetPairTransform();
+	uint32 Hash = HashTransform(0, PairTransform.TransformPosition(Camera.GetLocation()), PairTransform.TransformRotation(Camera.GetRotation()));
+	Hash = HashCombineFast(Hash, FCrc::MemCrc32(&ProjectionMatrix.M[0][0], sizeof(ProjectionMatrix.M)));
+
+	/**
+	 * An object at the destination is seen through the portal if converting it back through the pair puts it in the camera frustum,
+	 * so the destination frustum never has to be built.
+	 */
+	auto IsInDestinationView = [&PairTransform, &CameraFrustum](const FVector& Origin, double Radius)
+	{
+		return CameraFrustum.IntersectSphere(PairTransform.InverseTransformPosition(Origin), Radius);
+	};
+
+	/**
+	 * Teleport agents, their clones and attachments, and every other movable primitive at the destination count with their transform.
+	 * The primitive cache already refreshed their bounds this frame, static primitives never change the image.
+	 */
+	bool bAnyAnimating = false;
+	PrimitiveCache.GetMovableInView(IsInDestinationView, HashedPrimitives, bAnyAnimating);
+	if (bAnyAnimating)
+	{
+		return 0;
+	}
+	for (const UPrimitiveComponent* Primitive : HashedPrimitives)
+	{
+		Hash = HashCombineFast(Hash, GetTypeHash(Primitive));
+		Hash = HashTransform(Hash, Primitive->GetComponentLocation(), Primitive->GetComponentQuat());
+	}
+
+	/**
+	 * Portals seen through this portal change whenever they are rendered. The exit portal itself is behind the capture clip plane.
+	 */
+	for (APortalV3* OtherPortal : PortalList)
+	{
+		if (OtherPortal == Portal->LinkedPortal)
+		{
+			continue;
+		}
+		const FBox OtherBounds = OtherPortal->GetTeleportBounds();
+		if (IsInDestinationView(OtherBounds.GetCenter(), OtherBounds.GetExtent().Size()))
+		{
+			Hash = HashCombineFast(Hash, GetTypeHash(OtherPortal));
+			Hash = HashCombineFast(Hash, OtherPortal->CaptureCount);
+		}
+	}
+
+	return Hash != 0 ? Hash : 1;
+}
+
+/**
+ * Adds a budget entry for a portal that is not captured this frame. It keeps the texture targets it holds,
+ * so it counts towards the render target memory, but its tier is not changed until it is visible again.
+ *
+ * @param PortalIndex Index of the portal in the PortalList.
+ * @param bReleasable Whether the portal is not on screen, so its targets may be released when over budget.
+ */
+void APortal3Manager::AddLockedBudgetEntry(int32 PortalIndex, bool bReleasable)
+{
+	APortalV3* Portal = PortalList[PortalIndex];
+	if (!Portal->HasTextureTargets())
+	{
+		return;
+	}
+
+	FPortalRenderTargetBudgetEntry& Entry = BudgetEntries.AddDefaulted_GetRef();
+	Entry.PortalIndex = PortalIndex;
+	Entry.AspectRatio = Portal->GetTextureAspectRatio();
+	Entry.CropFraction = Portal->GetCaptureRectFraction();
+	Entry.Tier = Portal->ResolutionTier;
+	Entry.bLocked = true;
+	Entry.bReleasable = bReleasable;
+}
+
+/**
+ * Prints the render target memory of the last frame, in total and per portal, and the memory held by the render target pool.
+ */
+void APortal3Manager::DumpRenderTargetBudget() const
+{
+	UE_LOG(LogTemp, Log, TEXT("Portal render targets: %.2f MB of %.2f MB budget, %d released, %d tier steps down, pool %.2f MB (%d leased, %d free, %d hits, %d misses, %.0f%% hit rate)"),
+		RenderTargetBudget.GetTotalBytes() / (1024.0 * 1024.0),
+		RenderTargetBudget.BudgetBytes / (1024.0 * 1024.0),
+		RenderTargetBudget.GetNumReleased(),
+		RenderTargetBudget.GetNumStepsDown(),
+		RenderTargetPool.GetResidentBytes() / (1024.0 * 1024.0),
+		RenderTargetPool.GetNumLeased(),
+		RenderTargetPool.GetNumFree(),
+		RenderTargetPool.GetNumHits(),
+		RenderTargetPool.GetNumMisses(),
+		RenderTargetPool.GetHitRate() * 100.f);
+
+	for (const FPortalRenderTargetBudgetEntry& Entry : BudgetEntries)
+	{
+		const APortalV3* Portal = PortalList.IsValidIndex(Entry.PortalIndex) ? PortalList[Entry.PortalIndex] : nullptr;
+		const FIntPoint Size = FPortalResolutionTiers::GetSize(Entry.Tier, Entry.AspectRatio, Entry.CropFraction);
+		UE_LOG(LogTemp, Log, TEXT("  %s: tier %d, 2 x %dx%d, %.2f MB, coverage %.3f%s"),
+			Portal ? *Portal->GetName() : TEXT("<removed>"),
+			Entry.Tier, Size.X, Size.Y,
+			Entry.Bytes / (1024.0 * 1024.0),
+			Entry.Importance,
+			Entry.bReleased ? TEXT(", released") : Entry.bLocked ? TEXT(", not captured") : TEXT(""));
+	}
+}
+
+/**
+ * Called by the view extension on the game thread with the final view of the player, right before it is rendered.
+ * Runs the captures that were scheduled for late latching with the presented camera pose, and updates the latency stats.
+ *
+ * @param View The view of the player that is about to be rendered.
+ */
+void APortal3Manager::OnBeginRenderView(const FSceneView& View)
+{
+	const FTransform PresentedPose(View.ViewRotation, View.ViewLocation);
+
+	if (LateLatchedCaptures.Num() > 0)
+	{
+		/**
+		 * The captures are rendered before the view, so they use its pose and matrices directly. The material gets the
+		 * view projection of the presented view too, the portal contents and the world around it move in the same frame.
+		 */
+		const FMatrix& ViewProjectionMatrix = View.ViewMatrices.GetViewProjectionMatrix();
+		const FMatrix& ProjectionMatrix = View.ViewMatrices.GetProjectionMatrix();
+
+		for (const TWeakObjectPtr<APortalV3>& LateLatchedPortal : LateLatchedCaptures)
+		{
+			APortalV3* Portal = LateLatchedPortal.Get();
+			if (Portal == nullptr || Portal->LinkedPortal == nullptr)
+			{
+				continue;
+			}
+
+			const double StartTime = FPlatformTime::Seconds();
+			UpdatePortalCapture(Portal, PresentedPose, ViewProjectionMatrix, ProjectionMatrix);
+			CaptureScheduler.ReportCaptureCost((FPlatformTime::Seconds() - StartTime) * 1000.0);
+		}
+		LateLatchedCaptures.Reset();
+
+		CaptureLatency.RecordCapturePose(PresentedPose);
+		SET_DWORD_STAT(STAT_PortalCapturedPrimitives, NumCapturedPrimitives);
+	}
+
+	UpdateCaptureLatency(PresentedPose);
+}
+
+/**
+ * Compares the camera pose the captures of this frame used with the last presented poses, and sets the latency stats.
+ *
+ * @param PresentedPose The camera pose of the view that is about to be rendered.
+ */
+void APortal3Manager::UpdateCaptureLatency(const FTransform& PresentedPose)
+{
+	if (CaptureLatency.RecordPresentedPose(PresentedPose))
+	{
+		SET_FLOAT_STAT(STAT_PortalCaptureLatencyFrames, (float)CaptureLatency.GetLatencyFrames());
+		SET_FLOAT_STAT(STAT_PortalCapturePoseError, CaptureLatency.GetPoseErrorDegrees());
+	}
+}
+
+/**
+ * Updates the screen capture for the specified portal.
+ *
+ * This function calculates the new capture location and rotation for the portal by converting the camera
+ * transform through the cached portal pair transform, and uses these together with the camera's view projection
+ * and projection matrices to update the portal's screen capture.
+ *
+ * @param Portal The portal to update.
+ * @param Camera The current transform of the camera.
+ * @param ViewProjectionMatrix The view projection matrix of the camera.
+ * @param ProjectionMatrix The projection matrix of the camera.
+ */
+void APortal3Manager::UpdatePortalCapture(APortalV3* Portal, const FTransform& Camera, const FMatrix& ViewProjectionMatrix, const FMatrix& ProjectionMatrix)
+{
+	const FPortalPairTransform& PairTransform = Portal->GetPairTransform();
+	FTransform Target = Portal->LinkedPortal->GetActorTransform();
+
+	FVector CaptureLocation = PairTransform.TransformPosition(Camera.GetLocation());
+	FQuat CaptureRotation = PairTransform.TransformRotation(Camera.GetRotation());
+
+	CullCapturePrimitives(Portal, CaptureLocation);
+
+	/**
+	 * The oblique near plane loses depth precision when the capture gets close to the exit portal,
+	 * at the plane itself the whole depth range collapses. Those captures fall back to the clip plane.
+	 */
+	const double DistanceBehindExit = -FVector::DotProduct(CaptureLocation - Target.GetLocation(), Target.GetRotation().GetForwardVector());
+	Portal->ClipMode = CVarPortalCaptureObliqueNearPlane.GetValueOnGameThread() != 0 && DistanceBehindExit > ObliqueMinDistance
+		? EPortalClipMode::ObliqueProjection
+		: EPortalClipMode::ClipPlane;
+
+	Portal->UpdateScreenCapture(CaptureLocation, CaptureRotation , ViewProjectionMatrix, Target, ProjectionMatrix);
+}
+
+/**
+ * Culls the primitive cache against the frustum seen through a portal, and passes the survivors to the scene capture
+ * of the portal as its show only list. Everything behind the exit portal or outside its opening is never sent to the renderer.
+ *
+ * @param Portal The portal that is about to be captured.
+ * @param CaptureLocation The location of the scene capture at the exit portal.
+ */
+void APortal3Manager::CullCapturePrimitives(APortalV3* Portal, const FVector& CaptureLocation)
+{
+	if (CVarPortalCaptureCullPrimitives.GetValueOnGameThread() == 0)
+	{
+		Portal->ClearShowOnlyList();
+		return;
+	}
+
+	/**
+	 * The capture looks out of the exit portal, so the frustum is bounded by the edges of the exit portal opening
+	 * and by the same clip plane the scene capture uses, see APortalV3::UpdateScreenCapture.
+	 * GetPortalBounds returns the corners row by row, the frustum needs them in order around the opening.
+	 */
+	const FPortalCornerArray ExitCorners = Portal->LinkedPortal->GetPortalBounds();
+	const FVector OrderedCorners[4] = { ExitCorners[0], ExitCorners[1], ExitCorners[3], ExitCorners[2] };
+
+	const FVector ClipPlaneNormal = Portal->LinkedPortal->GetActorForwardVector();
+	const FVector ClipPlaneBase = Portal->LinkedPortal->GetActorLocation() + ClipPlaneNormal * -1.5f;
+
+	FPortalMath::BuildPortalFrustum(CaptureLocation, OrderedCorners, ClipPlaneBase, ClipPlaneNormal, PortalFrustumPlanes);
+
+	TArray<TWeakObjectPtr<UPrimitiveComponent>>& ShowOnlyComponents = Portal->BeginShowOnlyList();
+	PrimitiveCache.Cull(PortalFrustumPlanes, ShowOnlyComponents);
+	NumCapturedPrimitives += ShowOnlyComponents.Num();
+}
+
+/**
+ * Bound to the actor spawned event of the world, adds the primitives of the actor to the primitive cache.
+ */
+void APortal3Manager::OnWorldActorSpawned(AActor* Actor)
+{
+	PrimitiveCache.AddActor(Actor);
+}
+
+/**
+ * Bound to the actor destroyed event of the world, removes the primitives of the actor from the primitive cache.
+ */
+void APortal3Manager::OnWorldActorDestroyed(AActor* Actor)
+{
+	PrimitiveCache.RemoveActor(Actor);
+}
+
+/**
+ * Bound to the level added event, adds the primitives of a level streamed into the world of the manager to the primitive cache.
+ * The actors of a streamed level are loaded, not spawned, so the actor spawned event does not see them.
+ */
+void APortal3Manager::OnLevelAddedToWorld(ULevel* Level, UWorld* World)
+{
+	if (Level == nullptr || World != GetWorld())
+	{
+		return;
+	}
+	for (AActor* Actor : Level->Actors)
+	{
+		PrimitiveCache.AddActor(Actor);
+	}
+}
+
+/**
+ * Bound to the level removed event, removes the primitives of a level streamed out of the world of the manager from the primitive cache.
+ */
+void APortal3Manager::OnLevelRemovedFromWorld(ULevel* Level, UWorld* World)
+{
+	if (World != GetWorld())
+	{
+		return;
+	}
+	// a null level means all levels are removed, the manager ends play with its own level
+	if (Level == nullptr)
+	{
+		return;
+	}
+	for (AActor* Actor : Level->Actors)
+	{
+		PrimitiveCache.RemoveActor(Actor);
+	}
+}
+
+/**
+ * Gather stage. Snapshots the location of every agent and resolves the portal links for the later stages.
+ */
+void APortal3Manager::GatherAgents()
+{
+	// the clip plane of an agent that crosses is set to the linked portal, resolve its index once instead of per agent
+	// the teleport status of an agent is kept per portal slot, the classify stage maps the set slots back to portals
+	FramePipeline.PortalLinkedIndices.Reset();
+	FramePipeline.SlotPortalIndices.Init(INDEX_NONE, MaxPortalSlots);
+	for (int32 PortalIndex = 0; PortalIndex < PortalList.Num(); ++PortalIndex)
+	{
+		const APortalV3* Portal = PortalList[PortalIndex];
+		FramePipeline.PortalLinkedIndices.Add(Portal->LinkedPortal ? PortalList.IndexOfByKey(Portal->LinkedPortal) : INDEX_NONE);
+		if (Portal->PortalSlot != INDEX_NONE)
+		{
+			FramePipeline.SlotPortalIndices[Portal->PortalSlot] = PortalIndex;
+		}
+	}
+
+	check(FramePipeline.AgentResults.Num() == TeleportAgents.Num());
+	for (int32 AgentIndex = 0; AgentIndex < TeleportAgents.Num(); ++AgentIndex)
+	{
+		FPortalAgentFrameResult& Result = FramePipeline.AgentResults[AgentIndex];
+		Result.Location = TeleportAgents.GetActor(AgentIndex)->GetActorLocation();
+		Result.PreviousCloneMask = Result.CloneMask;
+	}
+}
+
+/**
+ * Classify stage. The agents are evaluated in parallel against the portals in the PortalList, which only reads state and emits commands.
+ */
+void APortal3Manager::ClassifyAgents()
+{
+	const int32 NumAgents = TeleportAgents.Num();
+	const int32 NumChunks = FMath::DivideAndRoundUp(NumAgents, TeleportCheckChunkSize);
+
+	if (FramePipeline.Commands.Num() < NumChunks)
+	{
+		FramePipeline.Commands.SetNum(NumChunks);
+	}
+
+	/**
+	 * Every chunk writes into its own command array, so no locking is needed.
+	 * Small agent counts are evaluated on the game thread, waking up workers would cost more than the evaluation itself.
+	 */
+	ParallelFor(NumChunks, [this, NumAgents](int32 ChunkIndex)
+	{
+		FPortalAgentCommandArray& Commands = FramePipeline.Commands[ChunkIndex];
+		Commands.Reset();
+
+		const int32 FirstAgent = ChunkIndex * TeleportCheckChunkSize;
+		const int32 LastAgent = FMath::Min(FirstAgent + TeleportCheckChunkSize, NumAgents);
+		for (int32 AgentIndex = FirstAgent; AgentIndex < LastAgent; ++AgentIndex)
+		{
+			EvaluateAgent(AgentIndex, Commands);
+		}
+	}, NumChunks < 2 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+	for (int32 ChunkIndex = NumChunks; ChunkIndex < FramePipeline.Commands.Num(); ++ChunkIndex)
+	{
+		FramePipeline.Commands[ChunkIndex].Reset();
+	}
+}
+
+/**
+ * Teleport stage. Applies the commands of the classify stage on the game thread, which manages teleportation status,
+ * collision settings, and clip plane for each teleport agent. Records the portals every agent needs a clone for.
+ */
+void APortal3Manager::ApplyTeleports()
+{
+	// applying the chunks in order keeps the result identical to a serial loop over the agents
+	for (const FPortalAgentCommandArray& Commands : FramePipeline.Commands)
+	{
+		for (const FPortalAgentCommand& Command : Commands)
+		{
+			ApplyAgentCommand(Command);
+		}
+	}
+
+	for (int32 AgentIndex = 0; AgentIndex < TeleportAgents.Num(); ++AgentIndex)
+	{
+		TeleportAgents.SetPreviousLocation(AgentIndex, TeleportAgents.GetActor(AgentIndex)->GetActorLocation());
+		FramePipeline.AgentResults[AgentIndex].CloneMask = TeleportAgents.GetAgent(AgentIndex)->GetTeleportStatusMask();
+	}
+}
+
+/**
+ * Evaluates a single agent against the portals, without changing any state. Safe to call from worker threads.
+ *
+ * @param AgentIndex The dense index of the agent in the TeleportAgents registry.
+ * @param OutCommands Output array the state changes for the agent are added to, in the order they have to be applied.
+ */
+void APortal3Manager::EvaluateAgent(int32 AgentIndex, FPortalAgentCommandArray& OutCommands) const
+{
+	// agents are removed from the registry in EndPlay, so the cached pointers are always valid here
+	const UTeleportAgent* TeleportAgent = TeleportAgents.GetAgent(AgentIndex);
+	bool bIsInsideAny = false; // a bool used to keep track wether a agent is not in any of the portal box colliders, prevents overwriting variables for multiple portals
+
+	// the broadphase returns the few portals whose collider can contain the agent, only those need the narrow IsInside check
+	const FVector AgentLocation = FramePipeline.AgentResults[AgentIndex].Location;
+	const FTransform AgentTransform(AgentLocation);
+	FPortalCandidateArray PortalCandidates;
+	PortalBroadphase.QueryPoint(AgentLocation, PortalCandidates);
+
+	/**
+	 * Fast agents can pass through the thin collider between two frames without ever being sampled inside it.
+	 * The movement since the last frame is swept against the portal openings, and the earliest crossing is teleported through.
+	 */
+	const int32 SweptPortalIndex = FindSweptPortal(TeleportAgents.GetPreviousLocation(AgentIndex), AgentLocation);
+
+	/**
+	 * Only the portals the agent can interact with are visited: the broadphase candidates, the swept portal, and the portals
+	 * the agent has a teleport status for, which may need an Exit. They are visited in PortalList order,
+	 * so the commands come out in the same order as a walk over every portal.
+	 */
+	FPortalCandidateArray VisitedPortals = PortalCandidates;
+	if (SweptPortalIndex != INDEX_NONE)
+	{
+		VisitedPortals.AddUnique(SweptPortalIndex);
+	}
+	for (uint64 StatusMask = TeleportAgent->GetTeleportStatusMask(); StatusMask != 0; StatusMask &= StatusMask - 1)
+	{
+		const int32 SlotPortalIndex = FramePipeline.SlotPortalIndices[FMath::CountTrailingZeros64(StatusMask)];
+		if (SlotPortalIndex != INDEX_NONE)
+		{
+			VisitedPortals.AddUnique(SlotPortalIndex);
+		}
+	}
+	VisitedPortals.Sort();
+
+	for (int32 PortalIndex : VisitedPortals)
+	{
+		const APortalV3* Portal = PortalList[PortalIndex];
+		if (Portal->LinkedPortal == nullptr || Portal->PortalSlot == INDEX_NONE)
+		{
+			// if the portal has no linked portal skip to the next portal
+			continue;
+		}
+
+		const bool bHasTeleportStatus = TeleportAgent->GetTeleportStatusSlot(Portal->PortalSlot);
+
+		if (PortalIndex == SweptPortalIndex)
+		{
+			OutCommands.Emplace(EPortalAgentCommandType::Cross, AgentIndex, PortalIndex);
+			OutCommands.Emplace(EPortalAgentCommandType::ClipPlane, AgentIndex, FramePipeline.PortalLinkedIndices[PortalIndex]);
+			bIsInsideAny = true;
+			continue;
+		}
+
+		// series of checks to check the state of the teleport agent, for more info, check the function descriptions by hovering, or by peek definition.
+		if (PortalCandidates.Contains(PortalIndex) && Portal->IsInside(AgentLocation))
+		{
+			// Check if the actor stays in front of the portal when inside the portal collider. if a change is detected, teleport.
+			if (CheckActorInFront(Portal->GetActorTransform(), AgentTransform))
+			{
+				OutCommands.Emplace(EPortalAgentCommandType::Enter, AgentIndex, PortalIndex);
+				OutCommands.Emplace(EPortalAgentCommandType::ClipPlane, AgentIndex, PortalIndex);
+				bIsInsideAny = true;
+			}
+			else if (bHasTeleportStatus)
+			{
+				OutCommands.Emplace(EPortalAgentCommandType::Cross, AgentIndex, PortalIndex);
+				OutCommands.Emplace(EPortalAgentCommandType::ClipPlane, AgentIndex, FramePipeline.PortalLinkedIndices[PortalIndex]);
+				bIsInsideAny = true;
+			}
+		}
+		else if (bHasTeleportStatus)
+		{
+			OutCommands.Emplace(EPortalAgentCommandType::Exit, AgentIndex, PortalIndex);
+		}
+	}
+
+	// only an agent that was inside a portal collider last frame has a clip plane and changed collision to restore
+	if (!bIsInsideAny && TeleportAgent->HasAnyTeleportStatus())
+	{
+		OutCommands.Emplace(EPortalAgentCommandType::Release, AgentIndex);
+	}
+}
+
+/**
+ * Finds the portal an agent moved through since the last frame, using the segment between its previous and current location.
  *
- * This function iterates through each portal in the PortalList and checks if the portal has a linked portal.
- * If a linked portal is found, it calculates the necessary transforms and updates the portal's screen capture
- * to reflect the current state of the camera relative to the portal and its linked portal.
+ * @param PreviousLocation The location of the agent at the end of the previous teleport check.
+ * @param Location The current location of the agent.
+ * @return Index in the PortalList of the portal that was crossed first, INDEX_NONE if no portal was crossed.
  */
-void APortal3Manager::UpdatePortals()
+int32 APortal3Manager::FindSweptPortal(const FVector& PreviousLocation, const FVector& Location) const
 {
-	for (APortalV3* Portal : PortalList)
+	if (PreviousLocation.Equals(Location))
 	{
-		if (Portal->LinkedPortal == nullptr)
+		return INDEX_NONE;
+	}
+
+	FPortalCandidateArray PortalCandidates;
+	PortalBroadphase.QueryBox(FBox(PreviousLocation.ComponentMin(Location), PreviousLocation.ComponentMax(Location)), PortalCandidates);
+
+	int32 SweptPortalIndex = INDEX_NONE;
+	double FirstFraction = TNumericLimits<double>::Max();
+	for (int32 PortalIndex : PortalCandidates)
+	{
+		const APortalV3* Portal = PortalList[PortalIndex];
+		if (Portal->LinkedPortal == nullptr || Portal->PortalSlot == INDEX_NONE)
 		{
-			Portal->NullScreenCapture();
 			continue;
 		}
 
-		FTransform PortalTransform = Portal->GetActorTransform();
-		FTransform CameraTransform = PlayerController->PlayerCameraManager->GetTransform();
-
-		if (CheckPortalNeedsUpdate(Portal, PortalTransform, CameraTransform))
+		double Fraction;
+		if (Portal->IsCrossedBySegment(PreviousLocation, Location, Fraction) && Fraction < FirstFraction)
 		{
-			FTransform TargetTransform = Portal->LinkedPortal->GetActorTransform();
-
-			UpdatePortalCapture(Portal, PortalTransform, TargetTransform, CameraTransform);
+			FirstFraction = Fraction;
+			SweptPortalIndex = PortalIndex;
 		}
 	}
+	return SweptPortalIndex;
 }
 
 /**
- * Updates the screen capture for the specified portal.
+ * Executes a command emitted by EvaluateAgent. Game thread only.
  *
- * This function calculates the new capture location and rotation for the portal based on the provided
- * reference, target, and camera transforms. It then retrieves the camera's view projection and projection
- * matrices, and uses these values to update the portal's screen capture.
- *
- * @param Portal The portal to update.
- * @param Reference The reference transform used for coordinate conversion, the main portal.
- * @param Target The transform of the linked portal.
- * @param Camera The current transform of the camera.
+ * @param Command The command to execute.
  */
-void APortal3Manager::UpdatePortalCapture(APortalV3* Portal, FTransform Reference, FTransform Target, FTransform Camera)
+void APortal3Manager::ApplyAgentCommand(const FPortalAgentCommand& Command)
 {
-	APlayerCameraManager* CameraManager = PlayerController->PlayerCameraManager;
+	UTeleportAgent* TeleportAgent = TeleportAgents.GetAgent(Command.AgentIndex);
+	APortalV3* Portal = PortalList.IsValidIndex(Command.PortalIndex) ? PortalList[Command.PortalIndex] : nullptr;
 
-	FVector CaptureLocation = ConvertLocationToActorSpace(Camera, Reference, Target);
-	FQuat CaptureRotation = ConvertRotationToActorSpace(Camera, Reference, Target);
-	FMatrix ViewProjectionMatrix = GetCameraProjectionMatrix(CameraManager, true);
-	FMatrix ProjectionMatrix = GetCameraProjectionMatrix(CameraManager, false);
-
-	Portal->UpdateScreenCapture(CaptureLocation, CaptureRotation , ViewProjectionMatrix, Target, ProjectionMatrix);
-}
-
-/**
- * Checks and manages teleportation for each agent in the TeleportAgents map.
- * Iterates through each agent and evaluates its position relative to portals in the PortalList.
- * Manages teleportation status, collision settings, and clip plane for each teleport agent.
- */
-void APortal3Manager::TeleportActorsCheck()
-{
-	for (TPair<AActor*, AActor*>& Pair : TeleportAgents)
+	/**
+	 * An agent in front of a portal stops colliding with the wall the portal is on. A crossing found by the sweep
+	 * never had an Enter command, so Cross changes the collision the same way before the agent is teleported.
+	 */
+	auto EnterPortal = [TeleportAgent](const APortalV3* EnteredPortal)
 	{
-		AActor* Agent = Pair.Value; // sometimes creates a nullptr error, no clue why. temporary fix: skip it...
-		if (Agent == nullptr)
+		if (!TeleportAgent->bDoNotTeleport)
 		{
-			UE_LOG(LogTemp, Warning, TEXT("TeleportAgents Length: %d"), TeleportAgents.Num())
-			continue;
+			TeleportAgent->ChangeAgentCollision(false);
 		}
-		UTeleportAgent* TeleportAgent = Agent->FindComponentByClass<UTeleportAgent>();
-		bool bIsInsideAny = false; // a bool used to keep track wether a agent is not in any of the portal box colliders, prevents overwriting variables for multiple portals
-
-		for (APortalV3* Portal: PortalList)
+		if (EnteredPortal->PortalSlot != INDEX_NONE)
 		{
-			if (Portal->LinkedPortal == nullptr)
-			{
-				// if the portal has no linked portal skip to the next portal
-				continue;
-			}
+			TeleportAgent->SetTeleportStatusSlot(EnteredPortal->PortalSlot, true);
+		}
+	};
 
-			// series of checks to check the state of the teleport agent, for more info, check the function descriptions by hovering, or by peek definition.
-			if (Portal->IsInside(Agent->GetActorLocation()))
-			{
-				if (!TeleportAgent->bDoNotTeleport)
-				{
-					TeleportAgent->ChangeAgentCollision(false);
-				}
-				
-				// Check if the actor stays in front of the portal when inside the portal collider. if a change is detected, teleport.
-				if (CheckActorInFront(Portal->GetActorTransform(), Agent->GetActorTransform()))
-				{
-					TeleportAgent->SetTeleportStatus(Portal, true);
-					TeleportAgent->SetClipPlane(Portal->GetActorLocation(), Portal->GetActorTransform().GetRotation().GetForwardVector());
-					bIsInsideAny = true;
-				}
-				else if (TeleportAgent->GetTeleportStatus(Portal))
-				{
-					TeleportAgent->SetTeleportStatus(Portal, false);
-					TeleportActor(Agent, Portal);
-					TeleportAgent->SetTeleportStatus(Portal->LinkedPortal, true);
-					TeleportAgent->SetClipPlane(Portal->LinkedPortal->GetActorLocation(), Portal->LinkedPortal->GetActorTransform().GetRotation().GetForwardVector());
-					bIsInsideAny = true;
-				}
-			}
-			else
-			{
-				TeleportAgent->SetTeleportStatus(Portal, false);
-			}
-			if (!bIsInsideAny)
-			{
-				TeleportAgent->DisableClipPlane();
-				TeleportAgent->ResetAgentCollision();
-			}
+	switch (Command.Type)
+	{
+	case EPortalAgentCommandType::Enter:
+		EnterPortal(Portal);
+		break;
+
+	case EPortalAgentCommandType::Exit:
+		TeleportAgent->SetTeleportStatusSlot(Portal->PortalSlot, false);
+		break;
+
+	case EPortalAgentCommandType::Cross:
+		EnterPortal(Portal);
+		TeleportAgent->SetTeleportStatusSlot(Portal->PortalSlot, false);
+		TeleportActor(Command.AgentIndex, Portal);
+		// the agent arrives in front of the exit portal
+		EnterPortal(Portal->LinkedPortal);
+		break;
+
+	case EPortalAgentCommandType::ClipPlane:
+		if (Portal)
+		{
+			TeleportAgent->SetClipPlane(Portal->GetActorLocation(), Portal->GetActorTransform().GetRotation().GetForwardVector());
 		}
+		break;
+
+	case EPortalAgentCommandType::Release:
+		TeleportAgent->DisableClipPlane();
+		TeleportAgent->ResetAgentCollision();
+		break;
 	}
 }
 
@@ -285,40 +1136,57 @@ void APortal3Manager::ResetRotationControllerSlerp(float DeltaTime)
 }
 
 /**
- * Iterates through all teleport agents and checks their teleport status for each portal.
- * Clones or updates actors based on teleport status. Removes cloned actors if teleport
- * status is false for a portal.
- * Could possibly have been combined with Teleport Actors Check function!
+ * Clone sync stage. Uses the clone masks recorded by the teleport stage, so no teleport status has to be checked again.
+ * Per portal, the agents in front of it are gathered into a batch and converted through the portal pair in one pass,
+ * after which the clones are created or updated from the converted transforms. Clones through portals an agent
+ * is no longer in front of are removed.
  */
-void APortal3Manager::CloneOrUpdateAllActors()
+void APortal3Manager::SyncClones()
 {
 	bCloneState = true;
-	for (TPair<AActor*, AActor*>& Pair : TeleportAgents)
+	for (APortalV3* Portal : PortalList)
 	{
-		AActor* Agent = Pair.Value; // sometimes creates a nullptr error
-		if (Agent == nullptr)
+		if (Portal->LinkedPortal == nullptr || Portal->PortalSlot == INDEX_NONE)
 		{
-			UE_LOG(LogTemp, Warning, TEXT("TeleportAgents Length: %d"), TeleportAgents.Num())
-				continue;
+			continue;
 		}
-		UTeleportAgent* TeleportAgent = Agent->FindComponentByClass<UTeleportAgent>(); 
 
-		for (APortalV3* Portal : PortalList)
+		// gather
+		const uint64 SlotBit = uint64(1) << Portal->PortalSlot;
+		CloneBatchAgents.Reset();
+		CloneBatchIn.Reset();
+		for (int32 AgentIndex = 0; AgentIndex < FramePipeline.AgentResults.Num(); ++AgentIndex)
 		{
-			if (Portal->LinkedPortal == nullptr)
+			const FPortalAgentFrameResult& Result = FramePipeline.AgentResults[AgentIndex];
+			if (Result.CloneMask & SlotBit)
 			{
-				continue;
-			}
-			if (TeleportAgent->GetTeleportStatus(Portal))
-			{
-				UE_LOG(LogTemp, Warning, TEXT("01 Clone or Update Actor"));
-				CloneOrUpdateActor(Agent, Portal);
+				AActor* Agent = TeleportAgents.GetActor(AgentIndex);
+				CloneBatchAgents.Add(AgentIndex);
+				CloneBatchIn.Add(Agent->GetActorLocation(), Agent->GetActorQuat(), Agent->GetVelocity());
 			}
-			else
+			else if (Result.PreviousCloneMask & SlotBit)
 			{
-				RemoveClonedActor(Agent, Portal);
+				RemoveClonedActor(TeleportAgents.GetActor(AgentIndex), Portal);
 			}
 		}
+
+		if (CloneBatchAgents.Num() == 0)
+		{
+			continue;
+		}
+
+		// convert
+		Portal->GetPairTransform().TransformBatch(CloneBatchIn, CloneBatchOut);
+
+		// scatter
+		for (int32 BatchIndex = 0; BatchIndex < CloneBatchAgents.Num(); ++BatchIndex)
+		{
+			const int32 AgentIndex = CloneBatchAgents[BatchIndex];
+			const FTransform NewTransform(CloneBatchOut.Rotations[BatchIndex], CloneBatchOut.Positions[BatchIndex], TeleportAgents.GetActor(AgentIndex)->GetActorScale3D());
+
+			UE_LOG(LogTemp, VeryVerbose, TEXT("01 Clone or Update Actor"));
+			CloneOrUpdateActor(AgentIndex, Portal, NewTransform, CloneBatchOut.Velocities[BatchIndex]);
+		}
 	}
 	bCloneState = false;
 }
@@ -336,9 +1204,6 @@ bool APortal3Manager::UpdateViewportSize(APortalV3* Portal)
 	UGameViewportClient* ViewportClient = GetWorld()->GetGameViewport();
 	ViewportClient->GetViewportSize(ViewportSize);
 
-	MapAllActorsWithComponent(GetWorld(), TeleportAgents);
-	PortalList = FindAllActorsInWorld<APortalV3>(GetWorld(), ABP_PortalV2);
-
 	if (ViewportSize.X == 0 || ViewportSize.Y == 0)
 	{
 		ViewportSize = FVector2D(256, 256); 
@@ -359,6 +1224,74 @@ bool APortal3Manager::UpdateViewportSize(APortalV3* Portal)
 	return bIsViewportSucces;
 }
 
+/**
+ * Rebuilds the portal broadphase grid from the current PortalList.
+ * Should be called every time the PortalList is modified, as the grid stores indices into the list.
+ */
+void APortal3Manager::RebuildPortalBroadphase()
+{
+	PortalBroadphase.Rebuild(PortalList);
+}
+
+/**
+ * Assigns a free portal slot to every portal in the PortalList that does not have one yet.
+ */
+void APortal3Manager::AssignPortalSlots()
+{
+	for (APortalV3* Portal : PortalList)
+	{
+		if (Portal->PortalSlot != INDEX_NONE)
+		{
+			continue;
+		}
+		if (UsedPortalSlots == MAX_uint64)
+		{
+			UE_LOG(LogTemp, Error, TEXT("No free portal slot left, a maximum of %d portals is supported!"), MaxPortalSlots);
+			return;
+		}
+
+		// the first zero bit is the lowest free slot
+		Portal->PortalSlot = FMath::CountTrailingZeros64(~UsedPortalSlots);
+		UsedPortalSlots |= uint64(1) << Portal->PortalSlot;
+	}
+}
+
+/**
+ * Frees the slot of a portal that is about to be destroyed, and clears the teleport status bit
+ * of that slot for all teleport agents with a single masked AND per agent.
+ * Agents that were inside no other portal get their clip plane and collision back here, as no later frame releases them.
+ *
+ * @param Portal The portal whose slot should be released.
+ */
+void APortal3Manager::ReleasePortalSlot(APortalV3* Portal)
+{
+	if (Portal == nullptr || Portal->PortalSlot == INDEX_NONE)
+	{
+		return;
+	}
+
+	const uint64 SlotBit = uint64(1) << Portal->PortalSlot;
+	for (int32 AgentIndex = 0; AgentIndex < TeleportAgents.Num(); ++AgentIndex)
+	{
+		UTeleportAgent* TeleportAgent = TeleportAgents.GetAgent(AgentIndex);
+		if (TeleportAgent->ClearTeleportStatus(SlotBit))
+		{
+			TeleportAgent->DisableClipPlane();
+			TeleportAgent->ResetAgentCollision();
+		}
+
+		// the clone sync stage only visits live portals, so the clones through this portal are removed here
+		if (FramePipeline.AgentResults[AgentIndex].CloneMask & SlotBit)
+		{
+			RemoveClonedActor(TeleportAgents.GetActor(AgentIndex), Portal);
+		}
+	}
+	FramePipeline.ClearSlots(SlotBit);
+
+	UsedPortalSlots &= ~SlotBit;
+	Portal->PortalSlot = INDEX_NONE;
+}
+
 /**
  * Clones or updates the specified agent in the context of the given portal.
  *
@@ -367,33 +1300,39 @@ bool APortal3Manager::UpdateViewportSize(APortalV3* Portal)
  * If a cloned actor exists, it updates the cloned actor's state to match the agent.
  * Finally, it sets the clip plane on the cloned actor's teleport agent component based on the linked portal's location and forward vector.
  *
- * @param Agent The actor to be cloned or updated.
+ * @param AgentIndex The dense index of the agent to be cloned or updated in the TeleportAgents registry.
  * @param Portal The portal that influences the cloning or updating process.
+ * @param NewTransform The transform of the agent converted through the portal pair.
+ * @param NewVelocity The velocity of the agent converted through the portal pair.
  */
-void APortal3Manager::CloneOrUpdateActor(AActor* Agent, APortalV3* Portal)
+void APortal3Manager::CloneOrUpdateActor(int32 AgentIndex, APortalV3* Portal, const FTransform& NewTransform, const FVector& NewVelocity)
 {
+	AActor* Agent = TeleportAgents.GetActor(AgentIndex);
 	if (!Agent || !Portal || !Portal->LinkedPortal)
 	{
 		return;
 	}
 
-	UE_LOG(LogTemp, Warning, TEXT("02 Find Actor pointer in ClonedActors Map"));
+	UE_LOG(LogTemp, VeryVerbose, TEXT("02 Find Actor pointer in ClonedActors Map"));
 	
-	AActor* ClonedActor = FindClonedActor(Agent, Portal);
+	const FPortalClone* Clone = FindClone(Agent, Portal);
 
-	if (ClonedActor == nullptr)
+	if (Clone == nullptr)
 	{
-		UE_LOG(LogTemp, Warning, TEXT("03 Cloning Actor"));
-		CloneActor(Agent, Portal);
+		UE_LOG(LogTemp, VeryVerbose, TEXT("03 Cloning Actor"));
+		CloneActor(AgentIndex, Portal, NewTransform, NewVelocity);
+		Clone = FindClone(Agent, Portal);
 	}
 	else
 	{
-		UE_LOG(LogTemp, Warning, TEXT("06 Updating Actor"));
-		UpdateClonedActor(Agent, ClonedActor, Portal);
+		UE_LOG(LogTemp, VeryVerbose, TEXT("06 Updating Actor"));
+		UpdateClonedActor(AgentIndex, *Clone, Portal, NewTransform, NewVelocity);
+	}
+
+	if (Clone && Clone->Agent)
+	{
+		Clone->Agent->SetClipPlane(Portal->LinkedPortal->GetActorLocation(), Portal->LinkedPortal->GetActorTransform().GetRotation().GetForwardVector());
 	}
-	ClonedActor = FindClonedActor(Agent, Portal);
-	UTeleportAgent* ClonedTeleportAgent = ClonedActor->FindComponentByClass<UTeleportAgent>();
-	ClonedTeleportAgent->SetClipPlane(Portal->LinkedPortal->GetActorLocation(), Portal->LinkedPortal->GetActorTransform().GetRotation().GetForwardVector());
 }
 
 /**
@@ -401,32 +1340,28 @@ void APortal3Manager::CloneOrUpdateActor(AActor* Agent, APortalV3* Portal)
  * Depending on the type of actor (player character, projectile, or static mesh),
  * it handles cloning and transformation appropriately.
  * 
- * @param Agent The actor to be cloned.
+ * @param AgentIndex The dense index of the agent to be cloned in the TeleportAgents registry.
  * @param Portal The portal through which the actor will be cloned.
+ * @param NewTransform The transform of the agent converted through the portal pair.
+ * @param NewVelocity The velocity of the agent converted through the portal pair.
  */
-void APortal3Manager::CloneActor(AActor* Agent, APortalV3* Portal)
+void APortal3Manager::CloneActor(int32 AgentIndex, APortalV3* Portal, const FTransform& NewTransform, const FVector& NewVelocity)
 {
-	FTransform TargetTransform = Portal->LinkedPortal->GetActorTransform();
-	FTransform PortalTransform = Portal->GetActorTransform();
-	FTransform ActorTransform = Agent->GetActorTransform();
-
-	UTeleportAgent* TeleportAgent = Agent->FindComponentByClass<UTeleportAgent>();
-
-	FVector NewLocation = ConvertLocationToActorSpace(ActorTransform, PortalTransform, TargetTransform);
-	FQuat NewRotation = ConvertRotationToActorSpace(ActorTransform, PortalTransform, TargetTransform);
-	FTransform NewTransform(NewRotation, NewLocation, ActorTransform.GetScale3D());
+	AActor* Agent = TeleportAgents.GetActor(AgentIndex);
+	ETeleportAgentKind AgentKind = TeleportAgents.GetKind(AgentIndex);
 
-	TArray<AActor*> AttachedActors;
-	Agent->GetAttachedActors(AttachedActors);
+	const FPortalPairTransform& PairTransform = Portal->GetPairTransform();
+	FVector NewLocation = NewTransform.GetLocation();
+	FQuat NewRotation = NewTransform.GetRotation();
 
 	FActorSpawnParameters SpawnParams;
 	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
 
-	UE_LOG(LogTemp, Warning, TEXT("04 Cloning Actor"));
+	UE_LOG(LogTemp, VeryVerbose, TEXT("04 Cloning Actor"));
 
-	if (TeleportAgent->bIsPlayerController)
+	if (AgentKind == ETeleportAgentKind::Player)
 	{
-		FQuat NewRotationCam = ConvertRotationToActorSpace(PlayerController->PlayerCameraManager->GetTransform(), PortalTransform, TargetTransform);
+		FQuat NewRotationCam = PairTransform.TransformRotation(PlayerController->PlayerCameraManager->GetTransform().GetRotation());
 
 		ACharacter* ClonedCharacter = GetWorld()->SpawnActor<ACharacter>(Agent->GetClass(), NewLocation, NewRotation.Rotator(), SpawnParams);
 		APortal2Character* ClonedPortal2Character = Cast<APortal2Character>(ClonedCharacter);
@@ -456,15 +1391,20 @@ void APortal3Manager::CloneActor(AActor* Agent, APortalV3* Portal)
 			AnimInstance->bTransitionUp = AnimInstanceMain->bTransitionUp;
 			AnimInstance->StartPosition = AnimInstanceMain->OutPosition;
 
-			ClonedCharacter->GetCharacterMovement()->Velocity = ConvertVelocityToActorSpace(AgentPortal2Character->GetCharacterMovement()->Velocity, PortalTransform, TargetTransform);
+			ClonedCharacter->GetCharacterMovement()->Velocity = NewVelocity;
 
 			CameraComponent->SetWorldRotation(NewRotationCam);
 		}
 
 		StoreClonedActor(Agent, Portal, ClonedCharacter);
 
-		for (AActor* AttachedActor : AttachedActors)
+		for (const FTeleportAgentAttachment& Attachment : TeleportAgents.GetAgent(AgentIndex)->GetAttachments())
 		{
+			AActor* AttachedActor = Attachment.Actor.Get();
+			if (AttachedActor == nullptr)
+			{
+				continue;
+			}
 			AActor* ClonedAttachedActor = GetWorld()->SpawnActor<AActor>(AttachedActor->GetClass(), NewLocation, NewRotation.Rotator(), SpawnParams);
 			UTP_WeaponComponent* WeaponComponent = ClonedAttachedActor->FindComponentByClass<UTP_WeaponComponent>();
 			if (WeaponComponent)
@@ -473,17 +1413,17 @@ void APortal3Manager::CloneActor(AActor* Agent, APortalV3* Portal)
 			}
 		}
 	}
-	else if (Agent->IsA(APortal2Projectile::StaticClass()))
+	else if (AgentKind == ETeleportAgentKind::Projectile)
 	{
 		APortal2Projectile* ClonedProjectile = GetWorld()->SpawnActor<APortal2Projectile>(Agent->GetClass(), NewLocation, NewRotation.Rotator(), SpawnParams);
 
-		ClonedProjectile->SetProjectileMovement(ConvertVelocityToActorSpace(Cast<APortal2Projectile>(Agent)->GetVelocity(), PortalTransform, TargetTransform));
+		ClonedProjectile->SetProjectileMovement(NewVelocity);
 
 		ClonedProjectile->SetActorEnableCollision(ECollisionEnabled::NoCollision);
 
 		StoreClonedActor(Agent, Portal, ClonedProjectile);
 	}
-	else if (Agent->IsA(AActor::StaticClass()))
+	else
 	{
 		AActor* ClonedStaticMesh = GetWorld()->SpawnActor<AActor>(Agent->GetClass(), NewLocation, NewRotation.Rotator(), SpawnParams);
 		ClonedStaticMesh->SetActorTransform(NewTransform);
@@ -491,11 +1431,11 @@ void APortal3Manager::CloneActor(AActor* Agent, APortalV3* Portal)
 		UPrimitiveComponent* PrimitiveComponent = Cast<UPrimitiveComponent>(ClonedStaticMesh->GetRootComponent());
 		if (PrimitiveComponent)
 		{
-			PrimitiveComponent->SetPhysicsLinearVelocity(ConvertVelocityToActorSpace(Cast<AActor>(Agent)->GetVelocity(), PortalTransform, TargetTransform));
+			PrimitiveComponent->SetPhysicsLinearVelocity(NewVelocity);
 		}
 		StoreClonedActor(Agent, Portal, ClonedStaticMesh);
 	}
-	UE_LOG(LogTemp, Warning, TEXT("05 Cloned Actor"));
+	UE_LOG(LogTemp, VeryVerbose, TEXT("05 Cloned Actor"));
 }
 
 /**
@@ -503,33 +1443,31 @@ void APortal3Manager::CloneActor(AActor* Agent, APortalV3* Portal)
  * and the portal through which it was cloned. Depending on the type of actor (player character, projectile, or static mesh),
  * it handles cloning and transformation appropriately.
  * 
- * @param Agent The original actor whose clone is being updated.
- * @param ClonedActor The cloned actor that needs to be updated.
+ * @param AgentIndex The dense index of the original agent in the TeleportAgents registry.
+ * @param Clone The clone that needs to be updated, with its cached teleport agent.
  * @param Portal The portal through which the actor was cloned.
+ * @param NewTransform The transform of the agent converted through the portal pair.
+ * @param NewVelocity The velocity of the agent converted through the portal pair.
  */
-void APortal3Manager::UpdateClonedActor(AActor* Agent, AActor* ClonedActor, APortalV3* Portal)
+void APortal3Manager::UpdateClonedActor(int32 AgentIndex, const FPortalClone& Clone, APortalV3* Portal, const FTransform& NewTransform, const FVector& NewVelocity)
 {
-	FTransform TargetTransform = Portal->LinkedPortal->GetActorTransform();
-	FTransform PortalTransform = Portal->GetActorTransform();
-	FTransform ActorTransform = Agent->GetActorTransform();
+	AActor* ClonedActor = Clone.Actor;
+	AActor* Agent = TeleportAgents.GetActor(AgentIndex);
+	ETeleportAgentKind AgentKind = TeleportAgents.GetKind(AgentIndex);
 
-	UTeleportAgent* TeleportAgent = Agent->FindComponentByClass<UTeleportAgent>();
+	const FPortalPairTransform& PairTransform = Portal->GetPairTransform();
 
-	FVector NewLocation = ConvertLocationToActorSpace(ActorTransform, PortalTransform, TargetTransform);
-	FQuat NewRotation = ConvertRotationToActorSpace(ActorTransform, PortalTransform, TargetTransform);
-	FTransform NewTransform(NewRotation, NewLocation, ActorTransform.GetScale3D());
-
-	UE_LOG(LogTemp, Warning, TEXT("07 Updating Actor"));
+	UE_LOG(LogTemp, VeryVerbose, TEXT("07 Updating Actor"));
 
 	//ClonedActor->SetActorLocationAndRotation(NewLocation, NewRotation);
 	ClonedActor->SetActorTransform(NewTransform);
 
-	if (TeleportAgent->bIsPlayerController)
+	if (AgentKind == ETeleportAgentKind::Player)
 	{
 		APortal2Character* PlayerCharacter = Cast<APortal2Character>(Agent);
 		APortal2Character* ClonedPortal2Character = Cast<APortal2Character>(ClonedActor);
 
-		FQuat NewRotationCam = ConvertRotationToActorSpace(PlayerController->PlayerCameraManager->GetTransform(), PortalTransform, TargetTransform);
+		FQuat NewRotationCam = PairTransform.TransformRotation(PlayerController->PlayerCameraManager->GetTransform().GetRotation());
 
 		UCameraComponent* CameraComponent = ClonedPortal2Character->GetFirstPersonCameraComponent();
 
@@ -548,33 +1486,32 @@ void APortal3Manager::UpdateClonedActor(AActor* Agent, AActor* ClonedActor, APor
 
 			if (AnimInstanceMain->bFire == true)
 			{
-				TArray<AActor*> Weapons;
-				TArray<AActor*> Weapons2;
-				ClonedActor->GetAttachedActors(Weapons);
-				Agent->GetAttachedActors(Weapons2);
-				UTP_WeaponComponent* WeaponComp = Weapons[0]->FindComponentByClass<UTP_WeaponComponent>();
-				UTP_WeaponComponent* WeaponComp2 = Weapons2[0]->FindComponentByClass<UTP_WeaponComponent>();
-				WeaponComp->PlayFireAnimation(false);
-				WeaponComp2->PlayFireAnimation(false);
+				// the weapons are cached by the teleport agents when they are attached
+				UTP_WeaponComponent* WeaponComp = Clone.Agent ? Clone.Agent->GetAttachedWeapon() : nullptr;
+				UTP_WeaponComponent* WeaponComp2 = TeleportAgents.GetAgent(AgentIndex)->GetAttachedWeapon();
+				if (WeaponComp && WeaponComp2)
+				{
+					WeaponComp->PlayFireAnimation(false);
+					WeaponComp2->PlayFireAnimation(false);
+				}
 			}
 
-			ClonedPortal2Character->GetCharacterMovement()->Velocity = ConvertVelocityToActorSpace(PlayerCharacter->GetCharacterMovement()->Velocity, PortalTransform, TargetTransform);
+			ClonedPortal2Character->GetCharacterMovement()->Velocity = NewVelocity;
 
 			CameraComponent->SetWorldRotation(NewRotationCam);
 		}
 	}
-	else if (TeleportAgent->IsA(APortal2Projectile::StaticClass()))
+	else if (AgentKind == ETeleportAgentKind::Projectile)
 	{
-		APortal2Projectile* Projectile = Cast<APortal2Projectile>(Agent);
 		APortal2Projectile* ClonedProjectile = Cast<APortal2Projectile>(ClonedActor);
-		ClonedProjectile->SetProjectileMovement(ConvertVelocityToActorSpace(Projectile->GetVelocity(), PortalTransform, TargetTransform));
+		ClonedProjectile->SetProjectileMovement(NewVelocity);
 	}
-	else if (TeleportAgent->IsA(AActor::StaticClass()))
+	else
 	{
 		UPrimitiveComponent* PrimitiveComponent = Cast<UPrimitiveComponent>(ClonedActor->GetRootComponent());
 		if (PrimitiveComponent)
 		{
-			PrimitiveComponent->SetPhysicsLinearVelocity(ConvertVelocityToActorSpace(Agent->GetVelocity(), PortalTransform, TargetTransform));
+			PrimitiveComponent->SetPhysicsLinearVelocity(NewVelocity);
 		}
 	}
 }
@@ -652,8 +1589,7 @@ void APortal3Manager::CreateNewPortal(FVector PortalCenter, FQuat PortalRotation
 
 	NewPortal->bIsOrangePortal = bIsOrangePortal;
 
-	PortalList = FindAllActorsInWorld<APortalV3>(GetWorld(), ABP_PortalV2);
-
+	// the portal registered itself in BeginPlay, during SpawnActor
 	UpdateViewportSize(NewPortal);
 }
 
@@ -669,7 +1605,9 @@ void APortal3Manager::DestroyOldPortal(bool bIsOrangePortal)
 	{
 		if (OrangePortal != nullptr)
 		{
-			OrangePortal->PortalDestroySelf();
+			APortalV3* OldPortal = OrangePortal;
+			UnregisterPortal(OldPortal);
+			OldPortal->PortalDestroySelf();
 			OrangePortal = nullptr;
 		}
 	}
@@ -677,11 +1615,59 @@ void APortal3Manager::DestroyOldPortal(bool bIsOrangePortal)
 	{
 		if (BluePortal != nullptr)
 		{
-			BluePortal->PortalDestroySelf();
+			APortalV3* OldPortal = BluePortal;
+			UnregisterPortal(OldPortal);
+			OldPortal->PortalDestroySelf();
 			BluePortal = nullptr;
 		}
 	}
-	PortalList = FindAllActorsInWorld<APortalV3>(GetWorld(), ABP_PortalV2);
+}
+
+/**
+ * Adds a portal to the PortalList, assigns it a portal slot and inserts it into the broadphase.
+ * Does nothing if the portal is already registered.
+ *
+ * @param Portal The portal to register.
+ */
+void APortal3Manager::RegisterPortal(APortalV3* Portal)
+{
+	if (Portal == nullptr || PortalList.Contains(Portal))
+	{
+		return;
+	}
+
+	PortalList.Add(Portal);
+
+	// a new portal counts as visible until its first visibility traces are back, so it never shows an empty frame
+	Portal->LineOfSightFramesLeft = LineOfSightHoldFrames;
+	AssignPortalSlots();
+	RebuildPortalBroadphase();
+}
+
+/**
+ * Removes a portal from the PortalList, releases its portal slot and removes it from the broadphase.
+ * Called by the manager before destroying a portal, and by the portal itself when it ends play for another reason.
+ *
+ * @param Portal The portal to unregister.
+ */
+void APortal3Manager::UnregisterPortal(APortalV3* Portal)
+{
+	if (Portal == nullptr || PortalList.Remove(Portal) == 0)
+	{
+		return;
+	}
+
+	ReleasePortalSlot(Portal);
+	RebuildPortalBroadphase();
+
+	if (Portal == OrangePortal)
+	{
+		OrangePortal = nullptr;
+	}
+	else if (Portal == BluePortal)
+	{
+		BluePortal = nullptr;
+	}
 }
 
 /**
@@ -694,25 +1680,33 @@ void APortal3Manager::DestroyOldPortal(bool bIsOrangePortal)
  * @param CameraTransform The current transform of the camera.
  * @return true if the portal needs an update, false otherwise.
  */
-bool APortal3Manager::CheckPortalNeedsUpdate(APortalV3* Portal, FTransform Reference, FTransform Camera)
+bool APortal3Manager::CheckPortalNeedsUpdate(APortalV3* Portal, FTransform Reference, FTransform Camera, const FConvexVolume& CameraFrustum, const FPortalCornerArray& PortalCorners)
 {
 	if (PlayerPortalDistance(Reference, Camera))
 	{
 		return true;
 	}
 
-	FQuat RotationQuat = FQuat(FRotator(0.f, 45.f, 0.f));
-	FQuat RotationQuatInverse = FQuat(FRotator(0.f, -45.f, 0.f));
+	/**
+	 * The camera has to be in front of the portal, and the portal quad has to intersect the view frustum.
+	 * Only portals that pass both cheap tests are traced against the world.
+	 */
+	const bool bWasInCameraView = Portal->bInCameraView;
+	Portal->bInCameraView = CheckActorInFront(Reference, Camera) && FPortalMath::IsQuadInFrustum(CameraFrustum.Planes, PortalCorners);
+	if (!Portal->bInCameraView)
+	{
+		return false;
+	}
 
-	if (CheckActorInFront(Reference, Camera) && CheckActorInFront(FTransform(Camera.GetRotation() * RotationQuat, Camera.GetLocation(), Camera.GetScale3D()), Reference) && CheckActorInFront(FTransform(Camera.GetRotation() * RotationQuatInverse, Camera.GetLocation(), Camera.GetScale3D()), Reference))
+	/**
+	 * The line of sight left over from when the portal went out of view is stale. A portal coming back into view counts
+	 * as visible until its first traces are back, like a new portal, so it never shows its old texture for a frame.
+	 */
+	if (!bWasInCameraView)
 	{
-		TArray<FVector> PortalBounds = Portal->GetPortalBounds();
-		if (CheckPlayerPortalLineOfSigth(PortalBounds, Camera, Portal))
-		{
-			return true;
-		}
+		Portal->LineOfSightFramesLeft = LineOfSightHoldFrames;
 	}
-	return false;
+	return CheckPlayerPortalLineOfSigth(Portal, PortalCorners, Camera);
 }
 
 /**
@@ -740,7 +1734,7 @@ bool APortal3Manager::PlayerPortalDistance(FTransform Reference, FTransform Came
  * @param Camera The transform representing the camera or actor position to check.
  * @return True if the camera or actor position is in front of the reference plane, false otherwise.
  */
-bool APortal3Manager::CheckActorInFront(FTransform Reference, FTransform Camera)
+bool APortal3Manager::CheckActorInFront(FTransform Reference, FTransform Camera) const
 {
 	FPlane PortalPlane = FPlane(Reference.GetLocation(), Reference.GetRotation().GetForwardVector());
 	float PortalDot = PortalPlane.PlaneDot(Camera.GetLocation());
@@ -753,42 +1747,90 @@ bool APortal3Manager::CheckActorInFront(FTransform Reference, FTransform Camera)
 }
 
 /**
- * Checks if the player's camera has a clear line of sight to any corner of a portal, using raycasting.
+ * Checks if the player's camera has a clear line of sight to a portal.
+ * Issues asynchronous traces from the camera to the 4 corners and the centre of the portal, and returns the result
+ * of the traces of the previous frames, so the game thread never waits on the physics scene.
  *
- * @param PortalBounds Array of corner points defining the bounding volume of the portal in world space.
+ * @param Portal The portal to check.
+ * @param PortalCorners The 4 corners of the portal, see APortalV3::GetPortalBounds.
  * @param Camera Transform representing the player's camera position and orientation.
- * @param Portal Pointer to the portal actor to exclude from the raycast checks (to avoid self-intersection).
- * @return True if there is a clear line of sight from the camera to any portal corner, false otherwise.
+ * @return True if a trace reached the portal within the last LineOfSightHoldFrames frames.
+ */
+bool APortal3Manager::CheckPlayerPortalLineOfSigth(APortalV3* Portal, const FPortalCornerArray& PortalCorners, const FTransform& Camera)
+{
+	const FCollisionQueryParams CollisionParams(SCENE_QUERY_STAT(PortalVisibility), false);
+
+	FPortalVisibilityTraces& Traces = VisibilityTraces.AddDefaulted_GetRef();
+	Traces.Portal = Portal;
+	for (int32 TraceIndex = 0; TraceIndex < FPortalVisibilityTraces::NumTraces; ++TraceIndex)
+	{
+		// the centre catches the case where a pillar or door frame blocks all 4 corners but not the middle of the portal
+		const FVector End = PortalCorners.IsValidIndex(TraceIndex) ? PortalCorners[TraceIndex] : Portal->GetActorLocation();
+		Traces.Handles[TraceIndex] = GetWorld()->AsyncLineTraceByChannel(EAsyncTraceType::Single, Camera.GetLocation(), End, ECC_Visibility, CollisionParams);
+	}
+
+	return Portal->LineOfSightFramesLeft > 0;
+}
+
+/**
+ * Reads back the visibility traces issued in the previous frame, and updates the line of sight of their portals.
  */
-bool APortal3Manager::CheckPlayerPortalLineOfSigth(TArray<FVector> PortalBounds, FTransform Camera, AActor* Portal)
+void APortal3Manager::ConsumeVisibilityTraces()
 {
-	for (const FVector& Corner : PortalBounds)
+	UWorld* World = GetWorld();
+	for (const FPortalVisibilityTraces& Traces : VisibilityTraces)
 	{
-		//DrawDebugSphere(GetWorld(), Corner, 20, 12, FColor::Green, false, -1.0f, 0, 1);
-		if (RaycastClear(Camera.GetLocation(), Corner, Portal))
+		APortalV3* Portal = Traces.Portal.Get();
+		if (Portal == nullptr)
 		{
-			return true;
+			continue;
+		}
+
+		bool bAnyResult = false;
+		bool bAnyClear = false;
+		for (const FTraceHandle& Handle : Traces.Handles)
+		{
+			FTraceDatum Datum;
+			if (World->QueryTraceData(Handle, Datum))
+			{
+				bAnyResult = true;
+				bAnyClear |= IsTraceClear(Datum, Portal);
+			}
+		}
+
+		/**
+		 * One clear trace refreshes the line of sight for a few frames, and a portal only loses it after that many frames
+		 * without a clear trace. Traces without a result, for example after a hitch, leave the line of sight as it was.
+		 */
+		if (bAnyClear)
+		{
+			Portal->LineOfSightFramesLeft = LineOfSightHoldFrames;
+		}
+		else if (bAnyResult)
+		{
+			Portal->LineOfSightFramesLeft = FMath::Max(0, Portal->LineOfSightFramesLeft - 1);
 		}
 	}
-	return false;
+	VisibilityTraces.Reset();
 }
 
 /**
- * Performs a line trace to check if there are any obstructions between two points (Start and End).
+ * Checks the result of a single visibility trace.
  *
- * @param Start The starting point of the raycast.
- * @param End The end point of the raycast.
- * @param Portal Pointer to the portal actor to exclude from the raycast check (to avoid self-intersection).
- * @return True if there are no obstructions between Start and End, or if the only obstruction is the Portal itself. False otherwise.
+ * @param Datum The finished trace.
+ * @param Portal The portal the trace was aimed at.
+ * @return True if nothing blocked the trace, or if the only obstruction is the Portal itself. False otherwise.
  */
-bool APortal3Manager::RaycastClear(const FVector& Start, const FVector& End, AActor* Portal)
+bool APortal3Manager::IsTraceClear(const FTraceDatum& Datum, const AActor* Portal)
 {
-	FHitResult HitResult;
-	FCollisionQueryParams CollisionParams;
-
-	bool bHit = GetWorld()->LineTraceSingleByChannel(HitResult, Start, End, ECC_Visibility, CollisionParams);
-
-	return !bHit || HitResult.GetActor() == Portal;
+	for (const FHitResult& HitResult : Datum.OutHits)
+	{
+		if (HitResult.bBlockingHit && HitResult.GetActor() != Portal)
+		{
+			return false;
+		}
+	}
+	return true;
 }
 
 /**
@@ -802,69 +1844,6 @@ bool APortal3Manager::GetCloneStatus()
 	return bCloneState;
 }
 
-/**
- * Converts a location from one actor's space (Camera) to another actor's space (Target) based on a reference actor (Reference).
- * In the portal project, this is used to both teleport actors and update screencapture camera positions.
- *
- * @param Camera The transform of the camera or source actor from which the location is being converted.
- * @param Reference The transform of the reference actor to which the Camera's location is relative.
- * @param Target The transform of the target actor to which the converted location is relative.
- * @return The location vector converted to the space of the Target actor.
- */
-FVector APortal3Manager::ConvertLocationToActorSpace(FTransform Camera, FTransform Reference, FTransform Target)
-{
-	FVector Direction = Camera.GetLocation() - Reference.GetLocation();
-
-	FVector Dots;
-	Dots.X = FVector::DotProduct(Direction, Reference.GetRotation().GetForwardVector());
-	Dots.Y = FVector::DotProduct(Direction, Reference.GetRotation().GetRightVector());
-	Dots.Z = FVector::DotProduct(Direction, Reference.GetRotation().GetUpVector());
-
-	FVector NewDirection = Dots.X * -Target.GetRotation().GetForwardVector() + Dots.Y * -Target.GetRotation().GetRightVector() + Dots.Z * Target.GetRotation().GetUpVector();
-
-	return Target.GetLocation() + NewDirection;
-}
-
-/**
- * Converts a rotation from one actor's space (Camera) to another actor's space (Target) based on a reference actor (Reference).
- * In the portal project, this is used to both rotate teleported actors and update screencapture camera rotations.
- *
- * @param Camera The transform of the camera or source actor from which the rotation is being converted.
- * @param Reference The transform of the reference actor to which the Camera's rotation is relative.
- * @param Target The transform of the target actor to which the converted rotation is relative.
- * @return The rotation quaternion converted to the space of the Target actor.
- */
-FQuat APortal3Manager::ConvertRotationToActorSpace(FTransform Camera, FTransform Reference, FTransform Target)
-{
-	FQuat LocalQuat = Reference.GetRotation().Inverse() * Camera.GetRotation();
-	LocalQuat = FQuat(FVector::UpVector, PI) * LocalQuat;
-
-	return Target.GetRotation() * LocalQuat;
-}
-
-/**
- * Converts a velocity vector from one actor's space (Reference) to another actor's space (Target).
- * In the portal project, this is used to update the velocity vector of teleported actors.
- *
- * @param Object The velocity vector of the object in the Reference actor's space.
- * @param Reference The transform of the reference actor whose space the velocity is relative to.
- * @param Target The transform of the target actor to which the converted velocity should be relative.
- * @return The velocity vector converted to the space of the Target actor.
- */
-FVector APortal3Manager::ConvertVelocityToActorSpace(FVector Object, FTransform Reference, FTransform Target)
-{
-	FVector Direction = Object;
-
-	FVector Dots;
-	Dots.X = FVector::DotProduct(Direction, Reference.GetRotation().GetForwardVector());
-	Dots.Y = FVector::DotProduct(Direction, Reference.GetRotation().GetRightVector());
-	Dots.Z = FVector::DotProduct(Direction, Reference.GetRotation().GetUpVector());
-
-	FVector NewVelocity = Dots.X * -Target.GetRotation().GetForwardVector() + Dots.Y * -Target.GetRotation().GetRightVector() + Dots.Z * Target.GetRotation().GetUpVector();
-
-	return NewVelocity;
-}
-
 /**
  * Retrieves the camera projection matrix based on the current view or projection settings.
  *
@@ -874,7 +1853,7 @@ FVector APortal3Manager::ConvertVelocityToActorSpace(FVector Object, FTransform
  */
 FMatrix APortal3Manager::GetCameraProjectionMatrix(APlayerCameraManager* CameraManagerIn, bool bIsView)
 {
-	FMinimalViewInfo CameraView = CameraManagerIn->GetCameraCacheView();
+	FMinimalViewInfo CameraView = GetPlayerCameraView(CameraManagerIn);
 
 	FMatrix ViewMatrix;
 	FMatrix ProjectionMatrix;
@@ -891,31 +1870,63 @@ FMatrix APortal3Manager::GetCameraProjectionMatrix(APlayerCameraManager* CameraM
 	}
 }
 
+/**
+ * Gets the camera view of the player as it is rendered. The cached camera view only knows the aspect ratio of the camera,
+ * the view that is rendered uses the aspect ratio of the player's part of the screen when split screen is used.
+ *
+ * @param CameraManagerIn The player camera manager instance that manages the camera settings.
+ * @return The camera view with the aspect ratio of the player's viewport.
+ */
+FMinimalViewInfo APortal3Manager::GetPlayerCameraView(APlayerCameraManager* CameraManagerIn) const
+{
+	FMinimalViewInfo CameraView = CameraManagerIn->GetCameraCacheView();
+
+	/**
+	 * A constrained aspect ratio is letterboxed to the camera aspect ratio, otherwise the view stretches to the player's viewport.
+	 * The split screen layout gives every local player a fraction of the game viewport.
+	 */
+	const ULocalPlayer* LocalPlayer = PlayerController ? PlayerController->GetLocalPlayer() : nullptr;
+	UGameViewportClient* ViewportClient = GetWorld()->GetGameViewport();
+	if (!CameraView.bConstrainAspectRatio && LocalPlayer != nullptr && ViewportClient != nullptr)
+	{
+		FVector2D ViewportSize;
+		ViewportClient->GetViewportSize(ViewportSize);
+
+		const FVector2D PlayerViewSize = ViewportSize * LocalPlayer->Size;
+		if (PlayerViewSize.X > 0.0 && PlayerViewSize.Y > 0.0)
+		{
+			CameraView.AspectRatio = PlayerViewSize.X / PlayerViewSize.Y;
+		}
+	}
+	return CameraView;
+}
+
 /**
  * Teleports the specified actor through the given portal.
  *
- * @param Agent The actor to teleport.
+ * @param AgentIndex The dense index of the agent to teleport in the TeleportAgents registry.
  * @param Portal The portal through which the actor will be teleported.
  */
-void APortal3Manager::TeleportActor(AActor* Agent, APortalV3* Portal)
+void APortal3Manager::TeleportActor(int32 AgentIndex, APortalV3* Portal)
 {
-	UTeleportAgent* TeleportAgent = Agent->FindComponentByClass<UTeleportAgent>();
-	
-	FTransform PortalTransform = Portal->GetActorTransform();
-	FTransform TargetTransform = Portal->LinkedPortal->GetActorTransform();
+	AActor* Agent = TeleportAgents.GetActor(AgentIndex);
+	ETeleportAgentKind AgentKind = TeleportAgents.GetKind(AgentIndex);
+
+	const FPortalPairTransform& PairTransform = Portal->GetPairTransform();
 	FTransform ActorTransform = Agent->GetActorTransform();
 
-	FVector NewLocation = ConvertLocationToActorSpace(ActorTransform, PortalTransform, TargetTransform);
-	FQuat NewRotation = ConvertRotationToActorSpace(ActorTransform, PortalTransform, TargetTransform);
-	FVector NewVelocity = ConvertVelocityToActorSpace(Agent->GetVelocity() ,PortalTransform, TargetTransform);
+	FVector NewLocation = PairTransform.TransformPosition(ActorTransform.GetLocation());
+	FQuat NewRotation = PairTransform.TransformRotation(ActorTransform.GetRotation());
+	FVector NewVelocity = PairTransform.TransformVector(Agent->GetVelocity());
 
-	USceneComponent* RootComponent2 = Agent->GetRootComponent();
-	UPrimitiveComponent* PrimitiveRootComponent = Cast<UPrimitiveComponent>(RootComponent2);
-	PrimitiveRootComponent->SetPhysicsLinearVelocity(NewVelocity);
+	if (UPrimitiveComponent* PrimitiveRootComponent = TeleportAgents.GetRootPrimitive(AgentIndex))
+	{
+		PrimitiveRootComponent->SetPhysicsLinearVelocity(NewVelocity);
+	}
 
 	FHitResult HitResult;
 
-	if (TeleportAgent->bIsPlayerController)
+	if (AgentKind == ETeleportAgentKind::Player)
 	{
 		Agent->SetActorLocation(NewLocation, false, &HitResult, ETeleportType::TeleportPhysics);
 
@@ -926,18 +1937,15 @@ void APortal3Manager::TeleportActor(AActor* Agent, APortalV3* Portal)
 		Char->bUseControllerRotationRoll = false;
 		
 
-		FRotator NewRotation2 = PlayerController->GetControlRotation();
-		FQuat LocalQuat = PortalTransform.GetRotation().Inverse() * NewRotation2.Quaternion();
-		LocalQuat = FQuat(FVector::UpVector, PI) * LocalQuat;
-		LocalQuat = TargetTransform.GetRotation() * LocalQuat;
-		
-		
+		// the control rotation goes through the same conversion as the actor rotation
+		FQuat LocalQuat = PairTransform.TransformRotation(PlayerController->GetControlRotation().Quaternion());
+
 		PlayerController->SetControlRotation(FRotator(LocalQuat.Rotator().Pitch, LocalQuat.Rotator().Yaw, LocalQuat.Rotator().Roll));
 		PlayerController->GetCharacter()->GetCharacterMovement()->Velocity = NewVelocity;
 
 		//Agent->SetActorRotation(FRotator(NewRotation.Rotator().Pitch, NewRotation.Rotator().Yaw, NewRotation.Rotator().Roll));
 	}
-	else if (Agent->IsA(APortal2Projectile::StaticClass()))
+	else if (AgentKind == ETeleportAgentKind::Projectile)
 	{
 		Agent->SetActorLocation(NewLocation, false, &HitResult, ETeleportType::TeleportPhysics);
 		Agent->SetActorRotation(NewRotation);
@@ -952,29 +1960,23 @@ void APortal3Manager::TeleportActor(AActor* Agent, APortalV3* Portal)
 }
 
 /**
- * Maps all actors in the world that have a UTeleportAgent component, excluding those with bDoNotTeleport set to true.
+ * Determines the agent kind of an actor, which decides how the actor is teleported and cloned.
  *
- * @param World The world context to search for actors.
- * @param OutActors The output map where mapped actors will be stored (Key: Actor with UTeleportAgent component, Value: Actor itself).
+ * @param Actor The actor owning the teleport agent component.
+ * @param TeleportAgent The teleport agent component of the actor.
+ * @return The kind of the teleport agent.
  */
-void APortal3Manager::MapAllActorsWithComponent(UWorld* World, TMap<AActor*, AActor*>& OutActors)
+ETeleportAgentKind APortal3Manager::GetAgentKind(AActor* Actor, UTeleportAgent* TeleportAgent) const
 {
-	if (!World)
+	if (TeleportAgent->bIsPlayerController)
 	{
-		return;
+		return ETeleportAgentKind::Player;
 	}
-
-	for (TActorIterator<AActor> It(World); It; ++It)
+	if (Actor->IsA(APortal2Projectile::StaticClass()))
 	{
-		AActor* Actor = *It;
-		if (Actor->FindComponentByClass<UTeleportAgent>())
-		{
-			if (!Actor->FindComponentByClass<UTeleportAgent>()->bDoNotTeleport)
-			{
-				OutActors.FindOrAdd(Actor, Actor);
-			}
-		}
+		return ETeleportAgentKind::Projectile;
 	}
+	return ETeleportAgentKind::Prop;
 }
 
 /**
@@ -986,13 +1988,25 @@ void APortal3Manager::MapAllActorsWithComponent(UWorld* World, TMap<AActor*, AAc
  */
 AActor* APortal3Manager::FindClonedActor(AActor* Agent, APortalV3* Portal)
 {
-	FAgentPortalKey Key(Agent, Portal);
-	AActor** ClonedActorPtr = ClonedActors.Find(Key);
-	return ClonedActorPtr ? *ClonedActorPtr : nullptr;
+	const FPortalClone* Clone = FindClone(Agent, Portal);
+	return Clone ? Clone->Actor : nullptr;
+}
+
+/**
+ * Finds the clone corresponding to the given Agent and Portal, together with its cached teleport agent.
+ *
+ * @param Agent The original actor that was cloned.
+ * @param Portal The portal through which the actor was cloned.
+ * @return The clone corresponding to Agent and Portal, or nullptr if not found.
+ */
+const FPortalClone* APortal3Manager::FindClone(AActor* Agent, APortalV3* Portal) const
+{
+	return ClonedActors.Find(FAgentPortalKey(Agent, Portal));
 }
 
 /**
  * Stores the cloned actor corresponding to the given Agent and Portal in the ClonedActors map.
+ * The teleport agent component of the clone is looked up once here and cached next to it.
  *
  * @param Agent The original actor that was cloned.
  * @param Portal The portal through which the actor was cloned.
@@ -1001,7 +2015,10 @@ AActor* APortal3Manager::FindClonedActor(AActor* Agent, APortalV3* Portal)
 void APortal3Manager::StoreClonedActor(AActor* Agent, APortalV3* Portal, AActor* ClonedActor)
 {
 	FAgentPortalKey Key(Agent, Portal);
-	ClonedActors.Add(Key, ClonedActor);
+	FPortalClone Clone;
+	Clone.Actor = ClonedActor;
+	Clone.Agent = ClonedActor ? ClonedActor->FindComponentByClass<UTeleportAgent>() : nullptr;
+	ClonedActors.Add(Key, Clone);
 }
 
 /**
@@ -1013,16 +2030,22 @@ void APortal3Manager::StoreClonedActor(AActor* Agent, APortalV3* Portal, AActor*
 void APortal3Manager::RemoveClonedActor(AActor* Agent, APortalV3* Portal)
 {
 	FAgentPortalKey Key(Agent, Portal);
-	AActor* ClonedActor = FindClonedActor(Agent, Portal);
-	if (ClonedActor != nullptr)
+	const FPortalClone* Clone = FindClone(Agent, Portal);
+	if (Clone != nullptr && Clone->Actor != nullptr)
 	{
-		UE_LOG(LogTemp, Warning, TEXT("08 Removing Cloned Actor"));
-		TArray<AActor*> AttachedActors;
-		ClonedActor->GetAttachedActors(AttachedActors);
-
-		for (AActor* AttachedActor : AttachedActors)
+		UE_LOG(LogTemp, VeryVerbose, TEXT("08 Removing Cloned Actor"));
+		AActor* ClonedActor = Clone->Actor;
+		if (UTeleportAgent* ClonedTeleportAgent = Clone->Agent)
 		{
-			AttachedActor->Destroy();
+			// copied, destroying an attachment removes it from the cached list
+			const TArray<FTeleportAgentAttachment, TInlineAllocator<2>> Attachments = ClonedTeleportAgent->GetAttachments();
+			for (const FTeleportAgentAttachment& Attachment : Attachments)
+			{
+				if (AActor* AttachedActor = Attachment.Actor.Get())
+				{
+					AttachedActor->Destroy();
+				}
+			}
 		}
 
 		ClonedActors.Remove(Key);
@@ -1031,24 +2054,32 @@ void APortal3Manager::RemoveClonedActor(AActor* Agent, APortalV3* Portal)
 }
 
 /**
- * Function that can be called to add a actor with the UTeleportAgent component to the teleportable actors map.
+ * Function that can be called to add a actor with the UTeleportAgent component to the teleportable actors registry.
+ * The component and agent kind are cached in the registry, so they are never searched for again during the tick.
  */
 void APortal3Manager::HandleActorSpawned(AActor* Actor)
 {
-	if (Actor->FindComponentByClass<UTeleportAgent>())
+	if (Actor == nullptr || TeleportAgents.Contains(Actor))
+	{
+		return;
+	}
+
+	if (UTeleportAgent* TeleportAgent = Actor->FindComponentByClass<UTeleportAgent>())
 	{
-		TeleportAgents.FindOrAdd(Actor, Actor);
+		TeleportAgents.Add(Actor, TeleportAgent, GetAgentKind(Actor, TeleportAgent));
+		FramePipeline.OnAgentAdded(Actor->GetActorLocation());
 	}
 }
 
 /**
- * Function that can be called to remove a actor with the UTeleportAgent component to the teleportable actors map.
+ * Function that can be called to remove a actor with the UTeleportAgent component from the teleportable actors registry.
  */
 void APortal3Manager::HandleActorDestroyed(AActor* Actor)
 {
-	if (Actor->FindComponentByClass<UTeleportAgent>())
+	const int32 DenseIndex = TeleportAgents.GetDenseIndex(TeleportAgents.FindHandle(Actor));
+	if (TeleportAgents.Remove(Actor))
 	{
-		UE_LOG(LogTemp, Warning, TEXT("Removed Actor"));
-		TeleportAgents.Remove(Actor);
+		FramePipeline.OnAgentRemoved(DenseIndex);
+		UE_LOG(LogTemp, VeryVerbose, TEXT("Removed Actor"));
 	}
-}
\ No newline at end of file
+}
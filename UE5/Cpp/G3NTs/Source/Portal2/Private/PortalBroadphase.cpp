@@ -0,0 +1,153 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalBroadphase.h"
+#include "PortalV3.h"
+
+FPortalBroadphase::FPortalBroadphase()
+	: CellSize(256.0)
+{
+}
+
+/**
+ * Rebuilds the grid from the given portal list. The indices returned by the queries are indices into this list.
+ *
+ * @param Portals The portals to insert into the grid.
+ */
+void FPortalBroadphase::Rebuild(const TArray<APortalV3*>& Portals)
+{
+	Reset();
+	PortalBounds.Reserve(Portals.Num());
+
+	for (int32 PortalIndex = 0; PortalIndex < Portals.Num(); ++PortalIndex)
+	{
+		APortalV3* Portal = Portals[PortalIndex];
+		if (Portal == nullptr)
+		{
+			// keep the indices in line with the portal list, an empty box never contains a point
+			PortalBounds.Add(FBox(ForceInit));
+			continue;
+		}
+
+		const FBox Bounds = Portal->GetTeleportBounds();
+		PortalBounds.Add(Bounds);
+
+		/**
+		 * Insert the portal into every cell its bounds overlap.
+		 * Portal colliders are small compared to the cell size, so this is only a handful of cells.
+		 */
+		const FIntVector MinCell = GetCell(Bounds.Min);
+		const FIntVector MaxCell = GetCell(Bounds.Max);
+
+		for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+		{
+			for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+			{
+				for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+				{
+					Cells.FindOrAdd(FIntVector(X, Y, Z)).Add(PortalIndex);
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Removes all portals from the grid.
+ */
+void FPortalBroadphase::Reset()
+{
+	Cells.Reset();
+	PortalBounds.Reset();
+}
+
+/**
+ * Gathers all portals whose teleport bounds contain the given point.
+ *
+ * @param Point The world location to check, usually the location of a teleport agent.
+ * @param OutPortalIndices Output array the candidate portal indices are added to.
+ */
+void FPortalBroadphase::QueryPoint(const FVector& Point, FPortalCandidateArray& OutPortalIndices) const
+{
+	const TArray<int32, TInlineAllocator<2>>* Cell = Cells.Find(GetCell(Point));
+	if (Cell == nullptr)
+	{
+		return;
+	}
+
+	for (int32 PortalIndex : *Cell)
+	{
+		if (PortalBounds[PortalIndex].IsInsideOrOn(Point))
+		{
+			OutPortalIndices.Add(PortalIndex);
+		}
+	}
+}
+
+/**
+ * Gathers all portals whose teleport bounds overlap the given box, each portal at most once.
+ *
+ * @param Box The world space box to check, usually the bounds of the segment an agent moved along.
+ * @param OutPortalIndices Output array the candidate portal indices are added to.
+ */
+void FPortalBroadphase::QueryBox(const FBox& Box, FPortalCandidateArray& OutPortalIndices) const
+{
+	const FIntVector MinCell = GetCell(Box.Min);
+	const FIntVector MaxCell = GetCell(Box.Max);
+	const int64 NumCells = int64(MaxCell.X - MinCell.X + 1) * (MaxCell.Y - MinCell.Y + 1) * (MaxCell.Z - MinCell.Z + 1);
+
+	/**
+	 * A very fast agent covers many empty cells in a single frame. There are never more than a few dozen portals,
+	 * so testing all portal bounds is cheaper than walking the cells in that case.
+	 */
+	if (NumCells > MaxQueryCells)
+	{
+		for (int32 PortalIndex = 0; PortalIndex < PortalBounds.Num(); ++PortalIndex)
+		{
+			if (PortalBounds[PortalIndex].Intersect(Box))
+			{
+				OutPortalIndices.Add(PortalIndex);
+			}
+		}
+		return;
+	}
+
+	for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+			{
+				const TArray<int32, TInlineAllocator<2>>* Cell = Cells.Find(FIntVector(X, Y, Z));
+				if (Cell == nullptr)
+				{
+					continue;
+				}
+
+				for (int32 PortalIndex : *Cell)
+				{
+					// portals overlapping several cells are found once per cell
+					if (PortalBounds[PortalIndex].Intersect(Box))
+					{
+						OutPortalIndices.AddUnique(PortalIndex);
+					}
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Converts a world location to the integer coordinates of the grid cell containing it.
+ *
+ * @param Point The world location.
+ * @return The coordinates of the grid cell.
+ */
+FIntVector FPortalBroadphase::GetCell(const FVector& Point) const
+{
+	return FIntVector(
+		FMath::FloorToInt32(Point.X / CellSize),
+		FMath::FloorToInt32(Point.Y / CellSize),
+		FMath::FloorToInt32(Point.Z / CellSize)
+	);
+}
@@ -5,6 +5,7 @@
 #include "GameFramework/ProjectileMovementComponent.h"
 #include "Components/SphereComponent.h"
 #include "Kismet/KismetMathLibrary.h"
+#include "PortalWorldSubsystem.h"
 
 // Sets default values
 APortalBullet::APortalBullet()
@@ -57,11 +58,8 @@ void APortalBullet::OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPri
 		// Check if the hit component is of PortalSurface channel
 		if (OtherComp->GetCollisionObjectType() == ECC_GameTraceChannel2) // Ensure this is set to PortalSurface channel
 		{
-			TArray<AActor*> ManagerArray;
-			if (BP_Portal3Manager != nullptr)
+			if (APortal3Manager* PortalManager = GetPortalManager())
 			{
-				UGameplayStatics::GetAllActorsOfClass(GetWorld(), BP_Portal3Manager, ManagerArray);
-				APortal3Manager* PortalManager = Cast<APortal3Manager>(ManagerArray[0]);
 				PortalManager->DestroyOldPortal(bIsOrangePortal);
 			}
 
@@ -297,14 +295,19 @@ bool APortalBullet::AdjustPortalPosition(UPortalSurface* PortalSurfaceData, FVec
 void APortalBullet::SpawnPortalOnSurface(FVector PortalCenter, FQuat PortalRotation, FVector SurfaceForwardVector, UPortalSurface* PortalSurfaceData, int32 Index)
 {
 	SurfaceForwardVector *= 0.1; // offset from the surface, from testing, it needs to be 1.2 units apart or it might cause incorrect collision bugs. 
-	TArray<AActor*> ManagerArray;
-	if (BP_Portal3Manager != nullptr)
+	if (APortal3Manager* PortalManager = GetPortalManager())
 	{
-		UGameplayStatics::GetAllActorsOfClass(GetWorld(), BP_Portal3Manager, ManagerArray);
-		APortal3Manager* PortalManager = Cast<APortal3Manager>(ManagerArray[0]);
 		PortalManager->CreateNewPortal(PortalCenter + SurfaceForwardVector, PortalRotation, bIsOrangePortal, PortalSurfaceData, Index);
 	}
 }
 
-
-
+/**
+ * Gets the portal manager of the world this bullet is in.
+ *
+ * @return The portal manager, nullptr if the world has none.
+ */
+APortal3Manager* APortalBullet::GetPortalManager() const
+{
+	UPortalWorldSubsystem* PortalSubsystem = GetWorld()->GetSubsystem<UPortalWorldSubsystem>();
+	return PortalSubsystem ? PortalSubsystem->GetManager() : nullptr;
+}
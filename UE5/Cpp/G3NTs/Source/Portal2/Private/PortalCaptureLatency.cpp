@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalCaptureLatency.h"
+
+/**
+ * Records the camera pose the captures of this frame were rendered from.
+ *
+ * @param Pose The camera pose, before it is converted through the portals.
+ */
+void FPortalCaptureLatencyTracker::RecordCapturePose(const FTransform& Pose)
+{
+	CapturePose = Pose;
+	bCapturePoseUsed = true;
+}
+
+/**
+ * Records the camera pose of the view that is about to be presented, and compares it with the capture pose of this frame.
+ * A camera standing still matches every pose, so the latency is only measured while the camera moves.
+ *
+ * @param PresentedPose The camera pose of the presented view.
+ * @return True if a new latency was measured, see GetLatencyFrames and GetPoseErrorDegrees.
+ */
+bool FPortalCaptureLatencyTracker::RecordPresentedPose(const FTransform& PresentedPose)
+{
+	constexpr double PoseTolerance = 1.e-3;
+
+	PresentedPoses.Insert(PresentedPose, 0);
+	if (PresentedPoses.Num() > PresentedPoseHistory)
+	{
+		PresentedPoses.Pop(EAllowShrinking::No);
+	}
+
+	const bool bCameraMoved = PresentedPoses.Num() > 1 && !PresentedPoses[0].Equals(PresentedPoses[1], PoseTolerance);
+	const bool bMeasured = bCapturePoseUsed && bCameraMoved;
+	if (bMeasured)
+	{
+		LatencyFrames = PresentedPoseHistory;
+		for (int32 Index = 0; Index < PresentedPoses.Num(); ++Index)
+		{
+			if (PresentedPoses[Index].Equals(CapturePose, PoseTolerance))
+			{
+				LatencyFrames = Index;
+				break;
+			}
+		}
+		PoseErrorDegrees = (float)FMath::RadiansToDegrees(CapturePose.GetRotation().AngularDistance(PresentedPose.GetRotation()));
+	}
+
+	bCapturePoseUsed = false;
+	return bMeasured;
+}
@@ -0,0 +1,158 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalCaptureScheduler.h"
+
+/**
+ * Selects the portals to capture this frame.
+ *
+ * @param Candidates The portals that are visible and linked.
+ * @param OutPortalIndices Output array the portal indices to capture are written to, highest priority first.
+ */
+void FPortalCaptureScheduler::Schedule(TConstArrayView<FPortalCaptureCandidate> Candidates, TArray<int32>& OutPortalIndices)
+{
+	OutPortalIndices.Reset();
+	LastDecisions.SetNumUninitialized(Candidates.Num(), EAllowShrinking::No);
+
+	// the decisions are stored by candidate index, every candidate starts as skipped
+	for (int32 Index = 0; Index < Candidates.Num(); ++Index)
+	{
+		LastDecisions[Index] = { Candidates[Index].PortalIndex, ComputePriority(Candidates[Index]), EPortalCaptureReason::OverBudget };
+	}
+
+	// forced captures do not count against the budget, skipping them would show a stale view right as the player walks through
+	for (int32 Index = 0; Index < Candidates.Num(); ++Index)
+	{
+		if (Candidates[Index].bForceCapture)
+		{
+			LastDecisions[Index].Reason = EPortalCaptureReason::Forced;
+			OutPortalIndices.Add(Candidates[Index].PortalIndex);
+		}
+	}
+
+	int32 Budget = GetCaptureBudget();
+
+	/**
+	 * One slot is kept for the round robin when there is room for more than one capture,
+	 * so low priority portals keep updating even when high priority portals would take the whole budget.
+	 */
+	const int32 RoundRobinSlots = Budget > 1 ? 1 : 0;
+	int32 PriorityBudget = Budget - RoundRobinSlots;
+
+	SortedCandidates.Reset();
+	for (int32 Index = 0; Index < Candidates.Num(); ++Index)
+	{
+		if (Candidates[Index].bForceCapture)
+		{
+			continue;
+		}
+		if (IsRateLimited(Candidates[Index]))
+		{
+			LastDecisions[Index].Reason = EPortalCaptureReason::RateLimited;
+			continue;
+		}
+		SortedCandidates.Add(Index);
+	}
+
+	SortedCandidates.Sort([this](int32 A, int32 B)
+	{
+		return LastDecisions[A].Priority > LastDecisions[B].Priority;
+	});
+
+	for (int32 Index : SortedCandidates)
+	{
+		if (PriorityBudget <= 0)
+		{
+			break;
+		}
+		LastDecisions[Index].Reason = EPortalCaptureReason::Priority;
+		OutPortalIndices.Add(Candidates[Index].PortalIndex);
+		--PriorityBudget;
+	}
+
+	// unused priority slots are handed to the round robin as well
+	int32 RoundRobinBudget = RoundRobinSlots + PriorityBudget;
+	if (RoundRobinBudget <= 0 || SortedCandidates.Num() == 0)
+	{
+		return;
+	}
+
+	/**
+	 * The round robin walks the remaining candidates in portal index order, starting after the portal that got the last round robin slot.
+	 */
+	SortedCandidates.Sort([&Candidates](int32 A, int32 B)
+	{
+		return Candidates[A].PortalIndex < Candidates[B].PortalIndex;
+	});
+
+	int32 Start = 0;
+	while (Start < SortedCandidates.Num() && Candidates[SortedCandidates[Start]].PortalIndex <= RoundRobinCursor)
+	{
+		++Start;
+	}
+
+	for (int32 Step = 0; Step < SortedCandidates.Num() && RoundRobinBudget > 0; ++Step)
+	{
+		const int32 Index = SortedCandidates[(Start + Step) % SortedCandidates.Num()];
+		if (LastDecisions[Index].Reason != EPortalCaptureReason::OverBudget)
+		{
+			continue;
+		}
+		LastDecisions[Index].Reason = EPortalCaptureReason::RoundRobin;
+		OutPortalIndices.Add(Candidates[Index].PortalIndex);
+		RoundRobinCursor = Candidates[Index].PortalIndex;
+		--RoundRobinBudget;
+	}
+}
+
+/**
+ * Computes the priority of a candidate, higher is more important.
+ *
+ * @param Candidate The candidate to rank.
+ * @return The priority, roughly between 0 and 1.
+ */
+float FPortalCaptureScheduler::ComputePriority(const FPortalCaptureCandidate& Candidate) const
+{
+	/**
+	 * Screen coverage dominates, it is what the player actually sees. Distance breaks ties between portals of similar size,
+	 * and the age term makes a portal that was skipped for a while climb up the ranking.
+	 */
+	const float CoverageTerm = FMath::Clamp(Candidate.ScreenCoverage, 0.f, 1.f);
+	const float DistanceTerm = 1.f / (1.f + Candidate.Distance / 1000.f);
+	const float AgeTerm = Settings.MaxCaptureAge > 0.f ? FMath::Min(Candidate.TimeSinceCapture / Settings.MaxCaptureAge, 1.f) : 1.f;
+
+	return 0.6f * CoverageTerm + 0.15f * DistanceTerm + 0.25f * AgeTerm;
+}
+
+/**
+ * Reports the measured cost of a capture, used to convert the millisecond budget into a number of captures.
+ *
+ * @param Milliseconds The game thread time the capture took.
+ */
+void FPortalCaptureScheduler::ReportCaptureCost(double Milliseconds)
+{
+	// exponential moving average, reacts within a few frames without jumping on a single slow capture
+	EstimatedCaptureMilliseconds = FMath::Lerp(EstimatedCaptureMilliseconds, Milliseconds, 0.1);
+}
+
+/**
+ * Returns the number of captures the budget allows this frame, forced captures excluded.
+ */
+int32 FPortalCaptureScheduler::GetCaptureBudget() const
+{
+	int32 Budget = FMath::Max(Settings.MaxCapturesPerFrame, 0);
+	if (Settings.BudgetMilliseconds > 0.f && EstimatedCaptureMilliseconds > 0.0)
+	{
+		// always allow one capture, otherwise a single expensive capture would freeze all portals
+		Budget = FMath::Min(Budget, FMath::Max(1, FMath::FloorToInt32(Settings.BudgetMilliseconds / EstimatedCaptureMilliseconds)));
+	}
+	return Budget;
+}
+
+/**
+ * Returns true if the candidate was captured too recently for its priority tier.
+ */
+bool FPortalCaptureScheduler::IsRateLimited(const FPortalCaptureCandidate& Candidate) const
+{
+	return Candidate.ScreenCoverage < Settings.LowPriorityCoverage && Candidate.TimeSinceCapture < Settings.LowPriorityInterval;
+}
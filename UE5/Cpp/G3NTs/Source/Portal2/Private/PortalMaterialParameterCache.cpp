@@ -0,0 +1,231 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalMaterialParameterCache.h"
+#include "PortalStats.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/Texture.h"
+
+/**
+ * Binds the cache to a material instance and forgets all cached values.
+ *
+ * @param InMaterial The material instance the parameters are written to.
+ */
+void FPortalMaterialParameterCache::Init(UMaterialInstanceDynamic* InMaterial)
+{
+	Material = InMaterial;
+	Primitive = nullptr;
+	Invalidate();
+}
+
+/**
+ * Binds the cache to the custom primitive data of a primitive component and forgets all cached values.
+ *
+ * @param InPrimitive The primitive component the custom primitive data is written to.
+ */
+void FPortalMaterialParameterCache::InitPrimitiveData(UPrimitiveComponent* InPrimitive)
+{
+	Material = nullptr;
+	Primitive = InPrimitive;
+	Invalidate();
+}
+
+/**
+ * Forgets all cached values, the next write of every parameter is forwarded.
+ */
+void FPortalMaterialParameterCache::Invalidate()
+{
+	Vectors.Reset();
+	Scalars.Reset();
+	Textures.Reset();
+	PrimitiveData.Reset();
+}
+
+/**
+ * Sets a vector parameter if it differs from the last value written through the cache.
+ *
+ * @param Name The name of the parameter.
+ * @param Value The new value.
+ * @return True if the value was written to the material.
+ */
+bool FPortalMaterialParameterCache::SetVector(FName Name, const FLinearColor& Value)
+{
+	if (Material == nullptr)
+	{
+		return false;
+	}
+
+	FVectorEntry* Entry = Vectors.FindByPredicate([Name](const FVectorEntry& Other) { return Other.Name == Name; });
+	if (Entry == nullptr)
+	{
+		// the first write looks the parameter up by name and remembers its index, INDEX_NONE if the material does not have it
+		FVectorEntry& NewEntry = Vectors.AddDefaulted_GetRef();
+		NewEntry.Name = Name;
+		NewEntry.Value = Value;
+		if (!Material->InitializeVectorParameterAndGetIndex(Name, Value, NewEntry.Index))
+		{
+			NewEntry.Index = INDEX_NONE;
+		}
+		INC_DWORD_STAT(STAT_PortalMaterialParameterWrites);
+		return true;
+	}
+
+	if (Entry->Value == Value)
+	{
+		INC_DWORD_STAT(STAT_PortalMaterialParameterWritesSuppressed);
+		return false;
+	}
+
+	Entry->Value = Value;
+	if (Entry->Index == INDEX_NONE || !Material->SetVectorParameterByIndex(Entry->Index, Value))
+	{
+		Material->SetVectorParameterValue(Name, Value);
+	}
+	INC_DWORD_STAT(STAT_PortalMaterialParameterWrites);
+	return true;
+}
+
+/**
+ * Sets a scalar parameter if it differs from the last value written through the cache.
+ *
+ * @param Name The name of the parameter.
+ * @param Value The new value.
+ * @return True if the value was written to the material.
+ */
+bool FPortalMaterialParameterCache::SetScalar(FName Name, float Value)
+{
+	if (Material == nullptr)
+	{
+		return false;
+	}
+
+	FScalarEntry* Entry = Scalars.FindByPredicate([Name](const FScalarEntry& Other) { return Other.Name == Name; });
+	if (Entry == nullptr)
+	{
+		FScalarEntry& NewEntry = Scalars.AddDefaulted_GetRef();
+		NewEntry.Name = Name;
+		NewEntry.Value = Value;
+		if (!Material->InitializeScalarParameterAndGetIndex(Name, Value, NewEntry.Index))
+		{
+			NewEntry.Index = INDEX_NONE;
+		}
+		INC_DWORD_STAT(STAT_PortalMaterialParameterWrites);
+		return true;
+	}
+
+	if (Entry->Value == Value)
+	{
+		INC_DWORD_STAT(STAT_PortalMaterialParameterWritesSuppressed);
+		return false;
+	}
+
+	Entry->Value = Value;
+	if (Entry->Index == INDEX_NONE || !Material->SetScalarParameterByIndex(Entry->Index, Value))
+	{
+		Material->SetScalarParameterValue(Name, Value);
+	}
+	INC_DWORD_STAT(STAT_PortalMaterialParameterWrites);
+	return true;
+}
+
+/**
+ * Sets a texture parameter if it differs from the last texture written through the cache.
+ *
+ * @param Name The name of the parameter.
+ * @param Value The new texture, may be nullptr.
+ * @return True if the value was written to the material.
+ */
+bool FPortalMaterialParameterCache::SetTexture(FName Name, UTexture* Value)
+{
+	if (Material == nullptr)
+	{
+		return false;
+	}
+
+	/**
+	 * The weak pointer resolves to nullptr once the cached texture is destroyed, so a new texture allocated at the same address
+	 * is still written. A destroyed texture does not match nullptr either, the material may still point to it.
+	 */
+	FTextureEntry* Entry = Textures.FindByPredicate([Name](const FTextureEntry& Other) { return Other.Name == Name; });
+	if (Entry != nullptr && Entry->Value.Get() == Value && (Value != nullptr || !Entry->Value.IsStale()))
+	{
+		INC_DWORD_STAT(STAT_PortalMaterialParameterWritesSuppressed);
+		return false;
+	}
+
+	if (Entry == nullptr)
+	{
+		Entry = &Textures.AddDefaulted_GetRef();
+		Entry->Name = Name;
+	}
+	Entry->Value = Value;
+	Material->SetTextureParameterValue(Name, Value);
+	INC_DWORD_STAT(STAT_PortalMaterialParameterWrites);
+	return true;
+}
+
+/**
+ * Sets 4 floats of the custom primitive data if they differ from the last value written through the cache.
+ *
+ * @param DataIndex Index of the first float in the custom primitive data.
+ * @param Value The new value.
+ * @return True if the value was written to the primitive.
+ */
+bool FPortalMaterialParameterCache::SetPrimitiveDataVector(int32 DataIndex, const FLinearColor& Value)
+{
+	if (Primitive == nullptr)
+	{
+		return false;
+	}
+
+	FPrimitiveDataEntry* Entry = PrimitiveData.FindByPredicate([DataIndex](const FPrimitiveDataEntry& Other) { return Other.DataIndex == DataIndex; });
+	if (Entry != nullptr && Entry->Value == Value)
+	{
+		INC_DWORD_STAT(STAT_PortalMaterialParameterWritesSuppressed);
+		return false;
+	}
+
+	if (Entry == nullptr)
+	{
+		Entry = &PrimitiveData.AddDefaulted_GetRef();
+		Entry->DataIndex = DataIndex;
+	}
+	Entry->Value = Value;
+	Primitive->SetCustomPrimitiveDataVector4(DataIndex, FVector4(Value.R, Value.G, Value.B, Value.A));
+	INC_DWORD_STAT(STAT_PortalMaterialParameterWrites);
+	return true;
+}
+
+/**
+ * Sets a float of the custom primitive data if it differs from the last value written through the cache.
+ *
+ * @param DataIndex Index of the float in the custom primitive data.
+ * @param Value The new value.
+ * @return True if the value was written to the primitive.
+ */
+bool FPortalMaterialParameterCache::SetPrimitiveDataFloat(int32 DataIndex, float Value)
+{
+	if (Primitive == nullptr)
+	{
+		return false;
+	}
+
+	const FLinearColor StoredValue(Value, 0.f, 0.f, 0.f);
+	FPrimitiveDataEntry* Entry = PrimitiveData.FindByPredicate([DataIndex](const FPrimitiveDataEntry& Other) { return Other.DataIndex == DataIndex; });
+	if (Entry != nullptr && Entry->Value == StoredValue)
+	{
+		INC_DWORD_STAT(STAT_PortalMaterialParameterWritesSuppressed);
+		return false;
+	}
+
+	if (Entry == nullptr)
+	{
+		Entry = &PrimitiveData.AddDefaulted_GetRef();
+		Entry->DataIndex = DataIndex;
+	}
+	Entry->Value = StoredValue;
+	Primitive->SetCustomPrimitiveDataFloat(DataIndex, Value);
+	INC_DWORD_STAT(STAT_PortalMaterialParameterWrites);
+	return true;
+}
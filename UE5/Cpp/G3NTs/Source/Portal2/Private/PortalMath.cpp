@@ -0,0 +1,457 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalMath.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+
+/**
+ * Intersects the segment an agent moved along during the last frame with the opening of a portal.
+ * Only a crossing from the front (positive forward axis) to the back of the portal counts, like CheckActorInFront.
+ *
+ * @param Start The location of the agent at the end of the previous frame.
+ * @param End The current location of the agent.
+ * @param QuadCenter The world location of the portal.
+ * @param QuadRotation The world rotation of the portal, the forward axis is the portal normal.
+ * @param QuadHalfExtents Half the width (local Y) and half the height (local Z) of the portal opening.
+ * @param OutFraction Fraction along the segment at which the portal plane is crossed, 0 at Start and 1 at End.
+ * @return True if the segment passes through the portal opening from front to back.
+ */
+bool FPortalMath::SegmentCrossesQuad(const FVector& Start, const FVector& End, const FVector& QuadCenter, const FQuat& QuadRotation, const FVector2D& QuadHalfExtents, double& OutFraction)
+{
+	const FVector LocalStart = QuadRotation.UnrotateVector(Start - QuadCenter);
+	const FVector LocalEnd = QuadRotation.UnrotateVector(End - QuadCenter);
+
+	/**
+	 * In local space the portal plane is X = 0. The segment has to start on or in front of the plane and end behind it,
+	 * an agent resting exactly on the plane has not crossed yet.
+	 */
+	if (LocalStart.X < 0.0 || LocalEnd.X >= 0.0)
+	{
+		return false;
+	}
+
+	const double Fraction = LocalStart.X / (LocalStart.X - LocalEnd.X);
+	const FVector LocalHit = FMath::Lerp(LocalStart, LocalEnd, Fraction);
+
+	if (FMath::Abs(LocalHit.Y) > QuadHalfExtents.X || FMath::Abs(LocalHit.Z) > QuadHalfExtents.Y)
+	{
+		return false;
+	}
+
+	OutFraction = Fraction;
+	return true;
+}
+
+/**
+ * Tests a portal quad against the planes of a view frustum. The quad is culled when all 4 corners are outside the same plane,
+ * which is exact for the frustum side planes and conservative only for quads that pass diagonally outside a frustum corner.
+ *
+ * @param FrustumPlanes The planes of the frustum, with the normals pointing out of the frustum as in FConvexVolume.
+ * @param Corners The 4 corners of the quad in world space.
+ * @return True if the quad may be visible, false if it is completely outside the frustum.
+ */
+bool FPortalMath::IsQuadInFrustum(TConstArrayView<FPlane> FrustumPlanes, TConstArrayView<FVector> Corners)
+{
+	check(Corners.Num() == 4);
+
+	/**
+	 * The corners are transposed into one register per axis, so every plane is tested against all 4 corners
+	 * with three multiply-adds and a single compare.
+	 */
+	const VectorRegister4Double CornersX = MakeVectorRegisterDouble(Corners[0].X, Corners[1].X, Corners[2].X, Corners[3].X);
+	const VectorRegister4Double CornersY = MakeVectorRegisterDouble(Corners[0].Y, Corners[1].Y, Corners[2].Y, Corners[3].Y);
+	const VectorRegister4Double CornersZ = MakeVectorRegisterDouble(Corners[0].Z, Corners[1].Z, Corners[2].Z, Corners[3].Z);
+
+	for (const FPlane& Plane : FrustumPlanes)
+	{
+		VectorRegister4Double Distance = VectorSubtract(VectorMultiply(CornersX, VectorSetFloat1(Plane.X)), VectorSetFloat1(Plane.W));
+		Distance = VectorMultiplyAdd(CornersY, VectorSetFloat1(Plane.Y), Distance);
+		Distance = VectorMultiplyAdd(CornersZ, VectorSetFloat1(Plane.Z), Distance);
+
+		// all 4 corners in front of an outward facing plane, the quad lies completely outside the frustum
+		if (VectorMaskBits(VectorCompareGT(Distance, GlobalVectorConstants::DoubleZero)) == 0xF)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Builds the view matrix of a scene capture, the same way the renderer does: world to camera space,
+ * followed by the swap from the Unreal axes (X forward, Z up) to the view axes (Z forward, Y up).
+ *
+ * @param Location The world location of the capture.
+ * @param Rotation The world rotation of the capture.
+ * @return The view matrix.
+ */
+FMatrix FPortalMath::MakeViewMatrix(const FVector& Location, const FQuat& Rotation)
+{
+	return FTranslationMatrix(-Location) * FInverseRotationMatrix(Rotation.Rotator()) * FMatrix(
+		FPlane(0, 0, 1, 0),
+		FPlane(1, 0, 0, 0),
+		FPlane(0, 1, 0, 0),
+		FPlane(0, 0, 0, 1));
+}
+
+/**
+ * Replaces the near plane of a reversed-Z perspective projection by an arbitrary plane, so everything on the
+ * negative side of the plane is removed by the regular depth clipping (Lengyel's oblique near plane).
+ *
+ * In clip space the near plane is W - Z >= 0. Replacing the Z column by the W column minus Scale * ClipPlane
+ * turns that test into Scale * dot(ClipPlane, P) >= 0. Scale is chosen as large as possible while keeping the depth
+ * of every point inside the frustum at or above 0, which preserves as much depth precision as possible.
+ *
+ * @param ProjectionMatrix A reversed-Z perspective projection, as used by the renderer.
+ * @param ViewSpaceClipPlane The clip plane in view space, points with a positive plane dot are kept.
+ *        The view origin has to be on the negative side, otherwise the projection is returned unchanged.
+ * @return The oblique projection matrix.
+ */
+FMatrix FPortalMath::MakeObliqueProjection(const FMatrix& ProjectionMatrix, const FPlane& ViewSpaceClipPlane)
+{
+	// FPlane stores dot(N, P) = W, so the plane dot of the view origin is -W
+	const double OriginDot = -ViewSpaceClipPlane.W;
+	if (OriginDot >= 0.0)
+	{
+		return ProjectionMatrix;
+	}
+
+	/**
+	 * Depth is Z / W = 1 - Scale * dot(ClipPlane, P) / P.z. Along a view ray P = t * (x, y, 1) that ratio grows towards
+	 * dot(N, (x, y, 1)) for large t, and is smaller everywhere closer, because the origin lies behind the plane.
+	 * The largest value over the frustum is reached in one of its corner directions, where |x| and |y| are the tangents
+	 * of the half field of view, read back from the projection.
+	 */
+	const double TanHalfX = 1.0 / ProjectionMatrix.M[0][0];
+	const double TanHalfY = 1.0 / ProjectionMatrix.M[1][1];
+	const double MaxRayDot = ViewSpaceClipPlane.Z + FMath::Abs(ViewSpaceClipPlane.X) * TanHalfX + FMath::Abs(ViewSpaceClipPlane.Y) * TanHalfY;
+	if (MaxRayDot <= UE_KINDA_SMALL_NUMBER)
+	{
+		// the plane faces away from the whole frustum, nothing behind it can be seen anyway
+		return ProjectionMatrix;
+	}
+	const double Scale = 1.0 / MaxRayDot;
+
+	FMatrix Result = ProjectionMatrix;
+	const double PlaneVector[4] = { ViewSpaceClipPlane.X, ViewSpaceClipPlane.Y, ViewSpaceClipPlane.Z, -ViewSpaceClipPlane.W };
+	for (int32 Row = 0; Row < 4; ++Row)
+	{
+		Result.M[Row][2] = ProjectionMatrix.M[Row][3] - Scale * PlaneVector[Row];
+	}
+	return Result;
+}
+
+/**
+ * Builds the off-axis frustum seen through a portal opening: one plane through the view origin and each edge of the opening,
+ * and the clip plane of the exit portal, which removes everything behind the portal surface.
+ *
+ * @param ViewOrigin The location of the scene capture.
+ * @param Corners The 4 corners of the exit portal opening, in order around the opening.
+ * @param ClipPlaneBase A point on the clip plane of the scene capture.
+ * @param ClipPlaneNormal The normal of the clip plane, pointing to the side that is rendered.
+ * @param OutPlanes The planes of the frustum, with the normals pointing out of the frustum as in FConvexVolume.
+ */
+void FPortalMath::BuildPortalFrustum(const FVector& ViewOrigin, TConstArrayView<FVector> Corners, const FVector& ClipPlaneBase, const FVector& ClipPlaneNormal, FPortalFrustumPlanes& OutPlanes)
+{
+	OutPlanes.Reset();
+
+	FVector Center = FVector::ZeroVector;
+	for (const FVector& Corner : Corners)
+	{
+		Center += Corner / Corners.Num();
+	}
+
+	for (int32 Index = 0; Index < Corners.Num(); ++Index)
+	{
+		const FVector& A = Corners[Index];
+		const FVector& B = Corners[(Index + 1) % Corners.Num()];
+
+		FVector Normal = FVector::CrossProduct(A - ViewOrigin, B - ViewOrigin);
+		if (!Normal.Normalize())
+		{
+			// the view origin lies on the line of this edge, leaving the plane out only makes the frustum larger
+			continue;
+		}
+
+		// the winding of the corners is unknown, the centre of the opening has to end up inside
+		FPlane Plane(ViewOrigin, Normal);
+		if (Plane.PlaneDot(Center) > 0.0)
+		{
+			Plane = Plane.Flip();
+		}
+		OutPlanes.Add(Plane);
+	}
+
+	OutPlanes.Add(FPlane(ClipPlaneBase, -ClipPlaneNormal.GetSafeNormal()));
+}
+
+/**
+ * Culls a batch of bounding spheres against a frustum, 4 spheres at a time.
+ *
+ * @param FrustumPlanes The planes of the frustum, with the normals pointing out of the frustum as in FConvexVolume.
+ * @param Spheres The spheres to cull.
+ * @param OutVisible Output array the indices of the spheres that intersect the frustum are added to, in increasing order.
+ */
+void FPortalMath::CullSpheres(TConstArrayView<FPlane> FrustumPlanes, const FPortalSphereBatch& Spheres, TArray<int32>& OutVisible)
+{
+	const int32 NumPadded = Spheres.X.Num();
+	const double* RESTRICT X = Spheres.X.GetData();
+	const double* RESTRICT Y = Spheres.Y.GetData();
+	const double* RESTRICT Z = Spheres.Z.GetData();
+	const double* RESTRICT Radius = Spheres.Radius.GetData();
+
+	for (int32 Base = 0; Base < NumPadded; Base += 4)
+	{
+		const VectorRegister4Double SphereX = VectorLoad(X + Base);
+		const VectorRegister4Double SphereY = VectorLoad(Y + Base);
+		const VectorRegister4Double SphereZ = VectorLoad(Z + Base);
+		const VectorRegister4Double SphereRadius = VectorLoad(Radius + Base);
+
+		// padding spheres have a negative radius and are outside from the start
+		int32 OutsideMask = VectorMaskBits(VectorCompareLT(SphereRadius, GlobalVectorConstants::DoubleZero));
+		for (const FPlane& Plane : FrustumPlanes)
+		{
+			VectorRegister4Double Distance = VectorSubtract(VectorMultiply(SphereX, VectorSetFloat1(Plane.X)), VectorSetFloat1(Plane.W));
+			Distance = VectorMultiplyAdd(SphereY, VectorSetFloat1(Plane.Y), Distance);
+			Distance = VectorMultiplyAdd(SphereZ, VectorSetFloat1(Plane.Z), Distance);
+
+			OutsideMask |= VectorMaskBits(VectorCompareGT(Distance, SphereRadius));
+			if (OutsideMask == 0xF)
+			{
+				break;
+			}
+		}
+
+		for (int32 Lane = 0; Lane < 4; ++Lane)
+		{
+			if ((OutsideMask & (1 << Lane)) == 0)
+			{
+				OutVisible.Add(Base + Lane);
+			}
+		}
+	}
+}
+
+/**
+ * Scalar version of CullSpheres, tests the spheres one by one. Kept as reference for the benchmark.
+ */
+void FPortalMath::CullSpheresScalar(TConstArrayView<FPlane> FrustumPlanes, const FPortalSphereBatch& Spheres, TArray<int32>& OutVisible)
+{
+	for (int32 Index = 0; Index < Spheres.Num(); ++Index)
+	{
+		const FVector Origin(Spheres.X[Index], Spheres.Y[Index], Spheres.Z[Index]);
+
+		bool bInside = true;
+		for (const FPlane& Plane : FrustumPlanes)
+		{
+			if (Plane.PlaneDot(Origin) > Spheres.Radius[Index])
+			{
+				bInside = false;
+				break;
+			}
+		}
+
+		if (bInside)
+		{
+			OutVisible.Add(Index);
+		}
+	}
+}
+
+/**
+ * Projects a set of world points and returns the bounding rectangle of their projection on the screen.
+ *
+ * @param ViewProjectionMatrix The view projection matrix of the camera.
+ * @param Points The world points, usually the corners of a portal.
+ * @return The rectangle in normalized device coordinates, clamped to the screen from -1 to 1. Invalid if the points are
+ *         off screen, the whole screen if a point is behind the camera.
+ */
+FBox2D FPortalMath::ComputeScreenRect(const FMatrix& ViewProjectionMatrix, TConstArrayView<FVector> Points)
+{
+	if (Points.Num() == 0)
+	{
+		return FBox2D(ForceInit);
+	}
+
+	FVector2D Min(TNumericLimits<double>::Max());
+	FVector2D Max(TNumericLimits<double>::Lowest());
+
+	for (const FVector& Point : Points)
+	{
+		const FVector4 Clip = ViewProjectionMatrix.TransformFVector4(FVector4(Point, 1.0));
+
+		/**
+		 * A corner behind the camera means the camera is very close to, or partly through, the portal.
+		 * The projection is meaningless then, and the portal may cover any part of the screen.
+		 */
+		if (Clip.W <= UE_KINDA_SMALL_NUMBER)
+		{
+			return FBox2D(FVector2D(-1.0), FVector2D(1.0));
+		}
+
+		const FVector2D Ndc(Clip.X / Clip.W, Clip.Y / Clip.W);
+		Min = FVector2D::Min(Min, Ndc);
+		Max = FVector2D::Max(Max, Ndc);
+	}
+
+	// the screen spans -1 to 1 on both axes in normalized device coordinates
+	Min = FVector2D::Max(Min, FVector2D(-1.0));
+	Max = FVector2D::Min(Max, FVector2D(1.0));
+	if (Max.X <= Min.X || Max.Y <= Min.Y)
+	{
+		return FBox2D(ForceInit);
+	}
+	return FBox2D(Min, Max);
+}
+
+/**
+ * Snaps a screen rectangle outwards to a grid, so the render targets sized from it come in a few sizes the pool can reuse.
+ * The current rectangle is kept while it still contains the new one and is less than twice its area,
+ * so a portal moving over the screen does not lease new render targets every frame.
+ *
+ * @param ScreenRect The rectangle the portal covers, in normalized device coordinates.
+ * @param CurrentRect The rectangle used so far.
+ * @param GridSteps Number of grid cells across the screen on each axis.
+ * @return The rectangle to use, the whole screen if ScreenRect is invalid.
+ */
+FBox2D FPortalMath::SelectCaptureRect(const FBox2D& ScreenRect, const FBox2D& CurrentRect, int32 GridSteps)
+{
+	if (!ScreenRect.bIsValid || GridSteps <= 0)
+	{
+		return FBox2D(FVector2D(-1.0), FVector2D(1.0));
+	}
+
+	// grid coordinates run from 0 to GridSteps over the screen
+	const double Scale = GridSteps * 0.5;
+	const FVector2D Min(
+		FMath::FloorToDouble((ScreenRect.Min.X + 1.0) * Scale) / Scale - 1.0,
+		FMath::FloorToDouble((ScreenRect.Min.Y + 1.0) * Scale) / Scale - 1.0);
+	const FVector2D Max(
+		FMath::CeilToDouble((ScreenRect.Max.X + 1.0) * Scale) / Scale - 1.0,
+		FMath::CeilToDouble((ScreenRect.Max.Y + 1.0) * Scale) / Scale - 1.0);
+	const FBox2D SnappedRect(FVector2D::Max(Min, FVector2D(-1.0)), FVector2D::Min(Max, FVector2D(1.0)));
+
+	if (CurrentRect.bIsValid && CurrentRect.IsInsideOrOn(SnappedRect.Min) && CurrentRect.IsInsideOrOn(SnappedRect.Max)
+		&& CurrentRect.GetArea() < SnappedRect.GetArea() * 2.0)
+	{
+		return CurrentRect;
+	}
+	return SnappedRect;
+}
+
+/**
+ * Builds the matrix that maps a rectangle of the screen onto the whole screen. Applied after a projection matrix,
+ * it gives the off-centre projection of only that rectangle. The depth and W are left untouched.
+ *
+ * @param ScreenRect The rectangle in normalized device coordinates.
+ * @return The crop matrix, the identity if the rectangle is invalid or empty.
+ */
+FMatrix FPortalMath::MakeScreenCropMatrix(const FBox2D& ScreenRect)
+{
+	const FVector2D HalfSize = ScreenRect.GetExtent();
+	if (!ScreenRect.bIsValid || HalfSize.X <= UE_KINDA_SMALL_NUMBER || HalfSize.Y <= UE_KINDA_SMALL_NUMBER)
+	{
+		return FMatrix::Identity;
+	}
+
+	// clip X' = (X - Center.X * W) / HalfSize.X, which is (Ndc.X - Center.X) / HalfSize.X after the divide by W, same for Y
+	const FVector2D Center = ScreenRect.GetCenter();
+	return FMatrix(
+		FPlane(1.0 / HalfSize.X, 0.0, 0.0, 0.0),
+		FPlane(0.0, 1.0 / HalfSize.Y, 0.0, 0.0),
+		FPlane(0.0, 0.0, 1.0, 0.0),
+		FPlane(-Center.X / HalfSize.X, -Center.Y / HalfSize.Y, 0.0, 1.0));
+}
+
+/**
+ * Estimates the fraction of the screen covered by a set of world points, using the bounding rectangle of their projection.
+ *
+ * @param ViewProjectionMatrix The view projection matrix of the camera.
+ * @param Points The world points, usually the corners of a portal.
+ * @return The covered fraction of the screen between 0 and 1. Points behind the camera count as covering the whole screen.
+ */
+float FPortalMath::ComputeScreenCoverage(const FMatrix& ViewProjectionMatrix, TConstArrayView<FVector> Points)
+{
+	const FBox2D ScreenRect = ComputeScreenRect(ViewProjectionMatrix, Points);
+	if (!ScreenRect.bIsValid)
+	{
+		return 0.f;
+	}
+	// the whole screen is 2 by 2 in normalized device coordinates
+	return (float)(ScreenRect.GetArea() / 4.0);
+}
+
+/**
+ * Times CullSpheres against CullSpheresScalar on random spheres standing in for the static meshes of a level,
+ * seen through a 240 x 120 portal. Does not need a world or a renderer, so it also runs headless with -nullrhi.
+ *
+ * @param NumPrimitives The number of spheres.
+ * @param Iterations The number of times each version culls all spheres.
+ * @return The visible count and the time per primitive of both versions.
+ */
+FPortalCullingBenchmarkResult FPortalMath::BenchmarkCullSpheres(int32 NumPrimitives, int32 Iterations)
+{
+	// a 240 x 120 portal in the YZ plane facing +X, seen from 300 units in front of it
+	const FVector Corners[4] = { FVector(0.0, -120.0, -60.0), FVector(0.0, 120.0, -60.0), FVector(0.0, 120.0, 60.0), FVector(0.0, -120.0, 60.0) };
+	FPortalFrustumPlanes Planes;
+	BuildPortalFrustum(FVector(-300.0, 0.0, 0.0), Corners, FVector(-1.5, 0.0, 0.0), FVector(1.0, 0.0, 0.0), Planes);
+
+	FRandomStream Random(NumPrimitives);
+	FPortalSphereBatch Spheres;
+	Spheres.SetNum(NumPrimitives);
+	for (int32 Index = 0; Index < NumPrimitives; ++Index)
+	{
+		Spheres.Set(Index, Random.GetUnitVector() * Random.FRandRange(0.0, 20000.0), Random.FRandRange(10.0, 400.0));
+	}
+
+	TArray<int32> VisibleScalar;
+	TArray<int32> VisibleBatch;
+
+	double StartTime = FPlatformTime::Seconds();
+	for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+	{
+		VisibleScalar.Reset();
+		CullSpheresScalar(Planes, Spheres, VisibleScalar);
+	}
+	const double ScalarTime = FPlatformTime::Seconds() - StartTime;
+
+	StartTime = FPlatformTime::Seconds();
+	for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+	{
+		VisibleBatch.Reset();
+		CullSpheres(Planes, Spheres, VisibleBatch);
+	}
+	const double BatchTime = FPlatformTime::Seconds() - StartTime;
+
+	const double NumTests = (double)NumPrimitives * Iterations;
+
+	FPortalCullingBenchmarkResult Result;
+	Result.NumVisible = VisibleBatch.Num();
+	Result.bResultsMatch = VisibleBatch == VisibleScalar;
+	Result.ScalarNsPerPrimitive = ScalarTime * 1e9 / NumTests;
+	Result.BatchNsPerPrimitive = BatchTime * 1e9 / NumTests;
+	return Result;
+}
+
+/**
+ * Micro benchmark of the portal frustum culling, see FPortalMath::BenchmarkCullSpheres.
+ * Usage: Portal.BenchmarkPrimitiveCulling [NumPrimitives] [Iterations]
+ */
+static FAutoConsoleCommand GPortalBenchmarkPrimitiveCullingCommand(
+	TEXT("Portal.BenchmarkPrimitiveCulling"),
+	TEXT("Times the vectorised portal frustum culling against the scalar culling. Arguments: [NumPrimitives=4000] [Iterations=1000]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const int32 NumPrimitives = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 4000;
+		const int32 Iterations = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 1000;
+
+		const FPortalCullingBenchmarkResult Result = FPortalMath::BenchmarkCullSpheres(NumPrimitives, Iterations);
+		UE_LOG(LogTemp, Log, TEXT("Portal primitive culling, %d primitives x %d iterations: %d visible (%s), scalar %.2f ns/primitive, batch %.2f ns/primitive (%.2fx)"),
+			NumPrimitives, Iterations,
+			Result.NumVisible,
+			Result.bResultsMatch ? TEXT("results match") : TEXT("RESULTS DIFFER"),
+			Result.ScalarNsPerPrimitive,
+			Result.BatchNsPerPrimitive,
+			Result.BatchNsPerPrimitive > 0.0 ? Result.ScalarNsPerPrimitive / Result.BatchNsPerPrimitive : 0.0);
+	}));
@@ -0,0 +1,162 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalPairTransform.h"
+#include "Math/QuatRotationTranslationMatrix.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+
+FPortalPairTransform::FPortalPairTransform()
+	: Matrix(FMatrix::Identity)
+	, InverseMatrix(FMatrix::Identity)
+	, Quat(FQuat::Identity)
+	, InverseQuat(FQuat::Identity)
+	, Translation(FVector::ZeroVector)
+{
+}
+
+/**
+ * Recomputes the cached conversion. Only has to be called when one of the two portals moves.
+ *
+ * @param Reference The transform of the portal that is entered.
+ * @param Target The transform of the linked portal that is exited.
+ */
+void FPortalPairTransform::Update(const FTransform& Reference, const FTransform& Target)
+{
+	/**
+	 * Only the rotation and location of the portals are used, the portal scale should not stretch the actors going through.
+	 * Target * Flip * Reference^-1, where Flip is a half turn around the up axis.
+	 */
+	Quat = Target.GetRotation() * FQuat(FVector::UpVector, PI) * Reference.GetRotation().Inverse();
+	Quat.Normalize();
+	InverseQuat = Quat.Inverse();
+
+	Translation = Target.GetLocation() - Quat.RotateVector(Reference.GetLocation());
+
+	Matrix = FQuatRotationTranslationMatrix(Quat, Translation);
+	InverseMatrix = FQuatRotationTranslationMatrix(InverseQuat, -InverseQuat.RotateVector(Translation));
+}
+
+/**
+ * Converts all positions, rotations and velocities of a batch in a single vectorised pass.
+ * Produces the same result as calling TransformPosition, TransformRotation and TransformVector for every entry.
+ *
+ * @param In The agent transforms in front of the reference portal.
+ * @param Out The converted transforms at the target portal, resized to the size of In. May not be In.
+ */
+void FPortalPairTransform::TransformBatch(const FPortalTransformBatch& In, FPortalTransformBatch& Out) const
+{
+	check(&In != &Out);
+
+	const int32 Num = In.Num();
+	Out.SetNumUninitialized(Num);
+
+	/**
+	 * The pair rotation and translation are loaded into registers once for the whole batch.
+	 * Every agent then costs one quaternion product and two quaternion-vector rotations, without building matrices.
+	 */
+	const VectorRegister4Double PairQuat = VectorLoad(&Quat.X);
+	const VectorRegister4Double PairTranslation = VectorLoadFloat3_W0(&Translation.X);
+
+	const FVector* RESTRICT InPositions = In.Positions.GetData();
+	const FQuat* RESTRICT InRotations = In.Rotations.GetData();
+	const FVector* RESTRICT InVelocities = In.Velocities.GetData();
+	FVector* RESTRICT OutPositions = Out.Positions.GetData();
+	FQuat* RESTRICT OutRotations = Out.Rotations.GetData();
+	FVector* RESTRICT OutVelocities = Out.Velocities.GetData();
+
+	for (int32 Index = 0; Index < Num; ++Index)
+	{
+		const VectorRegister4Double Position = VectorLoadFloat3_W0(&InPositions[Index].X);
+		const VectorRegister4Double Rotation = VectorLoad(&InRotations[Index].X);
+		const VectorRegister4Double Velocity = VectorLoadFloat3_W0(&InVelocities[Index].X);
+
+		const VectorRegister4Double NewPosition = VectorAdd(VectorQuaternionRotateVector(PairQuat, Position), PairTranslation);
+		const VectorRegister4Double NewRotation = VectorQuaternionMultiply2(PairQuat, Rotation);
+		const VectorRegister4Double NewVelocity = VectorQuaternionRotateVector(PairQuat, Velocity);
+
+		VectorStoreFloat3(NewPosition, &OutPositions[Index].X);
+		VectorStore(NewRotation, &OutRotations[Index].X);
+		VectorStoreFloat3(NewVelocity, &OutVelocities[Index].X);
+	}
+}
+
+/**
+ * Scalar version of TransformBatch, converts the entries one by one. Kept as reference for the benchmark.
+ *
+ * @param In The agent transforms in front of the reference portal.
+ * @param Out The converted transforms at the target portal, resized to the size of In. May not be In.
+ */
+void FPortalPairTransform::TransformBatchScalar(const FPortalTransformBatch& In, FPortalTransformBatch& Out) const
+{
+	const int32 Num = In.Num();
+	Out.SetNumUninitialized(Num);
+
+	for (int32 Index = 0; Index < Num; ++Index)
+	{
+		Out.Positions[Index] = TransformPosition(In.Positions[Index]);
+		Out.Rotations[Index] = TransformRotation(In.Rotations[Index]);
+		Out.Velocities[Index] = TransformVector(In.Velocities[Index]);
+	}
+}
+
+/**
+ * Micro benchmark of the batch conversion against the scalar conversion.
+ * Usage: Portal.BenchmarkPairTransform [NumAgents] [Iterations]
+ */
+static FAutoConsoleCommand GPortalBenchmarkPairTransformCommand(
+	TEXT("Portal.BenchmarkPairTransform"),
+	TEXT("Times the vectorised portal pair batch conversion against the scalar conversion. Arguments: [NumAgents=64] [Iterations=10000]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const int32 NumAgents = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 64;
+		const int32 Iterations = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 10000;
+
+		FPortalPairTransform PairTransform;
+		PairTransform.Update(
+			FTransform(FRotator(0.0, 30.0, 0.0), FVector(100.0, -250.0, 40.0)),
+			FTransform(FRotator(90.0, -45.0, 0.0), FVector(-800.0, 300.0, 120.0)));
+
+		FRandomStream Random(NumAgents);
+		FPortalTransformBatch In;
+		for (int32 Index = 0; Index < NumAgents; ++Index)
+		{
+			In.Add(Random.GetUnitVector() * Random.FRandRange(0.0, 500.0),
+				FRotator(Random.FRandRange(-90.0, 90.0), Random.FRandRange(-180.0, 180.0), 0.0).Quaternion(),
+				Random.GetUnitVector() * Random.FRandRange(0.0, 2000.0));
+		}
+
+		FPortalTransformBatch OutScalar;
+		FPortalTransformBatch OutBatch;
+
+		double StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			PairTransform.TransformBatchScalar(In, OutScalar);
+		}
+		const double ScalarTime = FPlatformTime::Seconds() - StartTime;
+
+		StartTime = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < Iterations; ++Iteration)
+		{
+			PairTransform.TransformBatch(In, OutBatch);
+		}
+		const double BatchTime = FPlatformTime::Seconds() - StartTime;
+
+		// both paths have to agree, otherwise the timings are meaningless
+		double MaxError = 0.0;
+		for (int32 Index = 0; Index < NumAgents; ++Index)
+		{
+			MaxError = FMath::Max(MaxError, FVector::Dist(OutScalar.Positions[Index], OutBatch.Positions[Index]));
+			MaxError = FMath::Max(MaxError, FVector::Dist(OutScalar.Velocities[Index], OutBatch.Velocities[Index]));
+			MaxError = FMath::Max(MaxError, (double)OutScalar.Rotations[Index].AngularDistance(OutBatch.Rotations[Index]));
+		}
+
+		const double NumConversions = (double)NumAgents * Iterations;
+		UE_LOG(LogTemp, Log, TEXT("Portal pair transform, %d agents x %d iterations: scalar %.2f ns/agent, batch %.2f ns/agent (%.2fx), max error %g"),
+			NumAgents, Iterations,
+			ScalarTime * 1e9 / NumConversions,
+			BatchTime * 1e9 / NumConversions,
+			BatchTime > 0.0 ? ScalarTime / BatchTime : 0.0,
+			MaxError);
+	}));
@@ -0,0 +1,218 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalPrimitiveCache.h"
+#include "Components/PrimitiveComponent.h"
+#include "Components/SkinnedMeshComponent.h"
+#include "Particles/ParticleSystemComponent.h"
+#include "GameFramework/Actor.h"
+
+/**
+ * Adds all registered primitive components of an actor, and tracks the actor for primitives registered later.
+ */
+void FPortalPrimitiveCache::AddActor(AActor* Actor)
+{
+	if (Actor == nullptr)
+	{
+		return;
+	}
+
+	FTrackedActor& TrackedActor = TrackedActors.FindOrAdd(Actor);
+	TrackedActor.Actor = Actor;
+	TrackedActor.NumComponents = Actor->GetComponents().Num();
+	TrackedActor.bHasUnregisteredPrimitives = false;
+
+	TInlineComponentArray<UPrimitiveComponent*> ActorComponents(Actor);
+	for (UPrimitiveComponent* Component : ActorComponents)
+	{
+		if (!Component->IsRegistered())
+		{
+			TrackedActor.bHasUnregisteredPrimitives = true;
+			continue;
+		}
+		if (ComponentToIndex.Contains(Component))
+		{
+			continue;
+		}
+
+		const int32 Index = Components.Add(Component);
+		Keys.Add(Component);
+		// animating primitives are refreshed with the movable ones, a particle system grows and shrinks in place
+		const bool bAnimating = IsAnimating(Component);
+		Movable.Add(bAnimating || Component->Mobility != EComponentMobility::Static);
+		Animating.Add(bAnimating);
+		Spheres.SetNum(Components.Num());
+		Spheres.Set(Index, Component->Bounds.Origin, Component->Bounds.SphereRadius);
+		ComponentToIndex.Add(Component, Index);
+	}
+}
+
+/**
+ * Removes all primitive components of an actor, by swapping the last primitive into the freed index.
+ */
+void FPortalPrimitiveCache::RemoveActor(AActor* Actor)
+{
+	if (Actor == nullptr)
+	{
+		return;
+	}
+
+	TrackedActors.Remove(Actor);
+
+	TInlineComponentArray<UPrimitiveComponent*> ActorComponents(Actor);
+	for (UPrimitiveComponent* Component : ActorComponents)
+	{
+		if (const int32* Index = ComponentToIndex.Find(Component))
+		{
+			RemoveAtSwap(*Index);
+		}
+	}
+}
+
+/**
+ * Removes all primitives.
+ */
+void FPortalPrimitiveCache::Reset()
+{
+	Components.Reset();
+	Keys.Reset();
+	Movable.Reset();
+	Animating.Reset();
+	Spheres.SetNum(0);
+	ComponentToIndex.Reset();
+	TrackedActors.Reset();
+	MovableIndices.Reset();
+}
+
+/**
+ * Scans the tracked actors whose components may have changed since they were last scanned again.
+ */
+void FPortalPrimitiveCache::AddChangedActors()
+{
+	/**
+	 * A component created on an actor changes the number of components it owns, a component registered later
+	 * is still unregistered when the actor is scanned. Every other actor is one map entry and a count compare per frame.
+	 */
+	for (auto It = TrackedActors.CreateIterator(); It; ++It)
+	{
+		AActor* Actor = It.Value().Actor.Get();
+		if (Actor == nullptr)
+		{
+			It.RemoveCurrent();
+		}
+		else if (It.Value().bHasUnregisteredPrimitives || Actor->GetComponents().Num() != It.Value().NumComponents)
+		{
+			// the actor is already in the map, so adding it does not move the iterator
+			AddActor(Actor);
+		}
+	}
+}
+
+/**
+ * Adds the primitives registered on tracked actors since they were added, re-reads the bounds of the movable primitives,
+ * and drops primitives that were destroyed without their actor.
+ */
+void FPortalPrimitiveCache::UpdateMovableBounds()
+{
+	AddChangedActors();
+
+	// backwards, so a swap removal only moves primitives that were already visited
+	for (int32 Index = Components.Num() - 1; Index >= 0; --Index)
+	{
+		const UPrimitiveComponent* Component = Components[Index].Get();
+		if (Component == nullptr)
+		{
+			RemoveAtSwap(Index);
+		}
+		else if (Movable[Index])
+		{
+			Spheres.Set(Index, Component->Bounds.Origin, Component->Bounds.SphereRadius);
+		}
+	}
+
+	MovableIndices.Reset();
+	for (int32 Index = 0; Index < Movable.Num(); ++Index)
+	{
+		if (Movable[Index])
+		{
+			MovableIndices.Add(Index);
+		}
+	}
+}
+
+/**
+ * Collects the primitives whose bounding sphere intersects a frustum.
+ *
+ * @param FrustumPlanes The planes of the frustum, with the normals pointing out of the frustum as in FConvexVolume.
+ * @param OutComponents Output array, reset and filled with the visible primitives.
+ */
+void FPortalPrimitiveCache::Cull(TConstArrayView<FPlane> FrustumPlanes, TArray<TWeakObjectPtr<UPrimitiveComponent>>& OutComponents)
+{
+	VisibleIndices.Reset();
+	FPortalMath::CullSpheres(FrustumPlanes, Spheres, VisibleIndices);
+
+	OutComponents.Reset(VisibleIndices.Num());
+	for (int32 Index : VisibleIndices)
+	{
+		OutComponents.Add(Components[Index]);
+	}
+}
+
+/**
+ * Collects the movable primitives whose bounding sphere passes a visibility test, with the bounds of the last UpdateMovableBounds.
+ *
+ * @param IsInView Test on the origin and radius of the bounding sphere of a primitive.
+ * @param OutComponents Output array, reset and filled with the movable primitives that pass the test.
+ * @param bOutAnyAnimating Set to true if any primitive that passes the test animates without moving, such as a skinned mesh or particle system.
+ */
+void FPortalPrimitiveCache::GetMovableInView(TFunctionRef<bool(const FVector& Origin, double Radius)> IsInView, TArray<const UPrimitiveComponent*>& OutComponents, bool& bOutAnyAnimating) const
+{
+	OutComponents.Reset();
+	bOutAnyAnimating = false;
+	for (int32 Index : MovableIndices)
+	{
+		// primitives added or removed since UpdateMovableBounds may have moved an index, they are picked up again next frame
+		if (!Components.IsValidIndex(Index) || !Movable[Index])
+		{
+			continue;
+		}
+		if (IsInView(FVector(Spheres.X[Index], Spheres.Y[Index], Spheres.Z[Index]), Spheres.Radius[Index]))
+		{
+			if (const UPrimitiveComponent* Component = Components[Index].Get())
+			{
+				OutComponents.Add(Component);
+				bOutAnyAnimating |= Animating[Index];
+			}
+		}
+	}
+}
+
+/**
+ * Returns true for primitives whose image changes without their transform changing, such as skinned meshes and particle systems.
+ */
+bool FPortalPrimitiveCache::IsAnimating(const UPrimitiveComponent* Component)
+{
+	// UFXSystemComponent is the base of both the Cascade and the Niagara components
+	return Component->IsA<USkinnedMeshComponent>() || Component->IsA<UFXSystemComponent>();
+}
+
+/**
+ * Removes the primitive at the given index by swapping the last primitive into it.
+ */
+void FPortalPrimitiveCache::RemoveAtSwap(int32 Index)
+{
+	const int32 LastIndex = Components.Num() - 1;
+
+	ComponentToIndex.Remove(Keys[Index]);
+	if (Index != LastIndex)
+	{
+		ComponentToIndex.Add(Keys[LastIndex], Index);
+		Spheres.Set(Index, FVector(Spheres.X[LastIndex], Spheres.Y[LastIndex], Spheres.Z[LastIndex]), Spheres.Radius[LastIndex]);
+	}
+
+	Components.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Keys.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Movable.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Animating.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Spheres.SetNum(Components.Num());
+}
@@ -0,0 +1,121 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalRenderTargetBudget.h"
+#include "PortalResolutionTiers.h"
+
+/**
+ * Computes the memory of the front and back render target of a portal.
+ *
+ * @param Tier The resolution tier of the portal.
+ * @param AspectRatio Height divided by width of the render targets.
+ * @param CropFraction Fraction of the view the render targets cover on each axis.
+ * @return The memory of both render targets in bytes.
+ */
+int64 FPortalRenderTargetBudget::GetPortalBytes(int32 Tier, double AspectRatio, const FVector2D& CropFraction) const
+{
+	const FIntPoint Size = FPortalResolutionTiers::GetSize(Tier, AspectRatio, CropFraction);
+	return 2 * (int64)Size.X * Size.Y * BytesPerPixel;
+}
+
+/**
+ * Fills in the memory of every entry. Over budget, the releasable entries are released first, since nobody sees them.
+ * Then the tiers of the least important unlocked entries are stepped down one at a time until the total fits in the budget,
+ * or every unlocked entry is at the lowest tier.
+ *
+ * @param Entries The portals to account for, the Tier, Bytes and bReleased of the entries are updated.
+ * @return The total memory of all entries in bytes, may be over budget if the locked entries alone exceed it.
+ */
+int64 FPortalRenderTargetBudget::Enforce(TArrayView<FPortalRenderTargetBudgetEntry> Entries)
+{
+	TotalBytes = 0;
+	NumStepsDown = 0;
+	NumReleased = 0;
+	SortedEntries.Reset();
+
+	for (int32 Index = 0; Index < Entries.Num(); ++Index)
+	{
+		FPortalRenderTargetBudgetEntry& Entry = Entries[Index];
+		Entry.Tier = FMath::Clamp(Entry.Tier, 0, FPortalResolutionTiers::NumTiers - 1);
+		Entry.Bytes = GetPortalBytes(Entry.Tier, Entry.AspectRatio, Entry.CropFraction);
+		Entry.bReleased = false;
+		TotalBytes += Entry.Bytes;
+
+		if (!Entry.bLocked)
+		{
+			SortedEntries.Add(Index);
+		}
+	}
+
+	if (BudgetBytes <= 0 || TotalBytes <= BudgetBytes)
+	{
+		return TotalBytes;
+	}
+
+	/**
+	 * Portals that are not on screen keep their targets only so they can show their last image when they come back into view.
+	 * Their memory goes before any visible portal loses resolution, largest first so as few as possible need a new capture.
+	 */
+	ReleasableEntries.Reset();
+	for (int32 Index = 0; Index < Entries.Num(); ++Index)
+	{
+		if (Entries[Index].bLocked && Entries[Index].bReleasable)
+		{
+			ReleasableEntries.Add(Index);
+		}
+	}
+	ReleasableEntries.Sort([&Entries](int32 A, int32 B)
+	{
+		return Entries[A].Bytes != Entries[B].Bytes ? Entries[A].Bytes > Entries[B].Bytes : A < B;
+	});
+
+	for (int32 Index : ReleasableEntries)
+	{
+		if (TotalBytes <= BudgetBytes)
+		{
+			break;
+		}
+
+		FPortalRenderTargetBudgetEntry& Entry = Entries[Index];
+		TotalBytes -= Entry.Bytes;
+		Entry.Bytes = 0;
+		Entry.bReleased = true;
+		++NumReleased;
+	}
+
+	if (TotalBytes <= BudgetBytes)
+	{
+		return TotalBytes;
+	}
+
+	// least important first, ties broken by index so the result does not depend on the sort
+	SortedEntries.Sort([&Entries](int32 A, int32 B)
+	{
+		return Entries[A].Importance != Entries[B].Importance ? Entries[A].Importance < Entries[B].Importance : A < B;
+	});
+
+	/**
+	 * The least important portal is stepped down until it reaches the lowest tier before the next one is touched,
+	 * so the portals the player is looking at keep their resolution as long as possible.
+	 */
+	for (int32 Index : SortedEntries)
+	{
+		FPortalRenderTargetBudgetEntry& Entry = Entries[Index];
+		while (TotalBytes > BudgetBytes && Entry.Tier < FPortalResolutionTiers::NumTiers - 1)
+		{
+			++Entry.Tier;
+			++NumStepsDown;
+
+			const int64 NewBytes = GetPortalBytes(Entry.Tier, Entry.AspectRatio, Entry.CropFraction);
+			TotalBytes += NewBytes - Entry.Bytes;
+			Entry.Bytes = NewBytes;
+		}
+
+		if (TotalBytes <= BudgetBytes)
+		{
+			break;
+		}
+	}
+
+	return TotalBytes;
+}
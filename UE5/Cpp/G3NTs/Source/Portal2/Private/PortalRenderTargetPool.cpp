@@ -0,0 +1,118 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalRenderTargetPool.h"
+#include "PixelFormat.h"
+
+/**
+ * Leases a render target of the given size and format, reusing a returned target if one matches.
+ *
+ * @param Size The size of the render target in pixels.
+ * @param Format The format of the render target.
+ * @return The leased render target, to be returned with Release.
+ */
+UTextureRenderTarget2D* FPortalRenderTargetPool::Acquire(FIntPoint Size, ETextureRenderTargetFormat Format)
+{
+	/**
+	 * The pool only holds a handful of targets, a linear search is cheaper than keeping a map in sync.
+	 * Most recently returned first, and removed without a swap, so the free list stays in least recently used order.
+	 */
+	for (int32 Index = FreeTargets.Num() - 1; Index >= 0; --Index)
+	{
+		UTextureRenderTarget2D* RenderTarget = FreeTargets[Index];
+		if (RenderTarget->SizeX == Size.X && RenderTarget->SizeY == Size.Y && RenderTarget->RenderTargetFormat == Format)
+		{
+			FreeTargets.RemoveAt(Index, 1, EAllowShrinking::No);
+			LeasedTargets.Add(RenderTarget);
+			++NumHits;
+			return RenderTarget;
+		}
+	}
+
+	// created in the transient package instead of the portal, as a pooled target outlives the portal that leased it first
+	UTextureRenderTarget2D* RenderTarget = NewObject<UTextureRenderTarget2D>(GetTransientPackage(), UTextureRenderTarget2D::StaticClass(), MakeUniqueObjectName(GetTransientPackage(), UTextureRenderTarget2D::StaticClass(), TEXT("PortalRenderTarget")));
+	RenderTarget->RenderTargetFormat = Format;
+	RenderTarget->Filter = TextureFilter::TF_Default;
+	RenderTarget->ClearColor = FColor::Black;
+	RenderTarget->bNeedsTwoCopies = false;
+	RenderTarget->AddressX = TextureAddress::TA_Clamp;
+	RenderTarget->AddressY = TextureAddress::TA_Clamp;
+	RenderTarget->SizeX = Size.X;
+	RenderTarget->SizeY = Size.Y;
+	RenderTarget->UpdateResource();
+
+	LeasedTargets.Add(RenderTarget);
+	ResidentBytes += GetTargetBytes(RenderTarget);
+	++NumMisses;
+	return RenderTarget;
+}
+
+/**
+ * Returns a leased render target to the pool. Does nothing for targets that were not leased from this pool.
+ *
+ * @param RenderTarget The render target to return.
+ */
+void FPortalRenderTargetPool::Release(UTextureRenderTarget2D* RenderTarget)
+{
+	if (RenderTarget == nullptr || LeasedTargets.RemoveSwap(RenderTarget, EAllowShrinking::No) == 0)
+	{
+		return;
+	}
+
+	/**
+	 * A full pool evicts its least recently used target, the one returned first. The target returned now is the one most likely
+	 * to be leased again soon, by the portal that replaces the one that returned it.
+	 */
+	if (MaxFreeTargets <= 0)
+	{
+		FreeRenderTarget(RenderTarget);
+		return;
+	}
+	if (FreeTargets.Num() >= MaxFreeTargets)
+	{
+		FreeRenderTarget(FreeTargets[0]);
+		FreeTargets.RemoveAt(0, 1, EAllowShrinking::No);
+	}
+	FreeTargets.Add(RenderTarget);
+}
+
+/**
+ * Frees all unused render targets. Leased targets stay with the portals that lease them.
+ */
+void FPortalRenderTargetPool::Reset()
+{
+	for (UTextureRenderTarget2D* RenderTarget : FreeTargets)
+	{
+		FreeRenderTarget(RenderTarget);
+	}
+	FreeTargets.Reset();
+}
+
+/**
+ * Returns the fraction of the leases that were served from a returned render target.
+ *
+ * @return The hit rate between 0 and 1, 0 before the first lease.
+ */
+float FPortalRenderTargetPool::GetHitRate() const
+{
+	const int32 NumLeases = NumHits + NumMisses;
+	return NumLeases > 0 ? (float)NumHits / NumLeases : 0.f;
+}
+
+/**
+ * Frees the GPU resource of a render target that is no longer in the pool, the object is collected by the garbage collector.
+ */
+void FPortalRenderTargetPool::FreeRenderTarget(UTextureRenderTarget2D* RenderTarget)
+{
+	ResidentBytes -= GetTargetBytes(RenderTarget);
+	RenderTarget->ReleaseResource();
+}
+
+/**
+ * Estimates the GPU memory of a render target from its size and pixel format.
+ */
+int64 FPortalRenderTargetPool::GetTargetBytes(const UTextureRenderTarget2D* RenderTarget)
+{
+	const EPixelFormat PixelFormat = GetPixelFormatFromRenderTargetFormat(RenderTarget->RenderTargetFormat);
+	return (int64)RenderTarget->SizeX * RenderTarget->SizeY * GPixelFormats[PixelFormat].BlockBytes;
+}
@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalResolutionTiers.h"
+
+namespace PortalResolutionTiers
+{
+	/** Render target width per tier, the top tier is the former fixed resolution */
+	static const int32 Widths[FPortalResolutionTiers::NumTiers] = { 1524, 1024, 512, 256 };
+
+	/** Minimum screen coverage per tier, a portal covering at least this much of the screen may use the tier */
+	static const float MinCoverage[FPortalResolutionTiers::NumTiers] = { 0.25f, 0.06f, 0.015f, 0.f };
+
+	/** A portal only drops to a lower resolution when its coverage is this factor below the boundary of its current tier */
+	static const float DowngradeFactor = 0.75f;
+}
+
+/**
+ * Returns the render target width of a tier. The height follows from the aspect ratio of the viewport.
+ */
+int32 FPortalResolutionTiers::GetWidth(int32 Tier)
+{
+	return PortalResolutionTiers::Widths[FMath::Clamp(Tier, 0, NumTiers - 1)];
+}
+
+/**
+ * Returns the render target size of a tier.
+ *
+ * @param Tier The resolution tier.
+ * @param AspectRatio Height divided by width of the viewport.
+ * @return The size of the render target in pixels.
+ */
+FIntPoint FPortalResolutionTiers::GetSize(int32 Tier, double AspectRatio)
+{
+	const int32 Width = GetWidth(Tier);
+	return FIntPoint(Width, FMath::Max(1, FMath::RoundToInt(Width * AspectRatio)));
+}
+
+/**
+ * Returns the render target size of a tier, cropped to a part of the view. Keeps the pixel density of the uncropped size.
+ *
+ * @param Tier The resolution tier.
+ * @param AspectRatio Height divided by width of the viewport.
+ * @param CropFraction Fraction of the view the render target covers on each axis, 0 to 1.
+ * @return The size of the render target in pixels.
+ */
+FIntPoint FPortalResolutionTiers::GetSize(int32 Tier, double AspectRatio, const FVector2D& CropFraction)
+{
+	const FIntPoint Size = GetSize(Tier, AspectRatio);
+	return FIntPoint(
+		FMath::Clamp(FMath::CeilToInt(Size.X * CropFraction.X), 1, Size.X),
+		FMath::Clamp(FMath::CeilToInt(Size.Y * CropFraction.Y), 1, Size.Y));
+}
+
+/**
+ * Selects the tier for a portal from its screen coverage, with hysteresis around the tier boundaries.
+ * Moving to a higher resolution happens as soon as the coverage crosses a boundary, moving to a lower resolution
+ * only when the coverage is clearly below it, so a portal hovering around a boundary does not reallocate every frame.
+ *
+ * @param ScreenCoverage Fraction of the screen covered by the portal, 0 to 1.
+ * @param CurrentTier The tier the portal currently uses.
+ * @return The tier the portal should use.
+ */
+int32 FPortalResolutionTiers::SelectTier(float ScreenCoverage, int32 CurrentTier)
+{
+	CurrentTier = FMath::Clamp(CurrentTier, 0, NumTiers - 1);
+
+	// the highest resolution tier whose minimum coverage is reached
+	int32 Tier = 0;
+	for (; Tier < NumTiers - 1; ++Tier)
+	{
+		if (ScreenCoverage >= PortalResolutionTiers::MinCoverage[Tier])
+		{
+			break;
+		}
+	}
+
+	if (Tier >= CurrentTier)
+	{
+		// lower or equal resolution, only accepted when the coverage clearly left the current tier
+		const bool bClearlyBelow = ScreenCoverage < PortalResolutionTiers::MinCoverage[CurrentTier] * PortalResolutionTiers::DowngradeFactor;
+		return bClearlyBelow ? Tier : CurrentTier;
+	}
+	return Tier;
+}
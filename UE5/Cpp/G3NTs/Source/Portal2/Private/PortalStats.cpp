@@ -0,0 +1,25 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalStats.h"
+
+DEFINE_STAT(STAT_PortalCachedPrimitives);
+DEFINE_STAT(STAT_PortalCapturedPrimitives);
+DEFINE_STAT(STAT_PortalWorldScans);
+DEFINE_STAT(STAT_PortalRegisteredPortals);
+DEFINE_STAT(STAT_PortalRegisteredAgents);
+DEFINE_STAT(STAT_PortalPendingRegistrations);
+DEFINE_STAT(STAT_PortalCaptures);
+DEFINE_STAT(STAT_PortalCapturesDeferred);
+DEFINE_STAT(STAT_PortalImpostors);
+DEFINE_STAT(STAT_PortalCapturesSkipped);
+DEFINE_STAT(STAT_PortalCapturesSkippedFraction);
+DEFINE_STAT(STAT_PortalCaptureLatencyFrames);
+DEFINE_STAT(STAT_PortalCapturePoseError);
+DEFINE_STAT(STAT_PortalMaterialParameterWrites);
+DEFINE_STAT(STAT_PortalMaterialParameterWritesSuppressed);
+DEFINE_STAT(STAT_PortalRenderTargetPoolHits);
+DEFINE_STAT(STAT_PortalRenderTargetPoolMisses);
+DEFINE_STAT(STAT_PortalRenderTargetPoolHitRate);
+DEFINE_STAT(STAT_PortalRenderTargetPoolMemory);
+DEFINE_STAT(STAT_PortalRenderTargetBudgetMemory);
@@ -3,6 +3,7 @@
 
 #include "PortalSurface.h"
 #include "Portal3Manager.h"
+#include "PortalWorldSubsystem.h"
 #include "DynamicMeshBuilder.h"
 #include "Components/StaticMeshComponent.h"
 
@@ -267,10 +268,9 @@ void UPortalSurface::FitPortalToSurface(int32 PortalID, const FVector BoxMin, co
  */
 void UPortalSurface::IterateMap()
 {
-	TArray<AActor*> Managers;
-	UGameplayStatics::GetAllActorsOfClass(GetWorld(), ManagerClass, Managers);
-	APortal3Manager* PortalManager = Cast<APortal3Manager>(Managers[0]);
-	if (PortalManager->OrangePortal && PortalManager->BluePortal)
+	UPortalWorldSubsystem* PortalSubsystem = GetWorld()->GetSubsystem<UPortalWorldSubsystem>();
+	APortal3Manager* PortalManager = PortalSubsystem ? PortalSubsystem->GetManager() : nullptr;
+	if (PortalManager && PortalManager->OrangePortal && PortalManager->BluePortal)
 	{
 		// Iterate over the map
 		for (const auto& Elem : Portals)
@@ -3,12 +3,19 @@
 
 #include "PortalV3.h"
 #include "PortalSurface.h"
+#include "PortalMath.h"
+#include "PortalResolutionTiers.h"
+#include "PortalWorldSubsystem.h"
+#include "PortalRenderTargetPool.h"
+#include "Portal3Manager.h"
 #include "Math/UnrealMathUtility.h"
+#include "Kismet/GameplayStatics.h"
 
 // Sets default values
 APortalV3::APortalV3()
 {
     PrimaryActorTick.bCanEverTick = false;
+    PortalSlot = INDEX_NONE;
 
     /**
      * Initializing all the components connected to the portal actor 
@@ -109,15 +116,80 @@ void APortalV3::BeginPlay()
 
     DynamicMaterialInstance = UMaterialInstanceDynamic::Create(Material, this);
     DynamicMaterialInstance->SetFlags(RF_Transient);
+    MaterialParameters.Init(DynamicMaterialInstance);
 
 	PortalMesh->SetMaterial(0, DynamicMaterialInstance);
 
+    /**
+     * The texture targets are leased from the render target pool of the portal manager once the portal is linked and visible,
+     * until then only the size is stored.
+     */
     UpdateTextureTarget(FVector2D(512, 512));
 
-    SceneCapture->TextureTarget = PortalTexture;
+    MaterialParameters.SetVector(TEXT("PortalEdge"), FLinearColor(PortalEdgeColor));
 
-    DynamicMaterialInstance->SetTextureParameterValue(TEXT("Texture"), PortalTexture);
-    DynamicMaterialInstance->SetVectorParameterValue(TEXT("PortalEdge"), PortalEdgeColor);
+    /**
+     * The pair transform is cached, it only needs to be recomputed when the portal moves.
+     */
+    RootComponent->TransformUpdated.AddUObject(this, &APortalV3::OnPortalTransformUpdated);
+
+    /**
+     * Every portal registers itself, including the ones shot by the manager: SpawnActor runs BeginPlay
+     * before APortal3Manager::CreateNewPortal gets the new portal back.
+     */
+    if (UPortalWorldSubsystem* PortalSubsystem = GetWorld()->GetSubsystem<UPortalWorldSubsystem>())
+    {
+        PortalSubsystem->RegisterPortal(this);
+    }
+}
+
+void APortalV3::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    /**
+     * Portals destroyed by the manager are already unregistered. This covers portals that end play for other reasons,
+     * such as level streaming, without the manager having to scan the world for the remaining portals.
+     */
+    if (UPortalWorldSubsystem* PortalSubsystem = GetWorld()->GetSubsystem<UPortalWorldSubsystem>())
+    {
+        PortalSubsystem->UnregisterPortal(this);
+        if (APortal3Manager* Manager = PortalSubsystem->GetManager())
+        {
+            ReleaseTextureTargets(Manager->GetRenderTargetPool());
+        }
+    }
+
+	Super::EndPlay(EndPlayReason);
+}
+
+/**
+ * Bound to the TransformUpdated event of the root component. Invalidates the pair transform of this portal,
+ * as well as the one of the linked portal, as both depend on the transform of this portal.
+ */
+void APortalV3::OnPortalTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+    MarkPairTransformDirty();
+    if (LinkedPortal != nullptr)
+    {
+        LinkedPortal->MarkPairTransformDirty();
+    }
+}
+
+/**
+ * Gets the cached conversion from this portal to the linked portal. The conversion is only recomputed
+ * when one of the portals moved, or the linked portal changed, since the last call.
+ * Should only be called when the portal has a linked portal.
+ *
+ * @return The conversion from this portal's space to the linked portal's space.
+ */
+const FPortalPairTransform& APortalV3::GetPairTransform()
+{
+    if ((bPairTransformDirty || PairTransformTarget != LinkedPortal) && LinkedPortal != nullptr)
+    {
+        PairTransform.Update(GetActorTransform(), LinkedPortal->GetActorTransform());
+        PairTransformTarget = LinkedPortal;
+        bPairTransformDirty = false;
+    }
+    return PairTransform;
 }
 
 /**
@@ -131,22 +203,47 @@ void APortalV3::BeginPlay()
  */
 void APortalV3::UpdateScreenCapture(FVector NewLocation, FQuat NewRotation, FMatrix ViewProjectionMatrix, FTransform Target, FMatrix ProjectionMatrix)
 {
-    ViewProjectionMatrix = ViewProjectionMatrix.GetTransposed();
+    /**
+     * The capture only renders CaptureRect, stretched over the whole render target. The material gets the same crop
+     * in its view projection, so the screen position it computes lands in the cropped texture.
+     */
+    const FMatrix CropMatrix = FPortalMath::MakeScreenCropMatrix(CaptureRect);
+
+    ViewProjectionMatrix = (ViewProjectionMatrix * CropMatrix).GetTransposed();
 
     FVector4 VecX, VecY, VecZ, VecW;
     BreakMatrix(ViewProjectionMatrix, VecX, VecY, VecZ, VecW);
 
-    DynamicMaterialInstance->SetVectorParameterValue(TEXT("VPX"), FVector4(VecX.X, VecX.Y, VecX.Z, VecX.W));
-    DynamicMaterialInstance->SetVectorParameterValue(TEXT("VPY"), FVector4(VecY.X, VecY.Y, VecY.Z, VecY.W));
-    DynamicMaterialInstance->SetVectorParameterValue(TEXT("VPW"), FVector4(VecW.X, VecW.Y, VecW.Z, VecW.W));
+    MaterialParameters.SetVector(TEXT("VPX"), FLinearColor(VecX));
+    MaterialParameters.SetVector(TEXT("VPY"), FLinearColor(VecY));
+    MaterialParameters.SetVector(TEXT("VPW"), FLinearColor(VecW));
 
     SceneCapture->SetWorldLocation(NewLocation);
     SceneCapture->SetWorldRotation(NewRotation);
 
-    SceneCapture->ClipPlaneNormal = Target.GetRotation().GetForwardVector();
-    SceneCapture->ClipPlaneBase = Target.GetLocation() + (SceneCapture->ClipPlaneNormal * -1.5f);
+    const FVector ClipPlaneNormal = Target.GetRotation().GetForwardVector();
+    const FVector ClipPlaneBase = Target.GetLocation() + (ClipPlaneNormal * -1.5f);
 
-    SceneCapture->CustomProjectionMatrix = ProjectionMatrix;
+    if (ClipMode == EPortalClipMode::ObliqueProjection)
+    {
+        /**
+         * The near plane of the projection is moved onto the exit portal, so the depth clipping removes everything behind it.
+         * The clip plane has to be in the view space of the capture, which is built the same way the renderer builds it.
+         */
+        const FMatrix ViewMatrix = FPortalMath::MakeViewMatrix(NewLocation, NewRotation);
+        const FPlane ViewSpaceClipPlane = FPlane(ClipPlaneBase, ClipPlaneNormal).TransformBy(ViewMatrix);
+
+        // the crop leaves the depth untouched, so it is applied after the near plane is moved
+        SceneCapture->bEnableClipPlane = false;
+        SceneCapture->CustomProjectionMatrix = FPortalMath::MakeObliqueProjection(ProjectionMatrix, ViewSpaceClipPlane) * CropMatrix;
+    }
+    else
+    {
+        SceneCapture->bEnableClipPlane = true;
+        SceneCapture->ClipPlaneNormal = ClipPlaneNormal;
+        SceneCapture->ClipPlaneBase = ClipPlaneBase;
+        SceneCapture->CustomProjectionMatrix = ProjectionMatrix * CropMatrix;
+    }
 
     SceneCapture->CaptureScene();
 
@@ -158,13 +255,13 @@ void APortalV3::UpdateScreenCapture(FVector NewLocation, FQuat NewRotation, FMat
 	{
 		SceneCapture->TextureTarget = PortalTexture;
 		bUsingPrimaryTextureTarget = false;
-		DynamicMaterialInstance->SetTextureParameterValue(TEXT("Texture"), PortalTexture2);
+		MaterialParameters.SetTexture(TEXT("Texture"), PortalTexture2);
 	}
 	else
 	{
 		SceneCapture->TextureTarget = PortalTexture2;
 		bUsingPrimaryTextureTarget = true;
-		DynamicMaterialInstance->SetTextureParameterValue(TEXT("Texture"), PortalTexture);
+		MaterialParameters.SetTexture(TEXT("Texture"), PortalTexture);
 	}
 }
 
@@ -173,62 +270,174 @@ void APortalV3::UpdateScreenCapture(FVector NewLocation, FQuat NewRotation, FMat
  */
 void APortalV3::NullScreenCapture()
 {
-    PortalTexture->UpdateResource();
-    PortalTexture2->UpdateResource();
+    if (PortalTexture != nullptr && PortalTexture2 != nullptr)
+    {
+        PortalTexture->UpdateResource();
+        PortalTexture2->UpdateResource();
+    }
 }
 /**
- * Updates the 2 texture targets. If the texture target objects do not yet exist,
- * it creates them and sets their default values. If the texture target objects do exist,
- * checks if the screen size changed, and if so updates the texture size.
+ * Stores the viewport size the 2 texture targets are sized from. If the size changed,
+ * the texture targets are leased again with the new size on the next AcquireTextureTargets.
  *
  * @param Size The new size for the texture target.
  */
 void APortalV3::UpdateTextureTarget(FVector2D Size)
 {
-	if (PortalTexture == nullptr && PortalTexture2 == nullptr)
-	{
-		PortalTexture = NewObject<UTextureRenderTarget2D>(this, UTextureRenderTarget2D::StaticClass(), *FString("PortalRenderTarget"));
-		PortalTexture2 = NewObject<UTextureRenderTarget2D>(this, UTextureRenderTarget2D::StaticClass(), *FString("PortalRenderTarget2"));
+    OldSize = Size;
+}
 
-		PortalTexture->RenderTargetFormat = ETextureRenderTargetFormat::RTF_RGBA8_SRGB;
-		PortalTexture->Filter = TextureFilter::TF_Default;
-		PortalTexture->ClearColor = FColor::Black;
-		PortalTexture->bNeedsTwoCopies = false;
-		PortalTexture->AddressX = TextureAddress::TA_Clamp;
-		PortalTexture->AddressY = TextureAddress::TA_Clamp;
+/**
+ * Selects the render target resolution tier from the screen coverage of the portal.
+ * The texture targets are resized on the next AcquireTextureTargets.
+ *
+ * @param ScreenCoverage Fraction of the screen covered by the portal, 0 to 1.
+ * @return True if the tier changed.
+ */
+bool APortalV3::UpdateResolutionTier(float ScreenCoverage)
+{
+    const int32 NewTier = FPortalResolutionTiers::SelectTier(ScreenCoverage, ResolutionTier);
+    if (NewTier == ResolutionTier)
+    {
+        return false;
+    }
 
-		PortalTexture2->RenderTargetFormat = ETextureRenderTargetFormat::RTF_RGBA8_SRGB;
-		PortalTexture2->Filter = TextureFilter::TF_Default;
-		PortalTexture2->ClearColor = FColor::Black;
-		PortalTexture2->bNeedsTwoCopies = false;
-		PortalTexture2->AddressX = TextureAddress::TA_Clamp;
-		PortalTexture2->AddressY = TextureAddress::TA_Clamp;
+    ResolutionTier = NewTier;
+    return true;
+}
 
-		PortalTexture->SizeX = 1524;
-		PortalTexture->SizeY = FMath::RoundToInt(1524 * Size.Y / Size.X);
+/**
+ * Leases a front and back texture target from the pool, sized from the resolution tier and the viewport aspect ratio.
+ * Does nothing if the portal already leases targets of that size, otherwise the old targets are returned first.
+ *
+ * @param Pool The render target pool of the portal manager.
+ * @return True if new targets were leased, their content is undefined and they need a new capture.
+ */
+bool APortalV3::AcquireTextureTargets(FPortalRenderTargetPool& Pool)
+{
+    const FIntPoint Size = GetDesiredTextureSize();
+    if (PortalTexture != nullptr && PortalTexture2 != nullptr && PortalTexture->SizeX == Size.X && PortalTexture->SizeY == Size.Y)
+    {
+        return false;
+    }
 
-		PortalTexture2->SizeX = 1524;
-		PortalTexture2->SizeY = FMath::RoundToInt(1524 * Size.Y / Size.X);
+    ReleaseTextureTargets(Pool);
 
-		OldSize = Size;
+    PortalTexture = Pool.Acquire(Size, ETextureRenderTargetFormat::RTF_RGBA8_SRGB);
+    PortalTexture2 = Pool.Acquire(Size, ETextureRenderTargetFormat::RTF_RGBA8_SRGB);
 
-		PortalTexture->UpdateResource();
-		PortalTexture2->UpdateResource();
-	}
-    else if (Size != OldSize && PortalTexture != nullptr && PortalTexture2 != nullptr)
+    // the next capture renders into PortalTexture and then shows it, see UpdateScreenCapture
+    CaptureHash = 0;
+    SceneCapture->TextureTarget = PortalTexture;
+    bUsingPrimaryTextureTarget = false;
+    MaterialParameters.SetTexture(TEXT("Texture"), PortalTexture2);
+    return true;
+}
+
+/**
+ * Stops the live capture and shows a single low resolution snapshot instead, taken from a canonical viewpoint
+ * in front of the portal. The material is given the view projection of that viewpoint, so the snapshot stays
+ * attached to the portal surface from any angle, only without parallax.
+ *
+ * @param Pool The render target pool of the portal manager, the snapshot uses the lowest resolution tier.
+ * @param ViewDistance Distance of the canonical viewpoint in front of the portal.
+ */
+void APortalV3::CaptureImpostor(FPortalRenderTargetPool& Pool, double ViewDistance)
+{
+    if (LinkedPortal == nullptr)
     {
-        OldSize = Size;
+        return;
+    }
 
-        PortalTexture->SizeX = 1524;
-        PortalTexture->SizeY = FMath::RoundToInt(1524 * Size.Y / Size.X);
-        PortalTexture2->SizeX = 1524;
-        PortalTexture2->SizeY = FMath::RoundToInt(1524 * Size.Y / Size.X);
+    // the canonical viewpoint is framed on the portal, the snapshot is never cropped
+    ResolutionTier = FPortalResolutionTiers::NumTiers - 1;
+    CaptureRect = FBox2D(FVector2D(-1.0), FVector2D(1.0));
+    AcquireTextureTargets(Pool);
 
-        PortalTexture->UpdateResource();
-        PortalTexture2->UpdateResource();
+    /**
+     * The canonical viewpoint looks straight at the portal along its normal, with a field of view that fits the portal opening.
+     * It is converted through the portal pair like the player camera would be.
+     */
+    const FVector Forward = GetActorForwardVector();
+
+    FMinimalViewInfo CanonicalView;
+    CanonicalView.Location = GetActorLocation() + Forward * ViewDistance;
+    CanonicalView.Rotation = (-Forward).Rotation();
+    CanonicalView.FOV = 90.f;
+    CanonicalView.AspectRatio = 1.0 / GetTextureAspectRatio();
+
+    FMatrix ViewMatrix;
+    FMatrix ProjectionMatrix;
+    FMatrix ViewProjectionMatrix;
+    UGameplayStatics::GetViewProjectionMatrix(CanonicalView, ViewMatrix, ProjectionMatrix, ViewProjectionMatrix);
+
+    // the show only list of the last live capture was culled for another viewpoint
+    ClearShowOnlyList();
+
+    const FPortalPairTransform& Pair = GetPairTransform();
+    UpdateScreenCapture(Pair.TransformPosition(CanonicalView.Location), Pair.TransformRotation(CanonicalView.Rotation.Quaternion()),
+        ViewProjectionMatrix, LinkedPortal->GetActorTransform(), ProjectionMatrix);
+
+    // the snapshot does not follow the camera, the live capture hash no longer describes the texture
+    CaptureHash = 0;
+    bShowingImpostor = true;
+    ImpostorTarget = LinkedPortal;
+}
+
+/**
+ * Switches the scene capture to only render the primitives in its show only list, and returns that list to be filled.
+ * Used by the portal manager to pass the primitives that survive culling against the portal frustum.
+ *
+ * @return The show only list of the scene capture.
+ */
+TArray<TWeakObjectPtr<UPrimitiveComponent>>& APortalV3::BeginShowOnlyList()
+{
+    SceneCapture->PrimitiveRenderMode = ESceneCapturePrimitiveRenderMode::PRM_UseShowOnlyList;
+    return SceneCapture->ShowOnlyComponents;
+}
+
+/**
+ * Switches the scene capture back to rendering all scene primitives, and empties the show only list.
+ */
+void APortalV3::ClearShowOnlyList()
+{
+    SceneCapture->PrimitiveRenderMode = ESceneCapturePrimitiveRenderMode::PRM_RenderScenePrimitives;
+    SceneCapture->ShowOnlyComponents.Reset();
+}
+
+/**
+ * Returns the leased texture targets to the pool. The portal shows the default texture of its material until it leases new ones.
+ *
+ * @param Pool The render target pool of the portal manager.
+ */
+void APortalV3::ReleaseTextureTargets(FPortalRenderTargetPool& Pool)
+{
+    if (PortalTexture == nullptr && PortalTexture2 == nullptr)
+    {
+        return;
+    }
+
+    Pool.Release(PortalTexture);
+    Pool.Release(PortalTexture2);
+    PortalTexture = nullptr;
+    PortalTexture2 = nullptr;
+
+    // a returned target is leased by the next portal, this portal may no longer render into or show it
+    SceneCapture->TextureTarget = nullptr;
+    if (DynamicMaterialInstance != nullptr)
+    {
+        MaterialParameters.SetTexture(TEXT("Texture"), nullptr);
     }
 }
 
+/**
+ * Gets the size of the texture targets from the current resolution tier, the viewport aspect ratio in OldSize and the CaptureRect.
+ */
+FIntPoint APortalV3::GetDesiredTextureSize() const
+{
+    return FPortalResolutionTiers::GetSize(ResolutionTier, GetTextureAspectRatio(), GetCaptureRectFraction());
+}
+
 /**
  * Deprecated! Debugs the collider used for teleportation checks by drawing a debug box in the world.
  */
@@ -239,21 +448,23 @@ void APortalV3::DebugCollider()
 
 /**
  * Gets the coordinates of the bounds of the portal.
- * However, it discards one dimension as the portal plane is a "plane" not a box.
+ * However, it discards one dimension as the portal plane is a "plane" not a box, so only the 4 corners of the plane are returned.
  *
  * @return An array of vectors representing the bounds of the portal.
  */
-TArray<FVector> APortalV3::GetPortalBounds()
+FPortalCornerArray APortalV3::GetPortalBounds() const
 {
-    TArray<FVector> PortalBounds;
+    FPortalCornerArray PortalBounds;
 
     FBox MeshBox = PortalMesh->GetStaticMesh()->GetBounds().GetBox();
-    FTransform Transform(PortalRotation + FRotator(0.f, 90.f, 0.f), GetActorLocation(), PortalScale);
+
+    // the world transform of the plane mesh, so the corners follow the rotation of the portal on its surface
+    const FTransform& Transform = PortalMesh->GetComponentTransform();
 
     /**
-     * iterating through all corners of a standard bounds box.
+     * iterating through the corners of the bottom face of a standard bounds box, the plane mesh has no depth.
      */
-    for (int32 i = 0; i < 8; i++)
+    for (int32 i = 0; i < 4; i++)
     {
         FVector LocalCorner(
             (i & 1) ? MeshBox.Max.X : MeshBox.Min.X,
@@ -299,25 +510,56 @@ void APortalV3::DrawBox(UWorld* World, const FVector& WorldOffset, const FColor&
  * @param Point The point to check.
  * @return True if the point is inside the portal, false otherwise.
  */
-bool APortalV3::IsInside(FVector Point)
+bool APortalV3::IsInside(const FVector& Point) const
 {
-    FVector Offset = GetActorLocation();
-    FVector BoxCenter = BoxCheck->GetComponentLocation();
     FVector BoxExtent = BoxCheck->GetScaledBoxExtent();
 
-    FVector DirectionX = BoxCheck->GetForwardVector();
-    FVector DirectionY = BoxCheck->GetRightVector();
-    FVector DirectionZ = BoxCheck->GetUpVector();
-
-    FVector Direction = Point - Offset;
-
-    Direction = GetActorRotation().GetInverse().RotateVector(Direction);
+    /**
+     * Unrotating with the actor quaternion directly, instead of building the inverse rotator every call.
+     */
+    FVector Direction = GetActorQuat().UnrotateVector(Point - GetActorLocation());
 
     bool IsInside = FMath::Abs(Direction.X) <= BoxExtent.X && FMath::Abs(Direction.Y) <= BoxExtent.Y && FMath::Abs(Direction.Z) <= -BoxExtent.Z;
 
     return IsInside;
 }
 
+/**
+ * Checks if an agent moved through the portal opening from front to back between two locations.
+ * Unlike IsInside this does not depend on the agent being sampled inside the collider, so fast agents are never missed.
+ *
+ * @param Start The location of the agent at the end of the previous frame.
+ * @param End The current location of the agent.
+ * @param OutFraction Fraction along the movement at which the portal was crossed.
+ * @return True if the portal was crossed.
+ */
+bool APortalV3::IsCrossedBySegment(const FVector& Start, const FVector& End, double& OutFraction) const
+{
+    /**
+     * The opening is the face of the collider box, its depth along the forward axis is not needed for the sweep.
+     */
+    FVector BoxExtent = BoxCheck->GetScaledBoxExtent().GetAbs();
+
+    return FPortalMath::SegmentCrossesQuad(Start, End, GetActorLocation(), GetActorQuat(), FVector2D(BoxExtent.Y, BoxExtent.Z), OutFraction);
+}
+
+/**
+ * Gets the world space axis aligned bounds of the portal collider box.
+ * Used by the portal manager to insert the portal into its broadphase grid.
+ *
+ * @return The axis aligned bounding box enclosing the rotated portal collider.
+ */
+FBox APortalV3::GetTeleportBounds() const
+{
+    /**
+     * The collider scale is rotated, which makes some of the extents negative. The absolute extent is used,
+     * so the bounds always enclose the volume checked in IsInside.
+     */
+    FVector BoxExtent = BoxCheck->GetScaledBoxExtent().GetAbs();
+
+    return FBox::BuildAABB(FVector::ZeroVector, BoxExtent).TransformBy(FTransform(GetActorQuat(), GetActorLocation()));
+}
+
 /**
  * Breaks a view projection matrix into its component vectors.
  * Which is then used in the portal material instance to correctly calculate the screen space coordinates.
@@ -353,6 +595,15 @@ void APortalV3::PortalDestroySelf()
         LinkedPortal->LinkedPortal = nullptr;
         UE_LOG(LogTemp, Warning, TEXT("Destroying the link"))
     }
+
+    // the texture targets go back to the pool, so the next portal that is shot reuses them
+    if (UPortalWorldSubsystem* PortalSubsystem = GetWorld()->GetSubsystem<UPortalWorldSubsystem>())
+    {
+        if (APortal3Manager* Manager = PortalSubsystem->GetManager())
+        {
+            ReleaseTextureTargets(Manager->GetRenderTargetPool());
+        }
+    }
     PortalSurface->RemovePortal(SurfaceId);
     Destroy();
 }
@@ -378,6 +629,6 @@ void APortalV3::SetSurfaceData(int32 Index, UPortalSurface* PortalSurfaceData)
 void APortalV3::SetPortalColor(FVector ColorIn)
 {
     PortalEdgeColor = ColorIn;
-    DynamicMaterialInstance->SetVectorParameterValue(TEXT("PortalEdge"), PortalEdgeColor);
+    MaterialParameters.SetVector(TEXT("PortalEdge"), FLinearColor(PortalEdgeColor));
 }
 
@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalViewExtension.h"
+#include "Portal3Manager.h"
+#include "SceneView.h"
+
+FPortalViewExtension::FPortalViewExtension(const FAutoRegister& AutoRegister, UWorld* InWorld, APortal3Manager* InManager)
+	: FWorldSceneViewExtension(AutoRegister, InWorld)
+	, Manager(InManager)
+{
+}
+
+/**
+ * Passes the view of the player to the portal manager. Scene captures render their own view families through the
+ * view extensions as well, the portal captures included, those are ignored.
+ */
+void FPortalViewExtension::BeginRenderViewFamily(FSceneViewFamily& InViewFamily)
+{
+	APortal3Manager* PortalManager = Manager.Get();
+	if (PortalManager == nullptr || PortalManager->PlayerController == nullptr)
+	{
+		return;
+	}
+
+	const AActor* ViewTarget = PortalManager->PlayerController->GetViewTarget();
+	for (const FSceneView* View : InViewFamily.Views)
+	{
+		if (View != nullptr && !View->bIsSceneCapture && View->ViewActor == ViewTarget)
+		{
+			PortalManager->OnBeginRenderView(*View);
+			return;
+		}
+	}
+}
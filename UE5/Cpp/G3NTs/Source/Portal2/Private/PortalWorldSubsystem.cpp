@@ -0,0 +1,157 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PortalWorldSubsystem.h"
+#include "Portal3Manager.h"
+#include "PortalV3.h"
+#include "PortalStats.h"
+
+/**
+ * Registers the portal manager of this world, and hands it all queued portals and agents.
+ *
+ * @param InManager The portal manager.
+ */
+void UPortalWorldSubsystem::SetManager(APortal3Manager* InManager)
+{
+	if (Manager != nullptr && Manager != InManager)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("A second portal manager was placed in the world, only the first one is used!"));
+		return;
+	}
+
+	Manager = InManager;
+	FlushPendingRegistrations();
+}
+
+/**
+ * Unregisters the portal manager of this world, if it is the registered one.
+ *
+ * @param InManager The portal manager that ends play.
+ */
+void UPortalWorldSubsystem::ClearManager(APortal3Manager* InManager)
+{
+	if (Manager == InManager)
+	{
+		Manager = nullptr;
+	}
+}
+
+/**
+ * Returns true while the manager is spawning clones, see APortal3Manager::GetCloneStatus.
+ */
+bool UPortalWorldSubsystem::GetCloneStatus() const
+{
+	return Manager != nullptr && Manager->GetCloneStatus();
+}
+
+/**
+ * Adds an actor with a UTeleportAgent component to the manager, or queues it until the manager registers.
+ */
+void UPortalWorldSubsystem::RegisterAgent(AActor* Actor)
+{
+	if (Manager != nullptr)
+	{
+		Manager->HandleActorSpawned(Actor);
+	}
+	else
+	{
+		PendingAgents.AddUnique(Actor);
+	}
+}
+
+/**
+ * Removes an actor with a UTeleportAgent component from the manager, or from the queue.
+ */
+void UPortalWorldSubsystem::UnregisterAgent(AActor* Actor)
+{
+	PendingAgents.RemoveSwap(Actor, EAllowShrinking::No);
+	if (Manager != nullptr)
+	{
+		Manager->HandleActorDestroyed(Actor);
+	}
+}
+
+/**
+ * Adds a portal to the manager, or queues it until the manager registers.
+ */
+void UPortalWorldSubsystem::RegisterPortal(APortalV3* Portal)
+{
+	if (Manager != nullptr)
+	{
+		Manager->RegisterPortal(Portal);
+	}
+	else
+	{
+		PendingPortals.AddUnique(Portal);
+	}
+}
+
+/**
+ * Removes a portal from the manager, or from the queue.
+ */
+void UPortalWorldSubsystem::UnregisterPortal(APortalV3* Portal)
+{
+	PendingPortals.RemoveSwap(Portal, EAllowShrinking::No);
+	if (Manager != nullptr)
+	{
+		Manager->UnregisterPortal(Portal);
+	}
+}
+
+void UPortalWorldSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	// the registration counts are published once per frame, instead of tracking every add and remove
+	SET_DWORD_STAT(STAT_PortalRegisteredPortals, Manager ? Manager->GetNumPortals() : 0);
+	SET_DWORD_STAT(STAT_PortalRegisteredAgents, Manager ? Manager->GetNumAgents() : 0);
+	SET_DWORD_STAT(STAT_PortalPendingRegistrations, PendingPortals.Num() + PendingAgents.Num());
+
+	if (Manager != nullptr)
+	{
+		const FPortalRenderTargetPool& RenderTargetPool = Manager->GetRenderTargetPool();
+		SET_DWORD_STAT(STAT_PortalRenderTargetPoolHits, RenderTargetPool.GetNumHits());
+		SET_DWORD_STAT(STAT_PortalRenderTargetPoolMisses, RenderTargetPool.GetNumMisses());
+		SET_FLOAT_STAT(STAT_PortalRenderTargetPoolHitRate, RenderTargetPool.GetHitRate());
+		SET_MEMORY_STAT(STAT_PortalRenderTargetPoolMemory, RenderTargetPool.GetResidentBytes());
+	}
+}
+
+TStatId UPortalWorldSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UPortalWorldSubsystem, STATGROUP_Tickables);
+}
+
+bool UPortalWorldSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+/**
+ * Hands the queued portals and agents to the manager.
+ */
+void UPortalWorldSubsystem::FlushPendingRegistrations()
+{
+	if (Manager == nullptr)
+	{
+		return;
+	}
+
+	for (APortalV3* Portal : PendingPortals)
+	{
+		if (IsValid(Portal))
+		{
+			Manager->RegisterPortal(Portal);
+		}
+	}
+	PendingPortals.Reset();
+
+	for (AActor* Actor : PendingAgents)
+	{
+		if (IsValid(Actor))
+		{
+			Manager->HandleActorSpawned(Actor);
+		}
+	}
+	PendingAgents.Reset();
+}
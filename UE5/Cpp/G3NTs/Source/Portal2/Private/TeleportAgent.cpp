@@ -2,9 +2,19 @@
 
 #include "TeleportAgent.h"
 #include "C:/Users/G3NTs/Documents/Unreal Projects/Portal2/Source/Portal2/TP_WeaponComponent.h"
+#include "Components/StaticMeshComponent.h"
+#include "Components/SkeletalMeshComponent.h"
 #include "Materials/MaterialInterface.h"
+#include "Materials/MaterialInstanceDynamic.h"
 #include "Engine/SkinnedAssetCommon.h"
 #include "Portal3Manager.h"
+#include "PortalWorldSubsystem.h"
+
+static TAutoConsoleVariable<int32> CVarPortalAgentClipPlaneAsPrimitiveData(
+	TEXT("Portal.Agent.ClipPlaneAsPrimitiveData"),
+	0,
+	TEXT("Pass the clip plane of teleport agents as custom primitive data instead of through a dynamic material instance per material slot. Requires the agent materials to read the clip plane from custom primitive data. Read when an agent begins play."),
+	ECVF_Default);
 
 UTeleportAgent::UTeleportAgent()
 {
@@ -12,6 +22,9 @@ UTeleportAgent::UTeleportAgent()
 
 	bIsCloned = false;
 	bDoNotTeleport = false;
+	TeleportStatusMask = 0;
+
+	bClipPlaneAsPrimitiveData = false;
 }
 
 void UTeleportAgent::BeginPlay()
@@ -26,59 +39,75 @@ void UTeleportAgent::BeginPlay()
 		if (UWorld* World = Owner->GetWorld())
 		{
 			/**
-			 * Dynamic material instances are assigned to the teleportable actors in order to get the clip plane working.
-			 * Without the dynamic material instances, the clip plane would not update. 
-			 * Two mesh component types are assigned the correct materials. One is the Skeletal mesh component, the other the static one. 
-			 * The code is made to work with multiple materials per mesh.
-			 */ 
+			 * Two mesh component types are clipped. One is the Skeletal mesh component, the other the static one.
+			 * The materials read the clip plane either from the custom primitive data, or, until every agent material
+			 * is migrated, from the parameters of a dynamic material instance per material slot.
+			 */
 			if (UStaticMeshComponent* MeshComponent = Owner->FindComponentByClass<UStaticMeshComponent>())
 			{
-				int32 MaterialCount = MeshComponent->GetNumMaterials();
-				DynamicMaterialInstances.SetNum(MaterialCount);
-				for (int32 i = 0; i < MaterialCount; ++i)
-				{
-					UMaterialInterface* Material = MeshComponent->GetMaterial(i);
-					if (Material)
-					{
-						DynamicMaterialInstances[i] = UMaterialInstanceDynamic::Create(Material, this);
-						MeshComponent->SetMaterial(i, DynamicMaterialInstances[i]);
-					}
-				}
+				ClipMeshComponents.Add(MeshComponent);
 			}
 			TArray<USkeletalMeshComponent*> SkeletalMeshComponents;
 			Owner->GetComponents<USkeletalMeshComponent>(SkeletalMeshComponents);
-			for (USkeletalMeshComponent* SkeletalComponent : SkeletalMeshComponents)
+			ClipMeshComponents.Append(SkeletalMeshComponents);
+
+			bClipPlaneAsPrimitiveData = CVarPortalAgentClipPlaneAsPrimitiveData.GetValueOnGameThread() != 0;
+			if (bClipPlaneAsPrimitiveData)
+			{
+				// every clipped mesh starts with the full custom primitive data layout, with the clip plane disabled
+				for (UMeshComponent* ClipMeshComponent : ClipMeshComponents)
+				{
+					FPortalMaterialParameterCache& Parameters = ClipPlaneParameters.AddDefaulted_GetRef();
+					Parameters.InitPrimitiveData(ClipMeshComponent);
+					Parameters.SetPrimitiveDataVector(ClipPlanePositionDataIndex, FLinearColor(0.f, 0.f, 0.f, 0.f));
+					Parameters.SetPrimitiveDataVector(ClipPlaneNormalDataIndex, FLinearColor(0.f, 0.f, 0.f, 0.f));
+					Parameters.SetPrimitiveDataFloat(ClipPlaneEnabledDataIndex, 0.0f);
+				}
+			}
+			else
 			{
-				for (int32 i = 0; i < SkeletalComponent->GetNumMaterials(); ++i)
+				// the code is made to work with multiple materials per mesh
+				for (UMeshComponent* ClipMeshComponent : ClipMeshComponents)
 				{
-					MaterialInterface = SkeletalComponent->GetMaterial(i);
-					if (MaterialInterface)
+					for (int32 i = 0; i < ClipMeshComponent->GetNumMaterials(); ++i)
 					{
-						UMaterialInstanceDynamic* DynamicMaterialInstance = UMaterialInstanceDynamic::Create(MaterialInterface, this);
-						SkeletalComponent->SetMaterial(i, DynamicMaterialInstance);
-						DynamicMaterialInstances.Add(DynamicMaterialInstance);
+						UMaterialInterface* Material = ClipMeshComponent->GetMaterial(i);
+						if (Material)
+						{
+							UMaterialInstanceDynamic* DynamicMaterialInstance = UMaterialInstanceDynamic::Create(Material, this);
+							ClipMeshComponent->SetMaterial(i, DynamicMaterialInstance);
+							DynamicMaterialInstances.Add(DynamicMaterialInstance);
+							ClipPlaneParameters.AddDefaulted_GetRef().Init(DynamicMaterialInstance);
+						}
 					}
 				}
 			}
 
+			/**
+			 * Attachments made before play are picked up here, from whichever side begins play last.
+			 * Attachments made during play are reported through NotifyActorAttached.
+			 */
+			TArray<AActor*> AttachedActors;
+			Owner->GetAttachedActors(AttachedActors);
+			for (AActor* AttachedActor : AttachedActors)
+			{
+				AddAttachedActor(AttachedActor);
+			}
+			NotifyActorAttached(Owner, FindAttachParentActor(Owner));
+
 			/**
 			 * This bit of the code manages initializing the variables of the teleport agent. 
 			 * It prevents cloned teleport actors to be cloned again.
 			 */
-			for (TActorIterator<APortal3Manager> It(World); It; ++It)
+			if (UPortalWorldSubsystem* PortalSubsystem = World->GetSubsystem<UPortalWorldSubsystem>())
 			{
-				APortal3Manager* Manager = *It;
-				if (Manager)
+				bIsCloned = PortalSubsystem->GetCloneStatus();
+				if (bIsCloned || bDoNotTeleport)
 				{
-					bIsCloned = Manager->GetCloneStatus();
-					if (bIsCloned || bDoNotTeleport)
-					{
-						return;
-					}
-					UE_LOG(LogTemp, Warning, TEXT("Added Actor"));
-					Manager->HandleActorSpawned(Owner);
 					return;
 				}
+				UE_LOG(LogTemp, Warning, TEXT("Added Actor"));
+				PortalSubsystem->RegisterAgent(Owner);
 			}
 		}
 	}
@@ -88,6 +117,12 @@ void UTeleportAgent::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	Super::EndPlay(EndPlayReason);
 
+	if (AActor* Owner = GetOwner())
+	{
+		NotifyActorDetached(Owner, FindAttachParentActor(Owner));
+	}
+	Attachments.Reset();
+
 	if (bIsCloned)
 	{
 		return;
@@ -97,19 +132,14 @@ void UTeleportAgent::EndPlay(const EEndPlayReason::Type EndPlayReason)
 	{
 		if (UWorld* World = Owner->GetWorld())
 		{
-			for (TActorIterator<APortal3Manager> It(World); It; ++It)
+			if (UPortalWorldSubsystem* PortalSubsystem = World->GetSubsystem<UPortalWorldSubsystem>())
 			{
-				APortal3Manager* Manager = *It;
-				if (Manager)
+				if (bDoNotTeleport)
 				{
-					if (bIsCloned || bDoNotTeleport)
-					{
-						return;
-					}
-					UE_LOG(LogTemp, Warning, TEXT("Removed Actor"));
-					Manager->HandleActorDestroyed(Owner);
 					return;
 				}
+				UE_LOG(LogTemp, Warning, TEXT("Removed Actor"));
+				PortalSubsystem->UnregisterAgent(Owner);
 			}
 		}
 	}
@@ -123,8 +153,11 @@ void UTeleportAgent::EndPlay(const EEndPlayReason::Type EndPlayReason)
  */
 void UTeleportAgent::SetTeleportStatus(AActor* Actor, bool bCanTeleport)
 {
-	bool& ExistingStatus = TeleportStatus.FindOrAdd(Actor, bCanTeleport);
-	ExistingStatus = bCanTeleport;
+	APortalV3* Portal = Cast<APortalV3>(Actor);
+	if (Portal && Portal->PortalSlot != INDEX_NONE)
+	{
+		SetTeleportStatusSlot(Portal->PortalSlot, bCanTeleport);
+	}
 }
 
 /**
@@ -135,62 +168,174 @@ void UTeleportAgent::SetTeleportStatus(AActor* Actor, bool bCanTeleport)
  */
 void UTeleportAgent::SetClipPlane(FVector InLocation, FVector InForwardVector)
 {
-	for (UMaterialInstanceDynamic* DynamicMaterialInstance : DynamicMaterialInstances)
+	WriteClipPlane(InLocation - InForwardVector, -InForwardVector, true);
+
+	// Apply the same clip plane settings to the attached agents
+	for (const FTeleportAgentAttachment& Attachment : Attachments)
 	{
-		DynamicMaterialInstance->SetVectorParameterValue(TEXT("Position"), InLocation - InForwardVector);
-		DynamicMaterialInstance->SetVectorParameterValue(TEXT("Normal"), -InForwardVector);
-		DynamicMaterialInstance->SetScalarParameterValue(TEXT("bClipPlaneEnabled"), 1.0f);
+		UTeleportAgent* AttachedTeleportAgent = Attachment.Agent.Get();
+		if (AttachedTeleportAgent && AttachedTeleportAgent != this)
+		{
+			AttachedTeleportAgent->WriteClipPlane(InLocation - InForwardVector, -InForwardVector, true);
+		}
 	}
+}
 
-	AActor* Owner = GetOwner();
-	if (!Owner) return;
-
-	TArray<AActor*> AttachedActors;
-	Owner->GetAttachedActors(AttachedActors);
+/**
+ * Disables the clipping plane
+ */
+void UTeleportAgent::DisableClipPlane()
+{
+	WriteClipPlane(FVector::ZeroVector, FVector::ZeroVector, false);
 
-	for (AActor* AttachedActor : AttachedActors)
+	// Apply the same clip plane settings to the attached agents
+	for (const FTeleportAgentAttachment& Attachment : Attachments)
 	{
-		// Check if the attached actor has a TeleportAgentComponent
-		UTeleportAgent* AttachedTeleportAgent = AttachedActor->FindComponentByClass<UTeleportAgent>();
+		UTeleportAgent* AttachedTeleportAgent = Attachment.Agent.Get();
 		if (AttachedTeleportAgent && AttachedTeleportAgent != this)
 		{
-			// Apply the same clip plane settings to the attached component
-			for (UMaterialInstanceDynamic* DynamicMaterialInstance : AttachedTeleportAgent->DynamicMaterialInstances)
-			{
-				DynamicMaterialInstance->SetVectorParameterValue(TEXT("Position"), InLocation - InForwardVector);
-				DynamicMaterialInstance->SetVectorParameterValue(TEXT("Normal"), -InForwardVector);
-				DynamicMaterialInstance->SetScalarParameterValue(TEXT("bClipPlaneEnabled"), 1.0f);
-			}
+			AttachedTeleportAgent->WriteClipPlane(FVector::ZeroVector, FVector::ZeroVector, false);
 		}
 	}
 }
 
 /**
- * Disables the clipping plane
+ * Adds an actor to the cached attachments of this agent. Does nothing if it is already in there.
+ *
+ * @param Actor The actor attached to the owner of this agent
  */
-void UTeleportAgent::DisableClipPlane()
+void UTeleportAgent::AddAttachedActor(AActor* Actor)
+{
+	if (Actor == nullptr || Actor == GetOwner() || Attachments.ContainsByPredicate([Actor](const FTeleportAgentAttachment& Attachment) { return Attachment.Actor == Actor; }))
+	{
+		return;
+	}
+
+	FTeleportAgentAttachment& Attachment = Attachments.AddDefaulted_GetRef();
+	Attachment.Actor = Actor;
+	Attachment.Agent = Actor->FindComponentByClass<UTeleportAgent>();
+	Attachment.Weapon = Actor->FindComponentByClass<UTP_WeaponComponent>();
+}
+
+/**
+ * Removes an actor from the cached attachments of this agent.
+ *
+ * @param Actor The actor detached from the owner of this agent
+ */
+void UTeleportAgent::RemoveAttachedActor(AActor* Actor)
 {
-	for (UMaterialInstanceDynamic* DynamicMaterialInstance : DynamicMaterialInstances)
+	// destroyed attachments are dropped along the way
+	Attachments.RemoveAll([Actor](const FTeleportAgentAttachment& Attachment) { return Attachment.Actor == Actor || !Attachment.Actor.IsValid(); });
+}
+
+/**
+ * Returns the weapon component of the first attached weapon, nullptr if no weapon is attached
+ */
+UTP_WeaponComponent* UTeleportAgent::GetAttachedWeapon() const
+{
+	for (const FTeleportAgentAttachment& Attachment : Attachments)
 	{
-		DynamicMaterialInstance->SetScalarParameterValue(TEXT("bClipPlaneEnabled"), 0.0f);
+		if (UTP_WeaponComponent* Weapon = Attachment.Weapon.Get())
+		{
+			return Weapon;
+		}
 	}
-	AActor* Owner = GetOwner();
-	if (!Owner) return;
+	return nullptr;
+}
 
-	TArray<AActor*> AttachedActors;
-	Owner->GetAttachedActors(AttachedActors);
+/**
+ * Notifies the teleport agent of the parent actor that an actor was attached to it.
+ * Has to be called by code that attaches actors at runtime, such as UTP_WeaponComponent::AttachWeapon.
+ *
+ * @param Actor The actor that was just attached
+ * @param Parent The actor it was attached to
+ */
+void UTeleportAgent::NotifyActorAttached(AActor* Actor, AActor* Parent)
+{
+	if (Actor == nullptr || Parent == nullptr)
+	{
+		return;
+	}
+	if (UTeleportAgent* ParentAgent = Parent->FindComponentByClass<UTeleportAgent>())
+	{
+		ParentAgent->AddAttachedActor(Actor);
+	}
+}
 
-	for (AActor* AttachedActor : AttachedActors)
+/**
+ * Finds the actor another actor is attached to. Unlike AActor::GetAttachParentActor this also finds attachments
+ * of components other than the root, such as a weapon that only attaches its mesh to the hand of a character.
+ *
+ * @param Actor The actor to find the parent of
+ * @return The parent actor, nullptr if no component of the actor is attached to another actor
+ */
+AActor* UTeleportAgent::FindAttachParentActor(const AActor* Actor)
+{
+	if (Actor == nullptr)
 	{
-		// Check if the attached actor has a TeleportAgentComponent
-		UTeleportAgent* AttachedTeleportAgent = AttachedActor->FindComponentByClass<UTeleportAgent>();
-		if (AttachedTeleportAgent && AttachedTeleportAgent != this)
+		return nullptr;
+	}
+
+	TInlineComponentArray<USceneComponent*> SceneComponents(Actor);
+	for (const USceneComponent* SceneComponent : SceneComponents)
+	{
+		const USceneComponent* AttachParent = SceneComponent->GetAttachParent();
+		if (AttachParent != nullptr && AttachParent->GetOwner() != Actor)
+		{
+			return AttachParent->GetOwner();
+		}
+	}
+	return nullptr;
+}
+
+/**
+ * Notifies the teleport agent of the former parent actor that an actor was detached from it.
+ *
+ * @param Actor The actor that was detached
+ * @param Parent The actor it was attached to
+ */
+void UTeleportAgent::NotifyActorDetached(AActor* Actor, AActor* Parent)
+{
+	if (Actor == nullptr || Parent == nullptr)
+	{
+		return;
+	}
+	if (UTeleportAgent* ParentAgent = Parent->FindComponentByClass<UTeleportAgent>())
+	{
+		ParentAgent->RemoveAttachedActor(Actor);
+	}
+}
+
+/**
+ * Writes the clip plane to the custom primitive data or the material instances of the clipped meshes of this agent only.
+ * A disabled clip plane keeps the last plane, only the enabled flag is written.
+ *
+ * @param Position The location of the clip plane
+ * @param Normal The normal of the clip plane, the side it points to stays visible
+ * @param bEnabled Whether the clip plane is active
+ */
+void UTeleportAgent::WriteClipPlane(const FVector& Position, const FVector& Normal, bool bEnabled)
+{
+	// the parameter caches only forward the values that changed since the last write
+	for (FPortalMaterialParameterCache& Parameters : ClipPlaneParameters)
+	{
+		if (bClipPlaneAsPrimitiveData)
+		{
+			if (bEnabled)
+			{
+				Parameters.SetPrimitiveDataVector(ClipPlanePositionDataIndex, FLinearColor(Position));
+				Parameters.SetPrimitiveDataVector(ClipPlaneNormalDataIndex, FLinearColor(Normal));
+			}
+			Parameters.SetPrimitiveDataFloat(ClipPlaneEnabledDataIndex, bEnabled ? 1.0f : 0.0f);
+		}
+		else
 		{
-			// Apply the same clip plane settings to the attached component
-			for (UMaterialInstanceDynamic* DynamicMaterialInstance : AttachedTeleportAgent->DynamicMaterialInstances)
+			if (bEnabled)
 			{
-				DynamicMaterialInstance->SetScalarParameterValue(TEXT("bClipPlaneEnabled"), 0.0f);
+				Parameters.SetVector(TEXT("Position"), FLinearColor(Position));
+				Parameters.SetVector(TEXT("Normal"), FLinearColor(Normal));
 			}
+			Parameters.SetScalar(TEXT("bClipPlaneEnabled"), bEnabled ? 1.0f : 0.0f);
 		}
 	}
 }
@@ -203,10 +348,10 @@ void UTeleportAgent::DisableClipPlane()
  */
 bool UTeleportAgent::GetTeleportStatus(AActor* Actor)
 {
-	const bool* TeleportStatusPtr = TeleportStatus.Find(Actor);
-	if (TeleportStatusPtr)
+	APortalV3* Portal = Cast<APortalV3>(Actor);
+	if (Portal && Portal->PortalSlot != INDEX_NONE)
 	{
-		return *TeleportStatusPtr;
+		return GetTeleportStatusSlot(Portal->PortalSlot);
 	}
 	return false;
 }
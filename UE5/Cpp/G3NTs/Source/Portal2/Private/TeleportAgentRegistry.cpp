@@ -0,0 +1,159 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TeleportAgentRegistry.h"
+#include "TeleportAgent.h"
+#include "Components/PrimitiveComponent.h"
+
+/**
+ * Adds an actor to the registry. Does nothing if the actor is already registered.
+ *
+ * @param Actor The actor owning the teleport agent component.
+ * @param TeleportAgent The teleport agent component of the actor.
+ * @param Kind The type of the agent.
+ * @return Handle to the registered agent.
+ */
+FTeleportAgentHandle FTeleportAgentRegistry::Add(AActor* Actor, UTeleportAgent* TeleportAgent, ETeleportAgentKind Kind)
+{
+	if (Actor == nullptr || TeleportAgent == nullptr)
+	{
+		return FTeleportAgentHandle();
+	}
+
+	if (const int32* ExistingSlot = ActorToSlot.Find(Actor))
+	{
+		return FTeleportAgentHandle(*ExistingSlot, Slots[*ExistingSlot].Generation);
+	}
+
+	int32 SlotIndex;
+	if (FreeSlots.Num() > 0)
+	{
+		SlotIndex = FreeSlots.Pop(EAllowShrinking::No);
+	}
+	else
+	{
+		SlotIndex = Slots.AddDefaulted();
+	}
+
+	const int32 DenseIndex = Actors.Add(Actor);
+	Agents.Add(TeleportAgent);
+	RootPrimitives.Add(Cast<UPrimitiveComponent>(Actor->GetRootComponent()));
+	Kinds.Add(Kind);
+	PreviousLocations.Add(Actor->GetActorLocation());
+	DenseToSlot.Add(SlotIndex);
+
+	Slots[SlotIndex].DenseIndex = DenseIndex;
+	ActorToSlot.Add(Actor, SlotIndex);
+
+	return FTeleportAgentHandle(SlotIndex, Slots[SlotIndex].Generation);
+}
+
+/**
+ * Removes an agent from the registry by swapping the last agent into its dense index.
+ *
+ * @param Handle Handle to the agent to remove.
+ * @return True if the agent was removed, false if the handle was stale.
+ */
+bool FTeleportAgentRegistry::Remove(FTeleportAgentHandle Handle)
+{
+	const int32 DenseIndex = GetDenseIndex(Handle);
+	if (DenseIndex == INDEX_NONE)
+	{
+		return false;
+	}
+
+	ActorToSlot.Remove(Actors[DenseIndex]);
+
+	/**
+	 * The last agent is moved into the removed dense index, so its slot has to point to the new index.
+	 */
+	const int32 LastIndex = Actors.Num() - 1;
+	if (DenseIndex != LastIndex)
+	{
+		Slots[DenseToSlot[LastIndex]].DenseIndex = DenseIndex;
+	}
+
+	Actors.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	Agents.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	RootPrimitives.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	Kinds.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	PreviousLocations.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+	DenseToSlot.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+
+	// bumping the generation invalidates all outstanding handles to this slot
+	FSlot& Slot = Slots[Handle.Slot];
+	Slot.DenseIndex = INDEX_NONE;
+	++Slot.Generation;
+	FreeSlots.Add(Handle.Slot);
+
+	return true;
+}
+
+/**
+ * Removes the agent owned by the given actor from the registry.
+ *
+ * @param Actor The actor to remove.
+ * @return True if the actor was registered and is now removed.
+ */
+bool FTeleportAgentRegistry::Remove(AActor* Actor)
+{
+	return Remove(FindHandle(Actor));
+}
+
+/**
+ * Finds the handle of a registered actor.
+ *
+ * @param Actor The actor to look for.
+ * @return Handle to the agent, invalid if the actor is not registered.
+ */
+FTeleportAgentHandle FTeleportAgentRegistry::FindHandle(AActor* Actor) const
+{
+	const int32* SlotIndex = ActorToSlot.Find(Actor);
+	if (SlotIndex == nullptr)
+	{
+		return FTeleportAgentHandle();
+	}
+	return FTeleportAgentHandle(*SlotIndex, Slots[*SlotIndex].Generation);
+}
+
+/**
+ * Resolves a handle to the current dense index of the agent.
+ *
+ * @param Handle The handle to resolve.
+ * @return The dense index, or INDEX_NONE if the handle is stale.
+ */
+int32 FTeleportAgentRegistry::GetDenseIndex(FTeleportAgentHandle Handle) const
+{
+	if (!Slots.IsValidIndex(Handle.Slot) || Slots[Handle.Slot].Generation != Handle.Generation)
+	{
+		return INDEX_NONE;
+	}
+	return Slots[Handle.Slot].DenseIndex;
+}
+
+/**
+ * Removes all agents from the registry.
+ */
+void FTeleportAgentRegistry::Reset()
+{
+	/**
+	 * The slots are kept, with a bumped generation, so handles from before the reset stay invalid.
+	 */
+	for (int32 SlotIndex = 0; SlotIndex < Slots.Num(); ++SlotIndex)
+	{
+		if (Slots[SlotIndex].DenseIndex != INDEX_NONE)
+		{
+			Slots[SlotIndex].DenseIndex = INDEX_NONE;
+			++Slots[SlotIndex].Generation;
+			FreeSlots.Add(SlotIndex);
+		}
+	}
+
+	Actors.Reset();
+	Agents.Reset();
+	RootPrimitives.Reset();
+	Kinds.Reset();
+	PreviousLocations.Reset();
+	DenseToSlot.Reset();
+	ActorToSlot.Reset();
+}
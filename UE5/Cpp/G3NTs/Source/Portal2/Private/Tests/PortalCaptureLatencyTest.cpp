@@ -0,0 +1,88 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+#include "PortalCaptureLatency.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace PortalCaptureLatencyTest
+{
+	/** Pose of a camera turning 2 degrees and moving 10 units every frame */
+	static FTransform GetTurningPose(int32 Frame)
+	{
+		return FTransform(FRotator(0.0, Frame * 2.0, 0.0), FVector(Frame * 10.0, 0.0, 0.0));
+	}
+
+	/**
+	 * Runs the frame loop of the portal manager for a turning camera and returns the measured latency of the last frame.
+	 *
+	 * @param CaptureDelay Frames the capture pose lags behind the presented pose, 0 for late latched captures.
+	 * @param OutPoseErrorDegrees The measured rotation error of the last frame.
+	 */
+	static int32 MeasureLatency(int32 CaptureDelay, float& OutPoseErrorDegrees)
+	{
+		FPortalCaptureLatencyTracker Tracker;
+		for (int32 Frame = 0; Frame < 8; ++Frame)
+		{
+			// the capture stage runs during the tick, the presented view is recorded right before it is rendered
+			Tracker.RecordCapturePose(GetTurningPose(FMath::Max(Frame - CaptureDelay, 0)));
+			Tracker.RecordPresentedPose(GetTurningPose(Frame));
+		}
+		OutPoseErrorDegrees = Tracker.GetPoseErrorDegrees();
+		return Tracker.GetLatencyFrames();
+	}
+}
+
+/**
+ * A capture rendered from the camera pose of the tick lags a frame behind the presented view, a late latched capture
+ * uses the presented pose and is in sync.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalCaptureLatencyLateLatchTest, "Portal.CaptureLatency.LateLatch", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalCaptureLatencyLateLatchTest::RunTest(const FString& Parameters)
+{
+	using namespace PortalCaptureLatencyTest;
+
+	float TickPoseError = 0.f;
+	const int32 TickLatency = MeasureLatency(1, TickPoseError);
+	TestEqual(TEXT("A capture from the pose of the last tick is a frame late"), TickLatency, 1);
+	TestTrue(TEXT("A capture from the pose of the last tick is a frame of rotation off"), FMath::IsNearlyEqual(TickPoseError, 2.f, 0.01f));
+
+	float LateLatchedPoseError = 0.f;
+	const int32 LateLatchedLatency = MeasureLatency(0, LateLatchedPoseError);
+	TestEqual(TEXT("A late latched capture is in sync"), LateLatchedLatency, 0);
+	TestTrue(TEXT("A late latched capture has no rotation error"), FMath::IsNearlyZero(LateLatchedPoseError, 0.01f));
+
+	AddInfo(FString::Printf(TEXT("Capture latency: %d frames from the tick pose, %d frames late latched"), TickLatency, LateLatchedLatency));
+
+	float SaturatedPoseError = 0.f;
+	TestEqual(TEXT("A capture older than the pose history saturates"),
+		MeasureLatency(FPortalCaptureLatencyTracker::PresentedPoseHistory + 2, SaturatedPoseError), FPortalCaptureLatencyTracker::PresentedPoseHistory);
+	return true;
+}
+
+/**
+ * A camera standing still matches every pose, and a frame without captures has nothing to compare, neither is measured.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalCaptureLatencyNoMeasurementTest, "Portal.CaptureLatency.NoMeasurement", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalCaptureLatencyNoMeasurementTest::RunTest(const FString& Parameters)
+{
+	using namespace PortalCaptureLatencyTest;
+
+	FPortalCaptureLatencyTracker Tracker;
+	Tracker.RecordCapturePose(GetTurningPose(0));
+	TestFalse(TEXT("The first presented pose has no previous pose to detect movement"), Tracker.RecordPresentedPose(GetTurningPose(0)));
+
+	Tracker.RecordCapturePose(GetTurningPose(0));
+	TestFalse(TEXT("A camera standing still is not measured"), Tracker.RecordPresentedPose(GetTurningPose(0)));
+
+	TestFalse(TEXT("A frame without captures is not measured"), Tracker.RecordPresentedPose(GetTurningPose(1)));
+
+	Tracker.RecordCapturePose(GetTurningPose(1));
+	TestTrue(TEXT("A moving camera with a capture is measured"), Tracker.RecordPresentedPose(GetTurningPose(2)));
+	TestEqual(TEXT("The capture pose is a frame old"), Tracker.GetLatencyFrames(), 1);
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
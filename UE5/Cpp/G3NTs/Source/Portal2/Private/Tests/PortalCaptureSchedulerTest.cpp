@@ -0,0 +1,132 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+#include "PortalCaptureScheduler.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace PortalCaptureSchedulerTest
+{
+	static FPortalCaptureCandidate MakeCandidate(int32 PortalIndex, float ScreenCoverage, float TimeSinceCapture, bool bForceCapture = false)
+	{
+		FPortalCaptureCandidate Candidate;
+		Candidate.PortalIndex = PortalIndex;
+		Candidate.ScreenCoverage = ScreenCoverage;
+		Candidate.Distance = 500.f;
+		Candidate.TimeSinceCapture = TimeSinceCapture;
+		Candidate.bForceCapture = bForceCapture;
+		return Candidate;
+	}
+}
+
+/**
+ * The largest portals fill the budget but one slot, the remaining slot rotates over the other portals in portal index order.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalCaptureSchedulerRoundRobinTest, "Portal.CaptureScheduler.PriorityAndRoundRobin", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalCaptureSchedulerRoundRobinTest::RunTest(const FString& Parameters)
+{
+	using namespace PortalCaptureSchedulerTest;
+
+	FPortalCaptureScheduler Scheduler;
+	Scheduler.Settings.MaxCapturesPerFrame = 3;
+	Scheduler.Settings.BudgetMilliseconds = 0.f;
+
+	const TArray<FPortalCaptureCandidate> Candidates = {
+		MakeCandidate(0, 0.5f, 0.2f),
+		MakeCandidate(1, 0.3f, 0.2f),
+		MakeCandidate(2, 0.1f, 0.2f),
+		MakeCandidate(3, 0.05f, 0.2f),
+		MakeCandidate(4, 0.04f, 0.2f) };
+
+	TArray<int32> Captures;
+	Scheduler.Schedule(Candidates, Captures);
+	TestTrue(TEXT("First frame captures the two largest portals and the first round robin portal"), Captures == TArray<int32>({ 0, 1, 2 }));
+
+	const TArray<FPortalCaptureDecision>& Decisions = Scheduler.GetLastDecisions();
+	TestEqual(TEXT("One decision per candidate"), Decisions.Num(), Candidates.Num());
+	TestTrue(TEXT("Portal 0 is captured for its priority"), Decisions[0].Reason == EPortalCaptureReason::Priority);
+	TestTrue(TEXT("Portal 1 is captured for its priority"), Decisions[1].Reason == EPortalCaptureReason::Priority);
+	TestTrue(TEXT("Portal 2 gets the round robin slot"), Decisions[2].Reason == EPortalCaptureReason::RoundRobin);
+	TestTrue(TEXT("Portal 3 is over budget"), Decisions[3].Reason == EPortalCaptureReason::OverBudget);
+	TestTrue(TEXT("Portal 4 is over budget"), Decisions[4].Reason == EPortalCaptureReason::OverBudget);
+	TestTrue(TEXT("A larger portal has a higher priority"), Decisions[0].Priority > Decisions[1].Priority);
+
+	Scheduler.Schedule(Candidates, Captures);
+	TestTrue(TEXT("Second frame moves the round robin slot to portal 3"), Captures == TArray<int32>({ 0, 1, 3 }));
+
+	Scheduler.Schedule(Candidates, Captures);
+	TestTrue(TEXT("Third frame moves the round robin slot to portal 4"), Captures == TArray<int32>({ 0, 1, 4 }));
+
+	Scheduler.Schedule(Candidates, Captures);
+	TestTrue(TEXT("Fourth frame wraps the round robin around to portal 2"), Captures == TArray<int32>({ 0, 1, 2 }));
+	return true;
+}
+
+/**
+ * Forced captures are always made and do not use the budget, small portals captured a moment ago are rate limited.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalCaptureSchedulerForcedTest, "Portal.CaptureScheduler.ForcedAndRateLimited", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalCaptureSchedulerForcedTest::RunTest(const FString& Parameters)
+{
+	using namespace PortalCaptureSchedulerTest;
+
+	FPortalCaptureScheduler Scheduler;
+	Scheduler.Settings.MaxCapturesPerFrame = 1;
+	Scheduler.Settings.BudgetMilliseconds = 0.f;
+
+	const TArray<FPortalCaptureCandidate> Candidates = {
+		MakeCandidate(0, 0.01f, 0.f, true),
+		MakeCandidate(1, 0.01f, 0.05f),
+		MakeCandidate(2, 0.3f, 0.2f),
+		MakeCandidate(3, 0.2f, 0.2f) };
+
+	TArray<int32> Captures;
+	Scheduler.Schedule(Candidates, Captures);
+	TestTrue(TEXT("The forced portal and the largest portal are captured"), Captures == TArray<int32>({ 0, 2 }));
+
+	const TArray<FPortalCaptureDecision>& Decisions = Scheduler.GetLastDecisions();
+	TestTrue(TEXT("Portal 0 is forced"), Decisions[0].Reason == EPortalCaptureReason::Forced);
+	TestTrue(TEXT("Portal 1 is rate limited"), Decisions[1].Reason == EPortalCaptureReason::RateLimited);
+	TestTrue(TEXT("Portal 2 is captured for its priority"), Decisions[2].Reason == EPortalCaptureReason::Priority);
+	TestTrue(TEXT("Portal 3 is over budget"), Decisions[3].Reason == EPortalCaptureReason::OverBudget);
+
+	Scheduler.Settings.MaxCapturesPerFrame = 0;
+	Scheduler.Schedule(Candidates, Captures);
+	TestTrue(TEXT("Without a budget only the forced portal is captured"), Captures == TArray<int32>({ 0 }));
+	return true;
+}
+
+/**
+ * The millisecond budget is converted into a number of captures with the measured capture cost, and always allows one capture.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalCaptureSchedulerTimeBudgetTest, "Portal.CaptureScheduler.TimeBudget", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalCaptureSchedulerTimeBudgetTest::RunTest(const FString& Parameters)
+{
+	FPortalCaptureScheduler Scheduler;
+	Scheduler.Settings.MaxCapturesPerFrame = 8;
+
+	Scheduler.Settings.BudgetMilliseconds = 0.f;
+	TestEqual(TEXT("Without a time budget the capture count limits"), Scheduler.GetCaptureBudget(), 8);
+
+	Scheduler.Settings.BudgetMilliseconds = 2.f;
+	TestEqual(TEXT("Two captures of the initial 1 ms estimate fit in 2 ms"), Scheduler.GetCaptureBudget(), 2);
+
+	for (int32 Frame = 0; Frame < 100; ++Frame)
+	{
+		Scheduler.ReportCaptureCost(10.0);
+	}
+	TestTrue(TEXT("The estimate follows the measured cost"), FMath::IsNearlyEqual(Scheduler.GetEstimatedCaptureMilliseconds(), 10.f, 0.01f));
+	TestEqual(TEXT("A capture more expensive than the budget still gets one capture"), Scheduler.GetCaptureBudget(), 1);
+
+	for (int32 Frame = 0; Frame < 100; ++Frame)
+	{
+		Scheduler.ReportCaptureCost(0.1);
+	}
+	TestEqual(TEXT("Cheap captures are limited by the capture count"), Scheduler.GetCaptureBudget(), 8);
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,194 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+#include "PortalMath.h"
+#include "Math/PerspectiveMatrix.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/**
+ * Runs the portal frustum culling benchmark on a few thousand primitives. The vectorised culling has to return
+ * the same primitives as the scalar one, the timings are reported as test info.
+ * Headless: UnrealEditor-Cmd Portal2.uproject -nullrhi -unattended -ExecCmds="Automation RunTests Portal.Math.PrimitiveCulling; Quit"
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalMathPrimitiveCullingTest, "Portal.Math.PrimitiveCulling", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalMathPrimitiveCullingTest::RunTest(const FString& Parameters)
+{
+	const int32 NumPrimitives = 4000;
+	const int32 Iterations = 200;
+
+	const FPortalCullingBenchmarkResult Result = FPortalMath::BenchmarkCullSpheres(NumPrimitives, Iterations);
+
+	TestTrue(TEXT("Vectorised culling returns the same primitives as the scalar culling"), Result.bResultsMatch);
+	TestTrue(TEXT("Some primitives are visible through the portal"), Result.NumVisible > 0);
+	TestTrue(TEXT("Most primitives are culled"), Result.NumVisible < NumPrimitives / 2);
+
+	AddInfo(FString::Printf(TEXT("%d primitives x %d iterations: %d visible, scalar %.2f ns/primitive, batch %.2f ns/primitive"),
+		NumPrimitives, Iterations, Result.NumVisible, Result.ScalarNsPerPrimitive, Result.BatchNsPerPrimitive));
+	return true;
+}
+
+namespace PortalMathTest
+{
+	/** Depth of a view space point after the projection, reversed-Z: 1 on the near plane, 0 at infinity */
+	static double GetDepth(const FMatrix& ProjectionMatrix, const FVector& ViewPoint)
+	{
+		const FVector4 ClipPoint = ProjectionMatrix.TransformFVector4(FVector4(ViewPoint, 1.0));
+		return ClipPoint.Z / ClipPoint.W;
+	}
+}
+
+/**
+ * The oblique projection puts its near plane on the clip plane: points on the clip plane get depth 1, points behind it are clipped,
+ * and the far corners of the frustum keep a depth of at least 0, so nothing in front of the plane is lost to the far clipping.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalMathObliqueProjectionTest, "Portal.Math.ObliqueProjection", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalMathObliqueProjectionTest::RunTest(const FString& Parameters)
+{
+	using namespace PortalMathTest;
+
+	// 90 degrees horizontal field of view at 16:9, view space is X right, Y up, Z forward
+	const double HalfFOV = FMath::DegreesToRadians(45.0);
+	const FMatrix ProjectionMatrix = FReversedZPerspectiveMatrix(HalfFOV, 1920.f, 1080.f, 10.f);
+	const double TanHalfX = 1.0 / ProjectionMatrix.M[0][0];
+	const double TanHalfY = 1.0 / ProjectionMatrix.M[1][1];
+
+	// a tilted clip plane 300 units in front of the view, as the exit portal of a capture looking at it from an angle
+	const FVector PlaneNormal = FVector(0.3, -0.2, 1.0).GetSafeNormal();
+	const FVector PlaneBase(40.0, 20.0, 300.0);
+	const FPlane ClipPlane(PlaneBase, PlaneNormal);
+	const FMatrix Oblique = FPortalMath::MakeObliqueProjection(ProjectionMatrix, ClipPlane);
+
+	const FVector Tangent = FVector::CrossProduct(PlaneNormal, FVector(0.0, 1.0, 0.0)).GetSafeNormal();
+	const FVector Bitangent = FVector::CrossProduct(PlaneNormal, Tangent);
+	for (const FVector2D Offset : { FVector2D(0.0, 0.0), FVector2D(100.0, 0.0), FVector2D(-80.0, 50.0), FVector2D(30.0, -90.0) })
+	{
+		const FVector OnPlane = PlaneBase + Tangent * Offset.X + Bitangent * Offset.Y;
+		TestTrue(FString::Printf(TEXT("Depth on the clip plane at %s is 1"), *OnPlane.ToString()), FMath::IsNearlyEqual(GetDepth(Oblique, OnPlane), 1.0, 1e-6));
+		TestTrue(FString::Printf(TEXT("Depth behind the clip plane at %s is clipped"), *OnPlane.ToString()), GetDepth(Oblique, OnPlane - PlaneNormal * 10.0) > 1.0);
+		TestTrue(FString::Printf(TEXT("Depth in front of the clip plane at %s is kept"), *OnPlane.ToString()), GetDepth(Oblique, OnPlane + PlaneNormal * 10.0) < 1.0);
+	}
+
+	for (const FVector2D Corner : { FVector2D(1.0, 1.0), FVector2D(-1.0, 1.0), FVector2D(1.0, -1.0), FVector2D(-1.0, -1.0) })
+	{
+		const FVector FarCorner = FVector(Corner.X * TanHalfX, Corner.Y * TanHalfY, 1.0) * 1e7;
+		TestTrue(FString::Printf(TEXT("Depth of the far corner %s is at least 0"), *Corner.ToString()), GetDepth(Oblique, FarCorner) >= -1e-6);
+	}
+
+	// a view in front of the plane would clip away everything it looks at, the projection is left alone
+	const FMatrix Unchanged = FPortalMath::MakeObliqueProjection(ProjectionMatrix, FPlane(FVector(0.0, 0.0, -50.0), FVector(0.0, 0.0, 1.0)));
+	TestTrue(TEXT("A view in front of the clip plane keeps its projection"), Unchanged.Equals(ProjectionMatrix, 0.0));
+	return true;
+}
+
+/**
+ * A segment only crosses a portal when it passes through the opening from the front to the back,
+ * which is what lets an agent that moved through a portal within one frame be teleported anyway.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalMathSegmentCrossesQuadTest, "Portal.Math.SegmentCrossesQuad", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalMathSegmentCrossesQuadTest::RunTest(const FString& Parameters)
+{
+	// a portal 100 wide and 200 high, facing +Y
+	const FVector Center(500.0, 200.0, 100.0);
+	const FQuat Rotation = FRotator(0.0, 90.0, 0.0).Quaternion();
+	const FVector2D HalfExtents(50.0, 100.0);
+
+	double Fraction = -1.0;
+	TestTrue(TEXT("A segment through the opening from the front crosses"), FPortalMath::SegmentCrossesQuad(Center + FVector(10.0, 30.0, 20.0), Center + FVector(10.0, -10.0, 20.0), Center, Rotation, HalfExtents, Fraction));
+	TestTrue(TEXT("The crossing fraction is where the segment meets the portal plane"), FMath::IsNearlyEqual(Fraction, 0.75, 1e-9));
+
+	TestTrue(TEXT("A segment starting on the portal plane crosses"), FPortalMath::SegmentCrossesQuad(Center, Center - FVector(0.0, 10.0, 0.0), Center, Rotation, HalfExtents, Fraction));
+	TestFalse(TEXT("A segment ending on the portal plane has not crossed yet"), FPortalMath::SegmentCrossesQuad(Center + FVector(0.0, 10.0, 0.0), Center, Center, Rotation, HalfExtents, Fraction));
+
+	TestFalse(TEXT("A segment beside the opening misses"), FPortalMath::SegmentCrossesQuad(Center + FVector(60.0, 10.0, 0.0), Center + FVector(60.0, -10.0, 0.0), Center, Rotation, HalfExtents, Fraction));
+	TestFalse(TEXT("A segment above the opening misses"), FPortalMath::SegmentCrossesQuad(Center + FVector(0.0, 10.0, 110.0), Center + FVector(0.0, -10.0, 110.0), Center, Rotation, HalfExtents, Fraction));
+	TestFalse(TEXT("A segment parallel to the portal in front of it misses"), FPortalMath::SegmentCrossesQuad(Center + FVector(-40.0, 10.0, 0.0), Center + FVector(40.0, 10.0, 0.0), Center, Rotation, HalfExtents, Fraction));
+	TestFalse(TEXT("A segment parallel to the portal on its plane misses"), FPortalMath::SegmentCrossesQuad(Center + FVector(-40.0, 0.0, 0.0), Center + FVector(40.0, 0.0, 0.0), Center, Rotation, HalfExtents, Fraction));
+	TestFalse(TEXT("A segment through the opening from the back misses"), FPortalMath::SegmentCrossesQuad(Center + FVector(10.0, -10.0, 20.0), Center + FVector(10.0, 30.0, 20.0), Center, Rotation, HalfExtents, Fraction));
+	return true;
+}
+
+/**
+ * A portal quad is only culled when all of its corners are outside the same frustum plane.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalMathQuadInFrustumTest, "Portal.Math.QuadInFrustum", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalMathQuadInFrustumTest::RunTest(const FString& Parameters)
+{
+	// a box from -100 to 100 on every axis, with the normals pointing out as in FConvexVolume
+	const TArray<FPlane> FrustumPlanes = {
+		FPlane(FVector(1.0, 0.0, 0.0), 100.0), FPlane(FVector(-1.0, 0.0, 0.0), 100.0),
+		FPlane(FVector(0.0, 1.0, 0.0), 100.0), FPlane(FVector(0.0, -1.0, 0.0), 100.0),
+		FPlane(FVector(0.0, 0.0, 1.0), 100.0), FPlane(FVector(0.0, 0.0, -1.0), 100.0) };
+
+	// a 40 by 40 quad facing +X, around a centre
+	auto MakeQuad = [](const FVector& Center)
+	{
+		return TArray<FVector>({ Center + FVector(0.0, -20.0, -20.0), Center + FVector(0.0, 20.0, -20.0), Center + FVector(0.0, 20.0, 20.0), Center + FVector(0.0, -20.0, 20.0) });
+	};
+
+	TestTrue(TEXT("A quad inside the frustum is visible"), FPortalMath::IsQuadInFrustum(FrustumPlanes, MakeQuad(FVector(0.0, 0.0, 0.0))));
+	TestTrue(TEXT("A quad crossing a side plane is visible"), FPortalMath::IsQuadInFrustum(FrustumPlanes, MakeQuad(FVector(0.0, 110.0, 0.0))));
+	TestTrue(TEXT("A quad touching a side plane is visible"), FPortalMath::IsQuadInFrustum(FrustumPlanes, MakeQuad(FVector(0.0, 120.0, 0.0))));
+	TestFalse(TEXT("A quad beyond a side plane is culled"), FPortalMath::IsQuadInFrustum(FrustumPlanes, MakeQuad(FVector(0.0, 130.0, 0.0))));
+	TestFalse(TEXT("A quad beyond the far plane is culled"), FPortalMath::IsQuadInFrustum(FrustumPlanes, MakeQuad(FVector(150.0, 0.0, 0.0))));
+	TestFalse(TEXT("A quad beyond two planes is culled"), FPortalMath::IsQuadInFrustum(FrustumPlanes, MakeQuad(FVector(0.0, 150.0, -150.0))));
+
+	// a quad passing diagonally outside a corner of the frustum is not outside any single plane, the test is conservative there
+	const TArray<FVector> DiagonalQuad = { FVector(0.0, 90.0, 130.0), FVector(0.0, 130.0, 90.0), FVector(10.0, 130.0, 90.0), FVector(10.0, 90.0, 130.0) };
+	TestTrue(TEXT("A quad diagonally outside a frustum corner is kept"), FPortalMath::IsQuadInFrustum(FrustumPlanes, DiagonalQuad));
+	return true;
+}
+
+/**
+ * Cropping a projection to a rectangle of the screen maps the corners of the rectangle onto the corners of the render target,
+ * and leaves the depth alone. The capture rectangle snaps to a grid, and keeps its size while the portal stays inside it.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalMathScreenCropTest, "Portal.Math.ScreenCrop", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalMathScreenCropTest::RunTest(const FString& Parameters)
+{
+	const FBox2D FullScreen(FVector2D(-1.0), FVector2D(1.0));
+	TestTrue(TEXT("Cropping to the whole screen is the identity"), FPortalMath::MakeScreenCropMatrix(FullScreen).Equals(FMatrix::Identity, 1e-12));
+	TestTrue(TEXT("Cropping to an invalid rectangle is the identity"), FPortalMath::MakeScreenCropMatrix(FBox2D(ForceInit)).Equals(FMatrix::Identity, 0.0));
+
+	// view space is X right, Y up, Z forward
+	const FMatrix ProjectionMatrix = FReversedZPerspectiveMatrix(FMath::DegreesToRadians(45.0), 1920.f, 1080.f, 10.f);
+	const double TanHalfX = 1.0 / ProjectionMatrix.M[0][0];
+	const double TanHalfY = 1.0 / ProjectionMatrix.M[1][1];
+
+	const FBox2D ScreenRect(FVector2D(-0.5, -0.2), FVector2D(0.3, 0.6));
+	const FMatrix CroppedProjection = ProjectionMatrix * FPortalMath::MakeScreenCropMatrix(ScreenRect);
+	for (const FVector2D Corner : { FVector2D(-1.0, -1.0), FVector2D(1.0, -1.0), FVector2D(1.0, 1.0), FVector2D(-1.0, 1.0) })
+	{
+		// the view point that projects onto this corner of the rectangle
+		const double Depth = 250.0;
+		const FVector2D Ndc(Corner.X < 0.0 ? ScreenRect.Min.X : ScreenRect.Max.X, Corner.Y < 0.0 ? ScreenRect.Min.Y : ScreenRect.Max.Y);
+		const FVector4 ViewPoint(Ndc.X * TanHalfX * Depth, Ndc.Y * TanHalfY * Depth, Depth, 1.0);
+
+		const FVector4 Clip = ProjectionMatrix.TransformFVector4(ViewPoint);
+		const FVector4 CroppedClip = CroppedProjection.TransformFVector4(ViewPoint);
+		const FVector2D CroppedNdc(CroppedClip.X / CroppedClip.W, CroppedClip.Y / CroppedClip.W);
+		TestTrue(FString::Printf(TEXT("The rectangle corner %s maps to the render target corner"), *Ndc.ToString()), CroppedNdc.Equals(Corner, 1e-9));
+		TestTrue(FString::Printf(TEXT("The depth at %s is unchanged"), *Ndc.ToString()), FMath::IsNearlyEqual(CroppedClip.Z / CroppedClip.W, Clip.Z / Clip.W, 1e-12));
+	}
+
+	// 8 grid cells across the screen, a quarter of the NDC range each
+	const int32 GridSteps = 8;
+	TestTrue(TEXT("An invalid screen rectangle captures the whole screen"), FPortalMath::SelectCaptureRect(FBox2D(ForceInit), FullScreen, GridSteps) == FullScreen);
+
+	const FBox2D Snapped = FPortalMath::SelectCaptureRect(FBox2D(FVector2D(-0.3, -0.3), FVector2D(0.2, 0.1)), FullScreen, GridSteps);
+	TestTrue(TEXT("The rectangle snaps outwards to the grid"), Snapped.Min.Equals(FVector2D(-0.5, -0.5), 1e-12) && Snapped.Max.Equals(FVector2D(0.25, 0.25), 1e-12));
+
+	const FBox2D Kept = FPortalMath::SelectCaptureRect(FBox2D(FVector2D(-0.2, -0.45), FVector2D(0.2, 0.2)), Snapped, GridSteps);
+	TestTrue(TEXT("A slightly smaller rectangle inside the current one keeps it"), Kept == Snapped);
+
+	const FBox2D Shrunk = FPortalMath::SelectCaptureRect(FBox2D(FVector2D(-0.2, -0.2), FVector2D(0.1, 0.1)), Snapped, GridSteps);
+	TestTrue(TEXT("A rectangle less than half the current one replaces it"), Shrunk.Min.Equals(FVector2D(-0.25, -0.25), 1e-12) && Shrunk.Max.Equals(FVector2D(0.25, 0.25), 1e-12));
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
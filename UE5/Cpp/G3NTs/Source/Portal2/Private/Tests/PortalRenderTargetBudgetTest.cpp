@@ -0,0 +1,116 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+#include "PortalRenderTargetBudget.h"
+#include "PortalResolutionTiers.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace PortalRenderTargetBudgetTest
+{
+	static FPortalRenderTargetBudgetEntry MakeEntry(int32 PortalIndex, float Importance, int32 Tier, bool bLocked, bool bReleasable)
+	{
+		FPortalRenderTargetBudgetEntry Entry;
+		Entry.PortalIndex = PortalIndex;
+		Entry.Importance = Importance;
+		Entry.AspectRatio = 0.5;
+		Entry.Tier = Tier;
+		Entry.bLocked = bLocked;
+		Entry.bReleasable = bReleasable;
+		return Entry;
+	}
+}
+
+/**
+ * Under budget, or without a budget, Enforce only fills in the memory of the entries.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalRenderTargetBudgetUnderBudgetTest, "Portal.RenderTargetBudget.UnderBudget", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalRenderTargetBudgetUnderBudgetTest::RunTest(const FString& Parameters)
+{
+	using namespace PortalRenderTargetBudgetTest;
+
+	FPortalRenderTargetBudget Budget;
+	const int64 TierZeroBytes = Budget.GetPortalBytes(0, 0.5);
+	TestEqual(TEXT("Two RGBA8 targets at tier 0"), TierZeroBytes, (int64)2 * 1524 * 762 * 4);
+
+	TArray<FPortalRenderTargetBudgetEntry> Entries = { MakeEntry(0, 0.5f, 0, false, false), MakeEntry(1, 0.f, 0, true, true) };
+
+	Budget.BudgetBytes = 0;
+	TestEqual(TEXT("Without a budget the total is the sum of the entries"), Budget.Enforce(Entries), 2 * TierZeroBytes);
+
+	Budget.BudgetBytes = 2 * TierZeroBytes;
+	TestEqual(TEXT("Exactly at budget the total is the sum of the entries"), Budget.Enforce(Entries), 2 * TierZeroBytes);
+	TestEqual(TEXT("No tier is stepped down"), Budget.GetNumStepsDown(), 0);
+	TestEqual(TEXT("No entry is released"), Budget.GetNumReleased(), 0);
+	TestEqual(TEXT("The visible portal keeps its tier"), Entries[0].Tier, 0);
+	TestFalse(TEXT("The off screen portal keeps its targets"), Entries[1].bReleased);
+	return true;
+}
+
+/**
+ * Over budget, the portals that are not on screen give up their targets before any visible portal is stepped down.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalRenderTargetBudgetReleaseTest, "Portal.RenderTargetBudget.ReleaseOffScreen", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalRenderTargetBudgetReleaseTest::RunTest(const FString& Parameters)
+{
+	using namespace PortalRenderTargetBudgetTest;
+
+	FPortalRenderTargetBudget Budget;
+	const int32 LowestTier = FPortalResolutionTiers::NumTiers - 1;
+
+	// a visible portal, an off screen portal, and an impostor that is on screen but not captured
+	TArray<FPortalRenderTargetBudgetEntry> Entries = {
+		MakeEntry(0, 0.5f, 0, false, false),
+		MakeEntry(1, 0.f, 0, true, true),
+		MakeEntry(2, 0.f, LowestTier, true, false) };
+	Budget.BudgetBytes = Budget.GetPortalBytes(0, 0.5) + Budget.GetPortalBytes(LowestTier, 0.5);
+
+	TestEqual(TEXT("The total fits the budget"), Budget.Enforce(Entries), Budget.BudgetBytes);
+	TestTrue(TEXT("The off screen portal is released"), Entries[1].bReleased);
+	TestEqual(TEXT("A released entry has no memory"), Entries[1].Bytes, (int64)0);
+	TestEqual(TEXT("One entry is released"), Budget.GetNumReleased(), 1);
+	TestEqual(TEXT("The visible portal keeps its tier"), Entries[0].Tier, 0);
+	TestEqual(TEXT("No tier is stepped down"), Budget.GetNumStepsDown(), 0);
+	TestFalse(TEXT("The impostor keeps its targets"), Entries[2].bReleased);
+	TestEqual(TEXT("The impostor keeps its tier"), Entries[2].Tier, LowestTier);
+	return true;
+}
+
+/**
+ * Over budget without off screen portals, the least important visible portal is stepped down first, one tier at a time.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalRenderTargetBudgetStepDownTest, "Portal.RenderTargetBudget.StepDown", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalRenderTargetBudgetStepDownTest::RunTest(const FString& Parameters)
+{
+	using namespace PortalRenderTargetBudgetTest;
+
+	FPortalRenderTargetBudget Budget;
+	const int32 LowestTier = FPortalResolutionTiers::NumTiers - 1;
+
+	TArray<FPortalRenderTargetBudgetEntry> Entries = {
+		MakeEntry(0, 0.5f, 0, false, false),
+		MakeEntry(1, 0.1f, 0, false, false),
+		MakeEntry(2, 0.f, 0, true, false) };
+	Budget.BudgetBytes = 2 * Budget.GetPortalBytes(0, 0.5) + Budget.GetPortalBytes(2, 0.5);
+
+	TestEqual(TEXT("The total fits the budget"), Budget.Enforce(Entries), Budget.BudgetBytes);
+	TestEqual(TEXT("The most important portal keeps its tier"), Entries[0].Tier, 0);
+	TestEqual(TEXT("The least important portal is stepped down to the first tier that fits"), Entries[1].Tier, 2);
+	TestEqual(TEXT("Two tier steps are taken"), Budget.GetNumStepsDown(), 2);
+	TestEqual(TEXT("A locked portal is never stepped down"), Entries[2].Tier, 0);
+
+	// a budget below the locked entries alone steps every visible portal down to the lowest tier and stays over budget
+	Budget.BudgetBytes = 1;
+	Entries[0].Tier = 0;
+	Entries[1].Tier = 0;
+	const int64 Total = Budget.Enforce(Entries);
+	TestEqual(TEXT("The most important portal ends at the lowest tier"), Entries[0].Tier, LowestTier);
+	TestEqual(TEXT("The least important portal ends at the lowest tier"), Entries[1].Tier, LowestTier);
+	TestEqual(TEXT("The total is still reported"), Total, Budget.GetPortalBytes(0, 0.5) + 2 * Budget.GetPortalBytes(LowestTier, 0.5));
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,62 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+#include "PortalResolutionTiers.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/**
+ * A portal moves to a higher resolution as soon as its coverage reaches a tier, and to a lower one only when the coverage
+ * is clearly below the tier it uses. The tiers start at 25%, 6% and 1.5% of the screen, and the downgrade factor is 0.75.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalResolutionTiersThresholdsTest, "Portal.ResolutionTiers.Thresholds", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalResolutionTiersThresholdsTest::RunTest(const FString& Parameters)
+{
+	TestEqual(TEXT("Reaching the boundary of a tier moves up at once"), FPortalResolutionTiers::SelectTier(0.015f, 3), 2);
+	TestEqual(TEXT("A large jump in coverage moves up several tiers at once"), FPortalResolutionTiers::SelectTier(0.3f, 3), 0);
+	TestEqual(TEXT("Just below the boundary of a higher tier stays"), FPortalResolutionTiers::SelectTier(0.24f, 1), 1);
+
+	TestEqual(TEXT("Just below the boundary of the current tier stays"), FPortalResolutionTiers::SelectTier(0.2f, 0), 0);
+	TestEqual(TEXT("At the downgrade threshold the tier stays"), FPortalResolutionTiers::SelectTier(0.1875f, 0), 0);
+	TestEqual(TEXT("Clearly below the current tier moves down"), FPortalResolutionTiers::SelectTier(0.18f, 0), 1);
+	TestEqual(TEXT("A large drop in coverage moves down several tiers at once"), FPortalResolutionTiers::SelectTier(0.01f, 0), 3);
+
+	TestEqual(TEXT("A current tier below the range is clamped"), FPortalResolutionTiers::SelectTier(0.3f, -1), 0);
+	TestEqual(TEXT("A current tier above the range is clamped"), FPortalResolutionTiers::SelectTier(0.f, FPortalResolutionTiers::NumTiers), FPortalResolutionTiers::NumTiers - 1);
+	return true;
+}
+
+/**
+ * A portal whose coverage hovers around a tier boundary settles on the higher tier and stays there,
+ * so it does not lease new render targets every frame.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPortalResolutionTiersHysteresisTest, "Portal.ResolutionTiers.Hysteresis", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FPortalResolutionTiersHysteresisTest::RunTest(const FString& Parameters)
+{
+	struct FBoundary
+	{
+		float Coverage;
+		int32 LowerTier;
+	};
+
+	for (const FBoundary Boundary : { FBoundary{ 0.25f, 1 }, FBoundary{ 0.06f, 2 }, FBoundary{ 0.015f, 3 } })
+	{
+		int32 Tier = Boundary.LowerTier;
+		int32 NumChanges = 0;
+		for (int32 Frame = 0; Frame < 20; ++Frame)
+		{
+			// 5% above and below the boundary, well within the downgrade band
+			const float Coverage = Boundary.Coverage * ((Frame % 2 == 0) ? 1.05f : 0.95f);
+			const int32 NewTier = FPortalResolutionTiers::SelectTier(Coverage, Tier);
+			NumChanges += NewTier != Tier ? 1 : 0;
+			Tier = NewTier;
+		}
+		TestEqual(FString::Printf(TEXT("Around the %.3f boundary the tier changes once"), Boundary.Coverage), NumChanges, 1);
+		TestEqual(FString::Printf(TEXT("Around the %.3f boundary the portal keeps the higher tier"), Boundary.Coverage), Tier, Boundary.LowerTier - 1);
+	}
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,30 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+#include "TeleportAgent.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/**
+ * A portal destroyed while an agent is inside it clears the status bit of its slot. Only clearing the last bit of the agent
+ * asks the caller to release the clip plane and collision, because no later frame emits a release for the agent.
+ */
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTeleportAgentClearStatusTest, "Portal.TeleportAgent.ClearStatusOfDestroyedPortal", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FTeleportAgentClearStatusTest::RunTest(const FString& Parameters)
+{
+	UTeleportAgent* TeleportAgent = NewObject<UTeleportAgent>();
+	TeleportAgent->SetTeleportStatusSlot(3, true);
+	TeleportAgent->SetTeleportStatusSlot(5, true);
+
+	TestFalse(TEXT("Destroying a portal the agent is not inside releases nothing"), TeleportAgent->ClearTeleportStatus(uint64(1) << 7));
+	TestFalse(TEXT("The agent is still inside another portal"), TeleportAgent->ClearTeleportStatus(uint64(1) << 3));
+	TestTrue(TEXT("The agent keeps the status of the other portal"), TeleportAgent->GetTeleportStatusSlot(5));
+
+	TestTrue(TEXT("Destroying the last portal the agent is inside releases it"), TeleportAgent->ClearTeleportStatus(uint64(1) << 5));
+	TestFalse(TEXT("The agent is inside no portal"), TeleportAgent->HasAnyTeleportStatus());
+	TestFalse(TEXT("An agent that is inside no portal is not released twice"), TeleportAgent->ClearTeleportStatus(uint64(1) << 5));
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -6,10 +6,20 @@
 #include "GameFramework/Actor.h"
 #include "Kismet/GameplayStatics.h"
 #include "Engine/World.h"
+#include "ConvexVolume.h"
 #include "TeleportAgent.h"
+#include "TeleportAgentRegistry.h"
 #include "EngineUtils.h"
 
 #include "PortalV3.h"
+#include "PortalBroadphase.h"
+#include "PortalAgentCommand.h"
+#include "PortalFramePipeline.h"
+#include "PortalCaptureScheduler.h"
+#include "PortalRenderTargetPool.h"
+#include "PortalRenderTargetBudget.h"
+#include "PortalPrimitiveCache.h"
+#include "PortalCaptureLatency.h"
 #include "DebugDisplay.h"
 
 #include "GameFramework/PlayerController.h"
@@ -24,6 +34,8 @@
 class APortal2Projectile;
 class ABP_PortalV2;
 class UPortalSurface;
+class FPortalViewExtension;
+class FSceneView;
 
 /**
  * Structure used to create a key of a combination between portal and teleportable actor. 
@@ -71,6 +83,35 @@ public:
 	}
 };
 
+/**
+ * A clone of an agent seen through a portal, stored per FAgentPortalKey in the ClonedActors map.
+ * The teleport agent component of the clone is cached when the clone is stored, so it is not searched for every frame.
+ */
+USTRUCT(BlueprintType)
+struct FPortalClone
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY(BlueprintReadOnly)
+	AActor* Actor = nullptr; // Pointer to the cloned actor
+
+	UPROPERTY(BlueprintReadOnly)
+	UTeleportAgent* Agent = nullptr; // Pointer to the teleport agent component of the cloned actor, may be null
+};
+
+/**
+ * The visibility traces of one portal, issued in the capture stage of one frame and read back in the capture stage of the next.
+ */
+struct FPortalVisibilityTraces
+{
+	/** Number of traces per portal, the 4 corners of the portal plane and its centre */
+	static constexpr int32 NumTraces = 5;
+
+	TWeakObjectPtr<APortalV3> Portal;
+	FTraceHandle Handles[NumTraces];
+};
+
 /**
  * Manager class responsible for handling portals and teleportation mechanics in the game.
  */
@@ -93,14 +134,92 @@ private:
 	 */
 
 	UPROPERTY(VisibleAnywhere)
-	TMap<AActor*, AActor*> TeleportAgents;
+	FTeleportAgentRegistry TeleportAgents;
 
 	UPROPERTY(VisibleAnywhere)
-	TMap<FAgentPortalKey, AActor*> ClonedActors;
+	TMap<FAgentPortalKey, FPortalClone> ClonedActors;
 
 	UPROPERTY(VisibleAnywhere)
 	TArray<APortalV3*> PortalList;
 
+	/** Grid over the portal colliders in PortalList, rebuilt whenever the portal list changes */
+	FPortalBroadphase PortalBroadphase;
+
+	/** Bit mask of the portal slots in use. Every live portal occupies one slot, see APortalV3::PortalSlot */
+	uint64 UsedPortalSlots;
+
+	/** Maximum number of live portals, limited by the bits in the teleport status mask of the agents */
+	static constexpr int32 MaxPortalSlots = 64;
+
+	/** Scratch storage for the clone pass, the agents in front of one portal and their transforms before and after conversion */
+	TArray<int32> CloneBatchAgents;
+	FPortalTransformBatch CloneBatchIn;
+	FPortalTransformBatch CloneBatchOut;
+
+	/** Results passed between the stages of the per frame pipeline, see RunPipelineStage */
+	FPortalFramePipeline FramePipeline;
+
+	/** Decides which portals are captured each frame, configured with the Portal.Capture console variables */
+	FPortalCaptureScheduler CaptureScheduler;
+
+	/** Scratch arrays of the capture stage, the visible portals and the ones picked by the scheduler */
+	TArray<FPortalCaptureCandidate> CaptureCandidates;
+	TArray<int32> ScheduledCaptures;
+
+	/** Scratch array of the capture stage, the capture hash of every candidate indexed by its PortalList index */
+	TArray<uint32> CandidateCaptureHashes;
+
+	/** Scratch array of ComputeCaptureHash, the movable primitives seen through the portal that is hashed */
+	TArray<const UPrimitiveComponent*> HashedPrimitives;
+
+	/** Render targets the portals lease for their scene captures, reused when portals are destroyed and shot again */
+	UPROPERTY()
+	FPortalRenderTargetPool RenderTargetPool;
+
+	/** Keeps the render target memory under the Portal.RenderTargets.BudgetMB ceiling, with the entries of the last frame */
+	FPortalRenderTargetBudget RenderTargetBudget;
+	TArray<FPortalRenderTargetBudgetEntry> BudgetEntries;
+
+	/** Primitives of the world the portal captures are culled from, kept up to date from the actor spawn and destroy events, the level streaming events of the world and the primitives registered on cached actors later */
+	FPortalPrimitiveCache PrimitiveCache;
+	FDelegateHandle ActorSpawnedHandle;
+	FDelegateHandle ActorDestroyedHandle;
+	FDelegateHandle LevelAddedHandle;
+	FDelegateHandle LevelRemovedHandle;
+
+	/** Scratch planes of the portal frustum of the current capture */
+	FPortalFrustumPlanes PortalFrustumPlanes;
+
+	/** Number of primitives passed to the scene captures this frame */
+	int32 NumCapturedPrimitives = 0;
+
+	/** Hands the final view of the player to the manager right before it is rendered, see OnBeginRenderView */
+	TSharedPtr<FPortalViewExtension, ESPMode::ThreadSafe> ViewExtension;
+
+	/** Portals scheduled this frame whose capture waits for the final view of the player, see Portal.Capture.LateLatch */
+	TArray<TWeakObjectPtr<APortalV3>> LateLatchedCaptures;
+
+	/** Compares the camera pose the captures were rendered from with the presented camera pose, for the latency stats */
+	FPortalCaptureLatencyTracker CaptureLatency;
+
+	/** Visibility traces issued this frame, their results are read in the next frame, see CheckPlayerPortalLineOfSigth */
+	TArray<FPortalVisibilityTraces> VisibilityTraces;
+
+	/** Distance of the canonical viewpoint in front of a portal for its impostor snapshot, see APortalV3::CaptureImpostor */
+	static constexpr double ImpostorViewDistance = 300.0;
+
+	/** Frames a portal keeps counting as in line of sight after the last trace that reached it, hides single frame occlusions */
+	static constexpr int32 LineOfSightHoldFrames = 3;
+
+	/** Grid cells across the screen the capture rectangles snap to, see FPortalMath::SelectCaptureRect */
+	static constexpr int32 CaptureRectGridSteps = 8;
+
+	/** Minimum distance of a capture behind its exit portal to clip it with an oblique near plane, see EPortalClipMode */
+	static constexpr double ObliqueMinDistance = 10.0;
+
+	/** Number of agents evaluated per task in the teleport check */
+	static constexpr int32 TeleportCheckChunkSize = 64;
+
 	// Class that needs to be set before running the game!
 	UPROPERTY(EditAnywhere)
 	TSubclassOf<AActor> ABP_PortalV2;
@@ -119,6 +238,7 @@ public:
 
 protected:
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	virtual void RegisterActorTickFunctions(bool bRegister) override;
 	virtual void TickActor(float DeltaSeconds, ELevelTick TickType, FActorTickFunction& ThisTickFunction) override;
 
@@ -130,40 +250,127 @@ private:
 	/**
 	 * Updates the capture state of all portals in the PortalList.
 	 *
-	 * This function iterates through each portal in the PortalList and checks if the portal has a linked portal.
-	 * If a linked portal is found, it calculates the necessary transforms and updates the portal's screen capture
-	 * to reflect the current state of the camera relative to the portal and its linked portal.
+	 * Every linked portal that passes CheckPortalNeedsUpdate becomes a capture candidate. The capture scheduler then picks
+	 * the candidates that fit in the per frame budget, and only those get their screen capture updated this frame.
 	 */
 	void UpdatePortals();
 
 	/**
-	 * Checks and manages teleportation for each agent in the TeleportAgents map.
-	 * Iterates through each agent and evaluates its position relative to portals in the PortalList.
-	 * Manages teleportation status, collision settings, and clip plane for each teleport agent.
+	 * Runs a single stage of the per frame pipeline. Stages that run out of order are skipped,
+	 * for example the clone sync stage in a frame where the teleport stages did not run.
+	 *
+	 * @param Stage The stage to run.
+	 */
+	void RunPipelineStage(EPortalPipelineStage Stage);
+
+	/**
+	 * Gather stage. Snapshots the location of every agent and resolves the portal links for the later stages.
+	 */
+	void GatherAgents();
+
+	/**
+	 * Classify stage. The agents are evaluated in parallel against the portals in the PortalList, which only reads state and emits commands.
+	 */
+	void ClassifyAgents();
+
+	/**
+	 * Teleport stage. Applies the commands of the classify stage on the game thread, which manages teleportation status,
+	 * collision settings, and clip plane for each teleport agent. Records the portals every agent needs a clone for.
+	 */
+	void ApplyTeleports();
+
+	/**
+	 * Evaluates a single agent against the portals, without changing any state. Safe to call from worker threads.
+	 *
+	 * @param AgentIndex The dense index of the agent in the TeleportAgents registry.
+	 * @param OutCommands Output array the state changes for the agent are added to, in the order they have to be applied.
+	 */
+	void EvaluateAgent(int32 AgentIndex, FPortalAgentCommandArray& OutCommands) const;
+
+	/**
+	 * Finds the portal an agent moved through since the last frame, using the segment between its previous and current location.
+	 *
+	 * @param PreviousLocation The location of the agent at the end of the previous teleport check.
+	 * @param Location The current location of the agent.
+	 * @return Index in the PortalList of the portal that was crossed first, INDEX_NONE if no portal was crossed.
+	 */
+	int32 FindSweptPortal(const FVector& PreviousLocation, const FVector& Location) const;
+
+	/**
+	 * Executes a command emitted by EvaluateAgent. Game thread only.
+	 *
+	 * @param Command The command to execute.
 	 */
-	void TeleportActorsCheck();
+	void ApplyAgentCommand(const FPortalAgentCommand& Command);
 
 	/**
-	 * Iterates through all teleport agents and checks their teleport status for each portal.
-	 * Clones or updates actors based on teleport status. Removes cloned actors if teleport
-	 * status is false for a portal.
-	 * Could possibly have been combined with Teleport Actors Check function!
+	 * Clone sync stage. Uses the clone masks recorded by the teleport stage, so no teleport status has to be checked again.
+	 * Per portal, the agents in front of it are gathered into a batch and converted through the portal pair in one pass,
+	 * after which the clones are created or updated from the converted transforms. Clones through portals an agent
+	 * is no longer in front of are removed.
 	 */
-	void CloneOrUpdateAllActors();
+	void SyncClones();
 
 public:
 	// Functions for the modifying the Teleportable Actors Map
 
 	/**
-	 * Function that can be called to add a actor with the UTeleportAgent component to the teleportable actors map.
+	 * Function that can be called to add a actor with the UTeleportAgent component to the teleportable actors registry.
 	 */
 	void HandleActorSpawned(AActor* Actor);
 
 	/**
-	 * Function that can be called to remove a actor with the UTeleportAgent component to the teleportable actors map.
+	 * Function that can be called to remove a actor with the UTeleportAgent component from the teleportable actors registry.
 	 */
 	void HandleActorDestroyed(AActor* Actor);
 
+	// Functions for modifying the PortalList
+
+	/**
+	 * Adds a portal to the PortalList, assigns it a portal slot and inserts it into the broadphase.
+	 * Does nothing if the portal is already registered.
+	 *
+	 * @param Portal The portal to register.
+	 */
+	void RegisterPortal(APortalV3* Portal);
+
+	/**
+	 * Removes a portal from the PortalList, releases its portal slot and removes it from the broadphase.
+	 * Called by the manager before destroying a portal, and by the portal itself when it ends play for another reason.
+	 *
+	 * @param Portal The portal to unregister.
+	 */
+	void UnregisterPortal(APortalV3* Portal);
+
+	/**
+	 * Returns the number of registered portals.
+	 */
+	int32 GetNumPortals() const { return PortalList.Num(); }
+
+	/**
+	 * Returns the number of registered teleport agents.
+	 */
+	int32 GetNumAgents() const { return TeleportAgents.Num(); }
+
+	/**
+	 * Returns the pool the portals lease their texture targets from.
+	 */
+	FPortalRenderTargetPool& GetRenderTargetPool() { return RenderTargetPool; }
+
+	/**
+	 * Prints the render target memory of the last frame, in total and per portal, and the memory held by the render target pool.
+	 * Used by the Portal.RenderTargets console command.
+	 */
+	void DumpRenderTargetBudget() const;
+
+	/**
+	 * Called by the view extension on the game thread with the final view of the player, right before it is rendered.
+	 * Runs the captures that were scheduled for late latching with the presented camera pose, and updates the latency stats.
+	 *
+	 * @param View The view of the player that is about to be rendered.
+	 */
+	void OnBeginRenderView(const FSceneView& View);
+
 	// Functions for the modifying the ClonedActorMap
 
 	/**
@@ -174,9 +381,19 @@ public:
 	 * @return The cloned actor corresponding to Agent and Portal, or nullptr if not found.
 	 */
 	AActor* FindClonedActor(AActor* Agent, APortalV3* Portal);
+
+	/**
+	 * Finds the clone corresponding to the given Agent and Portal, together with its cached teleport agent.
+	 *
+	 * @param Agent The original actor that was cloned.
+	 * @param Portal The portal through which the actor was cloned.
+	 * @return The clone corresponding to Agent and Portal, or nullptr if not found.
+	 */
+	const FPortalClone* FindClone(AActor* Agent, APortalV3* Portal) const;
 	
 	/**
 	 * Stores the cloned actor corresponding to the given Agent and Portal in the ClonedActors map.
+	 * The teleport agent component of the clone is looked up once here and cached next to it.
 	 *
 	 * @param Agent The original actor that was cloned.
 	 * @param Portal The portal through which the actor was cloned.
@@ -226,16 +443,87 @@ private:
 	/**
 	 * Updates the screen capture for the specified portal.
 	 *
-	 * This function calculates the new capture location and rotation for the portal based on the provided
-	 * reference, target, and camera transforms. It then retrieves the camera's view projection and projection
-	 * matrices, and uses these values to update the portal's screen capture.
+	 * This function calculates the new capture location and rotation for the portal by converting the camera
+	 * transform through the cached portal pair transform, and uses these together with the camera's view projection
+	 * and projection matrices to update the portal's screen capture.
 	 *
 	 * @param Portal The portal to update.
-	 * @param Reference The reference transform used for coordinate conversion, the main portal.
-	 * @param Target The transform of the linked portal.
 	 * @param Camera The current transform of the camera.
+	 * @param ViewProjectionMatrix The view projection matrix of the camera.
+	 * @param ProjectionMatrix The projection matrix of the camera.
+	 */
+	void UpdatePortalCapture(APortalV3* Portal, const FTransform& Camera, const FMatrix& ViewProjectionMatrix, const FMatrix& ProjectionMatrix);
+
+	/**
+	 * Compares the camera pose the captures of this frame used with the last presented poses, and sets the latency stats.
+	 *
+	 * @param PresentedPose The camera pose of the view that is about to be rendered.
+	 */
+	void UpdateCaptureLatency(const FTransform& PresentedPose);
+
+	/**
+	 * Switches a visible portal between live capture and an impostor snapshot, based on its distance and screen coverage.
+	 * Leaving the impostor needs the portal to be clearly closer or larger than the thresholds, so a portal at the threshold
+	 * does not switch every frame.
+	 *
+	 * @param Portal The visible portal.
+	 * @param Candidate The capture candidate of the portal, forced to capture when the portal leaves the impostor.
+	 * @return True if the portal shows an impostor this frame and is not captured live.
+	 */
+	bool UpdateImpostor(APortalV3* Portal, FPortalCaptureCandidate& Candidate);
+
+	/**
+	 * Hashes everything that decides what a portal capture shows: the capture view converted through the portal pair,
+	 * the projection, and the movable primitives and other portals whose bounds overlap the destination view.
+	 * When the hash equals the one of the last render, the texture still shows the right image and the capture can be skipped.
+	 * Animating primitives change the image without moving, so a view with a skinned mesh or particle system in it is never skipped.
+	 *
+	 * @param Portal The portal to hash.
+	 * @param Camera The current transform of the camera.
+	 * @param ProjectionMatrix The projection matrix of the camera.
+	 * @param CameraFrustum The view frustum of the camera, the destination view is tested by converting objects back through the portal pair.
+	 * @return The capture hash, 0 if an animating primitive is seen through the portal and the capture cannot be skipped.
+	 */
+	uint32 ComputeCaptureHash(APortalV3* Portal, const FTransform& Camera, const FMatrix& ProjectionMatrix, const FConvexVolume& CameraFrustum);
+
+	/**
+	 * Culls the primitive cache against the frustum seen through a portal, and passes the survivors to the scene capture
+	 * of the portal as its show only list. Everything behind the exit portal or outside its opening is never sent to the renderer.
+	 *
+	 * @param Portal The portal that is about to be captured.
+	 * @param CaptureLocation The location of the scene capture at the exit portal.
+	 */
+	void CullCapturePrimitives(APortalV3* Portal, const FVector& CaptureLocation);
+
+	/**
+	 * Bound to the actor spawned event of the world, adds the primitives of the actor to the primitive cache.
+	 */
+	void OnWorldActorSpawned(AActor* Actor);
+
+	/**
+	 * Bound to the actor destroyed event of the world, removes the primitives of the actor from the primitive cache.
+	 */
+	void OnWorldActorDestroyed(AActor* Actor);
+
+	/**
+	 * Bound to the level added event, adds the primitives of a level streamed into the world of the manager to the primitive cache.
+	 * The actors of a streamed level are loaded, not spawned, so the actor spawned event does not see them.
+	 */
+	void OnLevelAddedToWorld(ULevel* Level, UWorld* World);
+
+	/**
+	 * Bound to the level removed event, removes the primitives of a level streamed out of the world of the manager from the primitive cache.
+	 */
+	void OnLevelRemovedFromWorld(ULevel* Level, UWorld* World);
+
+	/**
+	 * Adds a budget entry for a portal that is not captured this frame. It keeps the texture targets it holds,
+	 * so it counts towards the render target memory, but its tier is not changed until it is visible again.
+	 *
+	 * @param PortalIndex Index of the portal in the PortalList.
+	 * @param bReleasable Whether the portal is not on screen, so its targets may be released when over budget.
 	 */
-	void UpdatePortalCapture(APortalV3* Portal, FTransform Reference, FTransform Target, FTransform Camera);
+	void AddLockedBudgetEntry(int32 PortalIndex, bool bReleasable);
 
 	/**
 	 * Deprecated! No longer used in the final version of the code
@@ -258,47 +546,54 @@ private:
 	 * If a cloned actor exists, it updates the cloned actor's state to match the agent.
 	 * Finally, it sets the clip plane on the cloned actor's teleport agent component based on the linked portal's location and forward vector.
 	 *
-	 * @param Agent The actor to be cloned or updated.
+	 * @param AgentIndex The dense index of the agent to be cloned or updated in the TeleportAgents registry.
 	 * @param Portal The portal that influences the cloning or updating process.
+	 * @param NewTransform The transform of the agent converted through the portal pair.
+	 * @param NewVelocity The velocity of the agent converted through the portal pair.
 	 */
-	void CloneOrUpdateActor(AActor* Agent, APortalV3* Portal);
+	void CloneOrUpdateActor(int32 AgentIndex, APortalV3* Portal, const FTransform& NewTransform, const FVector& NewVelocity);
 
 	/**
 	 * Clones the specified actor through the given portal.
 	 * Depending on the type of actor (player character, projectile, or static mesh),
 	 * it handles cloning and transformation appropriately.
 	 *
-	 * @param Agent The actor to be cloned.
+	 * @param AgentIndex The dense index of the agent to be cloned in the TeleportAgents registry.
 	 * @param Portal The portal through which the actor will be cloned.
+	 * @param NewTransform The transform of the agent converted through the portal pair.
+	 * @param NewVelocity The velocity of the agent converted through the portal pair.
 	 */
-	void CloneActor(AActor* Agent, APortalV3* Portal);
+	void CloneActor(int32 AgentIndex, APortalV3* Portal, const FTransform& NewTransform, const FVector& NewVelocity);
 
 	/**
 	 * Updates the cloned actor's position, rotation, and other properties based on the agent's state
 	 * and the portal through which it was cloned. Depending on the type of actor (player character, projectile, or static mesh),
 	 * it handles cloning and transformation appropriately.
 	 *
-	 * @param Agent The original actor whose clone is being updated.
-	 * @param ClonedActor The cloned actor that needs to be updated.
+	 * @param AgentIndex The dense index of the original agent in the TeleportAgents registry.
+	 * @param Clone The clone that needs to be updated, with its cached teleport agent.
 	 * @param Portal The portal through which the actor was cloned.
+	 * @param NewTransform The transform of the agent converted through the portal pair.
+	 * @param NewVelocity The velocity of the agent converted through the portal pair.
 	 */
-	void UpdateClonedActor(AActor* Agent, AActor* ClonedActor, APortalV3* Portal);
+	void UpdateClonedActor(int32 AgentIndex, const FPortalClone& Clone, APortalV3* Portal, const FTransform& NewTransform, const FVector& NewVelocity);
 	
 	/**
 	 * Teleports the specified actor through the given portal.
 	 *
-	 * @param Agent The actor to teleport.
+	 * @param AgentIndex The dense index of the agent to teleport in the TeleportAgents registry.
 	 * @param Portal The portal through which the actor will be teleported.
 	 */
-	void TeleportActor(AActor* Agent, APortalV3* Portal);
+	void TeleportActor(int32 AgentIndex, APortalV3* Portal);
 
 	/**
-	 * Maps all actors in the world that have a UTeleportAgent component, excluding those with bDoNotTeleport set to true.
+	 * Determines the agent kind of an actor, which decides how the actor is teleported and cloned.
 	 *
-	 * @param World The world context to search for actors.
-	 * @param OutActors The output map where mapped actors will be stored (Key: Actor with UTeleportAgent component, Value: Actor itself).
+	 * @param Actor The actor owning the teleport agent component.
+	 * @param TeleportAgent The teleport agent component of the actor.
+	 * @return The kind of the teleport agent.
 	 */
-	void MapAllActorsWithComponent(UWorld* World, TMap<AActor*, AActor*>& OutActors);
+	ETeleportAgentKind GetAgentKind(AActor* Actor, UTeleportAgent* TeleportAgent) const;
 	
 
 	/*
@@ -313,9 +608,11 @@ private:
 	 * @param Portal The portal actor being checked.
 	 * @param PortalTransform The current transform of the portal.
 	 * @param CameraTransform The current transform of the camera.
+	 * @param CameraFrustum The view frustum of the camera, see GetPlayerCameraView.
+	 * @param PortalCorners The 4 corners of the portal, see APortalV3::GetPortalBounds.
 	 * @return true if the portal needs an update, false otherwise.
 	 */
-	bool CheckPortalNeedsUpdate(APortalV3* Portal, FTransform Reference, FTransform Camera);
+	bool CheckPortalNeedsUpdate(APortalV3* Portal, FTransform Reference, FTransform Camera, const FConvexVolume& CameraFrustum, const FPortalCornerArray& PortalCorners);
 
 	/**
 	 * Checks if the player is within a specified distance threshold from a reference point.
@@ -334,27 +631,33 @@ private:
 	 * @param Camera The transform representing the camera or actor position to check.
 	 * @return True if the camera or actor position is in front of the reference plane, false otherwise.
 	 */
-	bool CheckActorInFront(FTransform Reference, FTransform Camera);
+	bool CheckActorInFront(FTransform Reference, FTransform Camera) const;
 
 	/**
-	 * Checks if the player's camera has a clear line of sight to any corner of a portal, using raycasting.
+	 * Checks if the player's camera has a clear line of sight to a portal.
+	 * Issues asynchronous traces from the camera to the 4 corners and the centre of the portal, and returns the result
+	 * of the traces of the previous frames, so the game thread never waits on the physics scene.
 	 *
-	 * @param PortalBounds Array of corner points defining the bounding volume of the portal in world space.
+	 * @param Portal The portal to check.
+	 * @param PortalCorners The 4 corners of the portal, see APortalV3::GetPortalBounds.
 	 * @param Camera Transform representing the player's camera position and orientation.
-	 * @param Portal Pointer to the portal actor to exclude from the raycast checks (to avoid self-intersection).
-	 * @return True if there is a clear line of sight from the camera to any portal corner, false otherwise.
+	 * @return True if a trace reached the portal within the last LineOfSightHoldFrames frames.
 	 */
-	bool CheckPlayerPortalLineOfSigth(TArray<FVector> PortalBounds, FTransform Camera, AActor* Portal);
+	bool CheckPlayerPortalLineOfSigth(APortalV3* Portal, const FPortalCornerArray& PortalCorners, const FTransform& Camera);
 
 	/**
-	 * Performs a line trace to check if there are any obstructions between two points (Start and End).
+	 * Reads back the visibility traces issued in the previous frame, and updates the line of sight of their portals.
+	 */
+	void ConsumeVisibilityTraces();
+
+	/**
+	 * Checks the result of a single visibility trace.
 	 *
-	 * @param Start The starting point of the raycast.
-	 * @param End The end point of the raycast.
-	 * @param Portal Pointer to the portal actor to exclude from the raycast check (to avoid self-intersection).
-	 * @return True if there are no obstructions between Start and End, or if the only obstruction is the Portal itself. False otherwise.
+	 * @param Datum The finished trace.
+	 * @param Portal The portal the trace was aimed at.
+	 * @return True if nothing blocked the trace, or if the only obstruction is the Portal itself. False otherwise.
 	 */
-	bool RaycastClear(const FVector& Start, const FVector& End, AActor* Portal);
+	static bool IsTraceClear(const FTraceDatum& Datum, const AActor* Portal);
 
 	/**
 	 * Updates the viewport size and applies it to all portals or a single one.
@@ -364,42 +667,29 @@ private:
 	 */
 	bool UpdateViewportSize(APortalV3* Portal = nullptr);
 
-	/*
-	* Return Functions
-	*/
-
 	/**
-	 * Converts a location from one actor's space (Camera) to another actor's space (Target) based on a reference actor (Reference).
-	 * In the portal project, this is used to both teleport actors and update screencapture camera positions.
-	 *
-	 * @param Camera The transform of the camera or source actor from which the location is being converted.
-	 * @param Reference The transform of the reference actor to which the Camera's location is relative.
-	 * @param Target The transform of the target actor to which the converted location is relative.
-	 * @return The location vector converted to the space of the Target actor.
+	 * Rebuilds the portal broadphase grid from the current PortalList.
+	 * Should be called every time the PortalList is modified, as the grid stores indices into the list.
 	 */
-	FVector ConvertLocationToActorSpace(FTransform Camera, FTransform Reference, FTransform Target);
+	void RebuildPortalBroadphase();
 
 	/**
-	 * Converts a rotation from one actor's space (Camera) to another actor's space (Target) based on a reference actor (Reference).
-	 * In the portal project, this is used to both rotate teleported actors and update screencapture camera rotations.
-	 *
-	 * @param Camera The transform of the camera or source actor from which the rotation is being converted.
-	 * @param Reference The transform of the reference actor to which the Camera's rotation is relative.
-	 * @param Target The transform of the target actor to which the converted rotation is relative.
-	 * @return The rotation quaternion converted to the space of the Target actor.
+	 * Assigns a free portal slot to every portal in the PortalList that does not have one yet.
 	 */
-	FQuat ConvertRotationToActorSpace(FTransform Camera, FTransform Reference, FTransform Target);
+	void AssignPortalSlots();
 
 	/**
-	 * Converts a velocity vector from one actor's space (Reference) to another actor's space (Target).
-	 * In the portal project, this is used to update the velocity vector of teleported actors.
+	 * Frees the slot of a portal that is about to be destroyed, and clears the teleport status bit
+	 * of that slot for all teleport agents with a single masked AND per agent.
+	 * Agents that were inside no other portal get their clip plane and collision back here, as no later frame releases them.
 	 *
-	 * @param Object The velocity vector of the object in the Reference actor's space.
-	 * @param Reference The transform of the reference actor whose space the velocity is relative to.
-	 * @param Target The transform of the target actor to which the converted velocity should be relative.
-	 * @return The velocity vector converted to the space of the Target actor.
+	 * @param Portal The portal whose slot should be released.
 	 */
-	FVector ConvertVelocityToActorSpace(FVector Object, FTransform Reference, FTransform Target);
+	void ReleasePortalSlot(APortalV3* Portal);
+
+	/*
+	* Return Functions
+	*/
 
 	/**
 	 * Retrieves the camera projection matrix based on the current view or projection settings.
@@ -410,21 +700,12 @@ private:
 	 */
 	FMatrix GetCameraProjectionMatrix(APlayerCameraManager* CameraManagerIn, bool bIsView);
 
-	/*
-	* Template Functions || would do really well in a seperate function library
-	*/
-
 	/**
-	 * Finds all actors of a specified subclass in the world that inherit from a given base class.
-	 * This function uses UGameplayStatics::GetAllActorsOfClass to gather all actors of the specified BaseClass,
-	 * then attempts to cast each found actor to SubClass. If successful, it adds the casted actor pointer to
-	 * an array which is returned at the end.
+	 * Gets the camera view of the player as it is rendered. The cached camera view only knows the aspect ratio of the camera,
+	 * the view that is rendered uses the aspect ratio of the player's part of the screen when split screen is used.
 	 *
-	 * @tparam SubClass The subclass of AActor to search for.
-	 * @param World The world context to search for actors.
-	 * @param BaseClass The base class from which SubClass inherits.
-	 * @return An array of pointers to actors of SubClass found in the world. May be empty if none are found.
+	 * @param CameraManagerIn The player camera manager instance that manages the camera settings.
+	 * @return The camera view with the aspect ratio of the player's viewport.
 	 */
-	template <typename SubClass>
-	TArray<SubClass*> FindAllActorsInWorld(UWorld* World, TSubclassOf<AActor> BaseClass);
+	FMinimalViewInfo GetPlayerCameraView(APlayerCameraManager* CameraManagerIn) const;
 };
\ No newline at end of file
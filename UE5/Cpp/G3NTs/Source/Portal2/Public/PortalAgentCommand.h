@@ -0,0 +1,34 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * The state changes the teleport check can make to a teleport agent.
+ */
+enum class EPortalAgentCommandType : uint8
+{
+	Enter,		// agent is inside the portal collider in front of the portal: turn off collision, set the teleport status
+	Exit,		// agent left the portal collider: clear the teleport status
+	Cross,		// agent moved behind the portal: teleport it to the linked portal and move the teleport status along
+	ClipPlane,	// set the clip plane of the agent to the portal
+	Release		// agent is no longer inside any portal collider: disable the clip plane and restore collision
+};
+
+/**
+ * A single deferred state change of a teleport agent, emitted by the parallel evaluation of the teleport check
+ * and executed afterwards on the game thread. Indices refer to the TeleportAgents registry and PortalList of the manager.
+ */
+struct FPortalAgentCommand
+{
+	EPortalAgentCommandType Type;
+	int32 AgentIndex;
+	int32 PortalIndex;
+
+	FPortalAgentCommand(EPortalAgentCommandType InType, int32 InAgentIndex, int32 InPortalIndex = INDEX_NONE)
+		: Type(InType), AgentIndex(InAgentIndex), PortalIndex(InPortalIndex)
+	{}
+};
+
+typedef TArray<FPortalAgentCommand> FPortalAgentCommandArray;
@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class APortalV3;
+
+/**
+ * Array type used to return the broadphase candidates. Agents can only ever touch one or two portals at once,
+ * so a small inline allocation prevents heap allocations in the per frame checks.
+ */
+typedef TArray<int32, TInlineAllocator<4>> FPortalCandidateArray;
+
+/**
+ * Uniform grid over the world space bounds of the portal teleport colliders (BoxCheck).
+ *
+ * The grid is rebuilt only when the portal list changes (a portal is created or destroyed).
+ * During the tick, a teleport agent queries the cell it is located in, and only runs the narrow phase
+ * APortalV3::IsInside check against the portals returned by this query, instead of against every portal in the level.
+ */
+struct PORTAL2_API FPortalBroadphase
+{
+public:
+	FPortalBroadphase();
+
+	/**
+	 * Rebuilds the grid from the given portal list. The indices returned by the queries are indices into this list.
+	 *
+	 * @param Portals The portals to insert into the grid.
+	 */
+	void Rebuild(const TArray<APortalV3*>& Portals);
+
+	/**
+	 * Removes all portals from the grid.
+	 */
+	void Reset();
+
+	/**
+	 * Gathers all portals whose teleport bounds contain the given point.
+	 *
+	 * @param Point The world location to check, usually the location of a teleport agent.
+	 * @param OutPortalIndices Output array the candidate portal indices are added to.
+	 */
+	void QueryPoint(const FVector& Point, FPortalCandidateArray& OutPortalIndices) const;
+
+	/**
+	 * Gathers all portals whose teleport bounds overlap the given box, each portal at most once.
+	 *
+	 * @param Box The world space box to check, usually the bounds of the segment an agent moved along.
+	 * @param OutPortalIndices Output array the candidate portal indices are added to.
+	 */
+	void QueryBox(const FBox& Box, FPortalCandidateArray& OutPortalIndices) const;
+
+	/**
+	 * Returns the number of portals inserted into the grid.
+	 */
+	int32 Num() const { return PortalBounds.Num(); }
+
+private:
+	/**
+	 * Converts a world location to the integer coordinates of the grid cell containing it.
+	 *
+	 * @param Point The world location.
+	 * @return The coordinates of the grid cell.
+	 */
+	FIntVector GetCell(const FVector& Point) const;
+
+private:
+	/** Boxes covering more cells than this skip the grid and test the bounds of all portals directly */
+	static constexpr int32 MaxQueryCells = 27;
+
+	/** Edge length of a single grid cell. Roughly the size of a portal collider, so a portal covers only a few cells. */
+	double CellSize;
+
+	/** Sparse grid, only cells which are overlapped by at least one portal are stored. */
+	TMap<FIntVector, TArray<int32, TInlineAllocator<2>>> Cells;
+
+	/** World space bounds per portal, used to reject candidates that share a cell but not the volume. */
+	TArray<FBox> PortalBounds;
+};
@@ -39,6 +39,7 @@ private:
 	UPROPERTY(EditDefaultsOnly, Category = "G3NTs|Portal")
 	class UNiagaraComponent* NiagaraComponent;
 
+	// No longer used, the manager is found through the UPortalWorldSubsystem. Kept so existing blueprints still load.
 	UPROPERTY(EditDefaultsOnly, Category = "G3NTs|Portal")
 	TSubclassOf<AActor> BP_Portal3Manager;
 
@@ -110,4 +111,11 @@ private:
 	 */
 	void SpawnPortalOnSurface(FVector PortalCenter, FQuat PortalRotation, FVector SurfaceForwardVector, UPortalSurface* PortalSurfaceData, int32 Index);
 
+	/**
+	 * Gets the portal manager of the world this bullet is in.
+	 *
+	 * @return The portal manager, nullptr if the world has none.
+	 */
+	APortal3Manager* GetPortalManager() const;
+
 };
@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Measures how many frames the camera pose the portal captures were rendered from lags behind the presented camera pose.
+ *
+ * The manager records the pose of every frame that captured portals, and every pose that is presented. The latency is the age
+ * of the presented pose that matches the capture pose, so 0 means the portal contents and the world around them are in sync.
+ * Only works on transforms, so the measurement can be checked headless.
+ */
+struct PORTAL2_API FPortalCaptureLatencyTracker
+{
+public:
+	/** Number of presented poses the capture pose is searched in, the latency saturates at this many frames */
+	static constexpr int32 PresentedPoseHistory = 4;
+
+	/**
+	 * Records the camera pose the captures of this frame were rendered from.
+	 *
+	 * @param Pose The camera pose, before it is converted through the portals.
+	 */
+	void RecordCapturePose(const FTransform& Pose);
+
+	/**
+	 * Records the camera pose of the view that is about to be presented, and compares it with the capture pose of this frame.
+	 * A camera standing still matches every pose, so the latency is only measured while the camera moves.
+	 *
+	 * @param PresentedPose The camera pose of the presented view.
+	 * @return True if a new latency was measured, see GetLatencyFrames and GetPoseErrorDegrees.
+	 */
+	bool RecordPresentedPose(const FTransform& PresentedPose);
+
+	/** Frames between the capture pose and the presented pose of the last measurement */
+	int32 GetLatencyFrames() const { return LatencyFrames; }
+
+	/** Angle in degrees between the capture rotation and the presented rotation of the last measurement */
+	float GetPoseErrorDegrees() const { return PoseErrorDegrees; }
+
+private:
+	/** Camera pose the captures of this frame were rendered from */
+	FTransform CapturePose;
+	bool bCapturePoseUsed = false;
+
+	/** Camera poses of the last presented views, newest first */
+	TArray<FTransform, TInlineAllocator<PresentedPoseHistory>> PresentedPoses;
+
+	int32 LatencyFrames = 0;
+	float PoseErrorDegrees = 0.f;
+};
@@ -0,0 +1,130 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * A portal that wants its scene capture updated this frame.
+ */
+struct FPortalCaptureCandidate
+{
+	/** Index of the portal in the PortalList of the manager */
+	int32 PortalIndex = INDEX_NONE;
+
+	/** Fraction of the screen covered by the portal, 0 to 1 */
+	float ScreenCoverage = 0.f;
+
+	/** Distance from the camera to the portal */
+	float Distance = 0.f;
+
+	/** Seconds since the capture of this portal was last updated, a large value if it was never captured */
+	float TimeSinceCapture = 0.f;
+
+	/** Portals the player is about to walk through are always captured, regardless of the budget */
+	bool bForceCapture = false;
+};
+
+/**
+ * Why the scheduler did or did not capture a candidate. Kept per frame for debugging.
+ */
+enum class EPortalCaptureReason : uint8
+{
+	Forced,			// captured, the player is close to the portal
+	Priority,		// captured, among the highest priority portals
+	RoundRobin,		// captured, in the round robin slot for lower priority portals
+	RateLimited,	// skipped, captured too recently for its priority tier
+	OverBudget		// skipped, the frame budget was used up
+};
+
+struct FPortalCaptureDecision
+{
+	int32 PortalIndex;
+	float Priority;
+	EPortalCaptureReason Reason;
+};
+
+/**
+ * Settings of the capture scheduler, set from the Portal.Capture console variables by the manager.
+ */
+struct FPortalCaptureSchedulerSettings
+{
+	/** Maximum number of scene captures per frame, forced captures excluded */
+	int32 MaxCapturesPerFrame = 4;
+
+	/** Game thread time budget for the scene captures per frame in milliseconds, 0 disables the time budget */
+	float BudgetMilliseconds = 0.f;
+
+	/** Portals covering less of the screen than this are low priority, and are captured at a reduced rate */
+	float LowPriorityCoverage = 0.02f;
+
+	/** Minimum seconds between two captures of a low priority portal */
+	float LowPriorityInterval = 0.1f;
+
+	/** Seconds without capture after which the age term of the priority is saturated */
+	float MaxCaptureAge = 0.5f;
+};
+
+/**
+ * Decides which portals get their scene capture updated this frame, within a per frame budget.
+ *
+ * Portals are ranked by projected screen area, distance and time since the last capture. The highest ranked portals fill the budget,
+ * one slot is reserved for a round robin over the remaining portals so no portal starves. Low priority portals are rate limited.
+ * Depends on nothing but its inputs, so the decisions can be checked without a renderer.
+ */
+struct PORTAL2_API FPortalCaptureScheduler
+{
+public:
+	FPortalCaptureSchedulerSettings Settings;
+
+	/**
+	 * Selects the portals to capture this frame.
+	 *
+	 * @param Candidates The portals that are visible and linked.
+	 * @param OutPortalIndices Output array the portal indices to capture are written to, highest priority first.
+	 */
+	void Schedule(TConstArrayView<FPortalCaptureCandidate> Candidates, TArray<int32>& OutPortalIndices);
+
+	/**
+	 * Computes the priority of a candidate, higher is more important.
+	 *
+	 * @param Candidate The candidate to rank.
+	 * @return The priority, roughly between 0 and 1.
+	 */
+	float ComputePriority(const FPortalCaptureCandidate& Candidate) const;
+
+	/**
+	 * Reports the measured cost of a capture, used to convert the millisecond budget into a number of captures.
+	 *
+	 * @param Milliseconds The game thread time the capture took.
+	 */
+	void ReportCaptureCost(double Milliseconds);
+
+	/**
+	 * Returns the number of captures the budget allows this frame, forced captures excluded.
+	 */
+	int32 GetCaptureBudget() const;
+
+	/**
+	 * Returns the decisions of the last Schedule call, one per candidate.
+	 */
+	const TArray<FPortalCaptureDecision>& GetLastDecisions() const { return LastDecisions; }
+
+	float GetEstimatedCaptureMilliseconds() const { return EstimatedCaptureMilliseconds; }
+
+private:
+	/**
+	 * Returns true if the candidate was captured too recently for its priority tier.
+	 */
+	bool IsRateLimited(const FPortalCaptureCandidate& Candidate) const;
+
+private:
+	/** Running average of the capture cost */
+	double EstimatedCaptureMilliseconds = 1.0;
+
+	/** Portal index the last round robin capture was given to */
+	int32 RoundRobinCursor = INDEX_NONE;
+
+	TArray<FPortalCaptureDecision> LastDecisions;
+	TArray<int32> SortedCandidates;
+};
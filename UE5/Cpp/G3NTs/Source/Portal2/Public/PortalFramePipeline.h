@@ -0,0 +1,114 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PortalAgentCommand.h"
+
+/**
+ * The stages the portal manager runs every frame, in order.
+ * Gather, Classify and Teleport run in TG_PostPhysics, CloneSync and Capture run in TG_PostUpdateWork.
+ */
+enum class EPortalPipelineStage : uint8
+{
+	Idle,		// no stage ran yet this frame
+	Gather,		// snapshot the agent locations and the portal links
+	Classify,	// evaluate the agents against the portals in parallel, emits commands
+	Teleport,	// apply the commands and record which portals each agent needs a clone for
+	CloneSync,	// create, update and remove clones from the recorded classification
+	Capture		// update the portal scene captures
+};
+
+/**
+ * Compact per agent result passed from the teleport stages to the clone stage.
+ * Entry i belongs to the agent at dense index i in the TeleportAgents registry.
+ */
+struct FPortalAgentFrameResult
+{
+	/** Location of the agent gathered at the start of the frame */
+	FVector Location = FVector::ZeroVector;
+
+	/** Portal slots the agent is in front of after the teleport stage, a clone is needed through each of these portals */
+	uint64 CloneMask = 0;
+
+	/** CloneMask of the previous frame, clones for slots that are no longer set are removed */
+	uint64 PreviousCloneMask = 0;
+};
+
+/**
+ * Per frame data of the portal manager pipeline.
+ *
+ * The teleport check and the clone update used to walk the full agent x portal matrix separately in the two tick groups.
+ * Now every stage reads the results of the previous stage from here, so the later tick group consumes the classification
+ * of the earlier one instead of recomputing it.
+ */
+struct PORTAL2_API FPortalFramePipeline
+{
+public:
+	/** Per agent results, kept parallel to the dense arrays of the TeleportAgents registry */
+	TArray<FPortalAgentFrameResult> AgentResults;
+
+	/** Commands emitted by the classify stage, one array per chunk of agents */
+	TArray<FPortalAgentCommandArray> Commands;
+
+	/** Index of the linked portal in the PortalList for every portal, INDEX_NONE if not linked */
+	TArray<int32> PortalLinkedIndices;
+
+	/** Index in the PortalList of the portal in every portal slot, INDEX_NONE for free slots. See APortalV3::PortalSlot */
+	TArray<int32> SlotPortalIndices;
+
+	/**
+	 * Marks the start of the given stage. Stages have to run in order, a frame starts again at Gather.
+	 *
+	 * @param Stage The stage that is about to run.
+	 * @return True if the stage is allowed to run, false if the previous stages of this frame did not run.
+	 */
+	bool BeginStage(EPortalPipelineStage Stage)
+	{
+		if (Stage != EPortalPipelineStage::Gather && Stage != EPortalPipelineStage::Capture && (uint8)CurrentStage + 1 != (uint8)Stage)
+		{
+			return false;
+		}
+		CurrentStage = Stage;
+		return true;
+	}
+
+	EPortalPipelineStage GetCurrentStage() const { return CurrentStage; }
+
+	/**
+	 * Adds an entry for an agent that was added to the registry.
+	 */
+	void OnAgentAdded(const FVector& Location)
+	{
+		FPortalAgentFrameResult& Result = AgentResults.AddDefaulted_GetRef();
+		Result.Location = Location;
+	}
+
+	/**
+	 * Removes the entry of an agent that was removed from the registry, mirroring the swap remove of the registry.
+	 *
+	 * @param DenseIndex The dense index the agent had before it was removed.
+	 */
+	void OnAgentRemoved(int32 DenseIndex)
+	{
+		if (AgentResults.IsValidIndex(DenseIndex))
+		{
+			AgentResults.RemoveAtSwap(DenseIndex, 1, EAllowShrinking::No);
+		}
+	}
+
+	/**
+	 * Clears the given portal slots from the clone masks of all agents, used when a portal is destroyed.
+	 */
+	void ClearSlots(uint64 SlotMask)
+	{
+		for (FPortalAgentFrameResult& Result : AgentResults)
+		{
+			Result.CloneMask &= ~SlotMask;
+			Result.PreviousCloneMask &= ~SlotMask;
+		}
+	}
+
+private:
+	EPortalPipelineStage CurrentStage = EPortalPipelineStage::Idle;
+};
@@ -0,0 +1,125 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UMaterialInstanceDynamic;
+class UPrimitiveComponent;
+class UTexture;
+
+/**
+ * Remembers the last value pushed to every parameter of a dynamic material instance, and only forwards real changes.
+ *
+ * Every parameter write on a material instance looks up the parameter by name and updates the render thread copy,
+ * even when the value is the same. The portals set their view projection and texture every frame, mostly unchanged.
+ * Vector and scalar parameters are written by index after the first write, so the name lookup is only done once.
+ *
+ * The custom primitive data of a primitive component is cached the same way, for materials that read their parameters from it.
+ * Does not keep the material or primitive alive, the owner holds the reference.
+ */
+struct PORTAL2_API FPortalMaterialParameterCache
+{
+public:
+	/**
+	 * Binds the cache to a material instance and forgets all cached values.
+	 *
+	 * @param InMaterial The material instance the parameters are written to.
+	 */
+	void Init(UMaterialInstanceDynamic* InMaterial);
+
+	/**
+	 * Binds the cache to the custom primitive data of a primitive component and forgets all cached values.
+	 *
+	 * @param InPrimitive The primitive component the custom primitive data is written to.
+	 */
+	void InitPrimitiveData(UPrimitiveComponent* InPrimitive);
+
+	/**
+	 * Forgets all cached values, the next write of every parameter is forwarded.
+	 */
+	void Invalidate();
+
+	/**
+	 * Sets a vector parameter if it differs from the last value written through the cache.
+	 *
+	 * @param Name The name of the parameter.
+	 * @param Value The new value.
+	 * @return True if the value was written to the material.
+	 */
+	bool SetVector(FName Name, const FLinearColor& Value);
+
+	/**
+	 * Sets a scalar parameter if it differs from the last value written through the cache.
+	 *
+	 * @param Name The name of the parameter.
+	 * @param Value The new value.
+	 * @return True if the value was written to the material.
+	 */
+	bool SetScalar(FName Name, float Value);
+
+	/**
+	 * Sets a texture parameter if it differs from the last texture written through the cache.
+	 *
+	 * @param Name The name of the parameter.
+	 * @param Value The new texture, may be nullptr.
+	 * @return True if the value was written to the material.
+	 */
+	bool SetTexture(FName Name, UTexture* Value);
+
+	/**
+	 * Sets 4 floats of the custom primitive data if they differ from the last value written through the cache.
+	 *
+	 * @param DataIndex Index of the first float in the custom primitive data.
+	 * @param Value The new value.
+	 * @return True if the value was written to the primitive.
+	 */
+	bool SetPrimitiveDataVector(int32 DataIndex, const FLinearColor& Value);
+
+	/**
+	 * Sets a float of the custom primitive data if it differs from the last value written through the cache.
+	 *
+	 * @param DataIndex Index of the float in the custom primitive data.
+	 * @param Value The new value.
+	 * @return True if the value was written to the primitive.
+	 */
+	bool SetPrimitiveDataFloat(int32 DataIndex, float Value);
+
+private:
+	struct FVectorEntry
+	{
+		FName Name;
+		int32 Index;
+		FLinearColor Value;
+	};
+
+	struct FScalarEntry
+	{
+		FName Name;
+		int32 Index;
+		float Value;
+	};
+
+	struct FTextureEntry
+	{
+		FName Name;
+		TWeakObjectPtr<UTexture> Value;
+	};
+
+	struct FPrimitiveDataEntry
+	{
+		int32 DataIndex;
+		FLinearColor Value;
+	};
+
+	UMaterialInstanceDynamic* Material = nullptr;
+	UPrimitiveComponent* Primitive = nullptr;
+
+	/** A portal material has a handful of parameters, a linear search on the name is faster than a map */
+	TArray<FVectorEntry, TInlineAllocator<4>> Vectors;
+	TArray<FScalarEntry, TInlineAllocator<2>> Scalars;
+	TArray<FTextureEntry, TInlineAllocator<1>> Textures;
+
+	/** Floats are stored in the R channel, they never share a data index with a vector */
+	TArray<FPrimitiveDataEntry, TInlineAllocator<3>> PrimitiveData;
+};
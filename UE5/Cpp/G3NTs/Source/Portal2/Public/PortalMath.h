@@ -0,0 +1,199 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Planes of a portal view frustum, see FPortalMath::BuildPortalFrustum */
+typedef TArray<FPlane, TInlineAllocator<5>> FPortalFrustumPlanes;
+
+/**
+ * Struct-of-arrays batch of bounding spheres, used to cull many primitives against a frustum at once.
+ * The arrays are padded to a multiple of 4 with spheres that are never visible, so the culling loop needs no tail.
+ */
+struct PORTAL2_API FPortalSphereBatch
+{
+public:
+	TArray<double> X;
+	TArray<double> Y;
+	TArray<double> Z;
+	TArray<double> Radius;
+
+	/**
+	 * Sets the sphere at the given index, the batch has to be large enough.
+	 */
+	FORCEINLINE void Set(int32 Index, const FVector& Origin, double InRadius)
+	{
+		X[Index] = Origin.X;
+		Y[Index] = Origin.Y;
+		Z[Index] = Origin.Z;
+		Radius[Index] = InRadius;
+	}
+
+	/**
+	 * Resizes the batch to hold Num spheres plus the padding. New and padding spheres are never visible.
+	 */
+	void SetNum(int32 Num)
+	{
+		const int32 OldPadded = X.Num();
+		const int32 Padded = Align(Num, 4);
+		X.SetNum(Padded, EAllowShrinking::No);
+		Y.SetNum(Padded, EAllowShrinking::No);
+		Z.SetNum(Padded, EAllowShrinking::No);
+		Radius.SetNum(Padded, EAllowShrinking::No);
+		for (int32 Index = FMath::Min(Num, OldPadded); Index < Padded; ++Index)
+		{
+			// a negative radius fails every plane test
+			Set(Index, FVector::ZeroVector, -1.0);
+		}
+		NumSpheres = Num;
+	}
+
+	int32 Num() const { return NumSpheres; }
+
+private:
+	int32 NumSpheres = 0;
+};
+
+/**
+ * Result of FPortalMath::BenchmarkCullSpheres.
+ */
+struct FPortalCullingBenchmarkResult
+{
+	int32 NumVisible = 0;
+	bool bResultsMatch = false;
+	double ScalarNsPerPrimitive = 0.0;
+	double BatchNsPerPrimitive = 0.0;
+};
+
+/**
+ * Stateless geometry helpers used by the portal manager. Everything in here only depends on its arguments,
+ * so it can be used from worker threads and checked in isolation.
+ */
+struct PORTAL2_API FPortalMath
+{
+	/**
+	 * Intersects the segment an agent moved along during the last frame with the opening of a portal.
+	 * Only a crossing from the front (positive forward axis) to the back of the portal counts, like CheckActorInFront.
+	 *
+	 * @param Start The location of the agent at the end of the previous frame.
+	 * @param End The current location of the agent.
+	 * @param QuadCenter The world location of the portal.
+	 * @param QuadRotation The world rotation of the portal, the forward axis is the portal normal.
+	 * @param QuadHalfExtents Half the width (local Y) and half the height (local Z) of the portal opening.
+	 * @param OutFraction Fraction along the segment at which the portal plane is crossed, 0 at Start and 1 at End.
+	 * @return True if the segment passes through the portal opening from front to back.
+	 */
+	static bool SegmentCrossesQuad(const FVector& Start, const FVector& End, const FVector& QuadCenter, const FQuat& QuadRotation, const FVector2D& QuadHalfExtents, double& OutFraction);
+
+	/**
+	 * Projects a set of world points and returns the bounding rectangle of their projection on the screen.
+	 *
+	 * @param ViewProjectionMatrix The view projection matrix of the camera.
+	 * @param Points The world points, usually the corners of a portal.
+	 * @return The rectangle in normalized device coordinates, clamped to the screen from -1 to 1. Invalid if the points are
+	 *         off screen, the whole screen if a point is behind the camera.
+	 */
+	static FBox2D ComputeScreenRect(const FMatrix& ViewProjectionMatrix, TConstArrayView<FVector> Points);
+
+	/**
+	 * Snaps a screen rectangle outwards to a grid, so the render targets sized from it come in a few sizes the pool can reuse.
+	 * The current rectangle is kept while it still contains the new one and is less than twice its area,
+	 * so a portal moving over the screen does not lease new render targets every frame.
+	 *
+	 * @param ScreenRect The rectangle the portal covers, in normalized device coordinates.
+	 * @param CurrentRect The rectangle used so far.
+	 * @param GridSteps Number of grid cells across the screen on each axis.
+	 * @return The rectangle to use, the whole screen if ScreenRect is invalid.
+	 */
+	static FBox2D SelectCaptureRect(const FBox2D& ScreenRect, const FBox2D& CurrentRect, int32 GridSteps);
+
+	/**
+	 * Builds the matrix that maps a rectangle of the screen onto the whole screen. Applied after a projection matrix,
+	 * it gives the off-centre projection of only that rectangle. The depth and W are left untouched.
+	 *
+	 * @param ScreenRect The rectangle in normalized device coordinates.
+	 * @return The crop matrix, the identity if the rectangle is invalid or empty.
+	 */
+	static FMatrix MakeScreenCropMatrix(const FBox2D& ScreenRect);
+
+	/**
+	 * Estimates the fraction of the screen covered by a set of world points, using the bounding rectangle of their projection.
+	 *
+	 * @param ViewProjectionMatrix The view projection matrix of the camera.
+	 * @param Points The world points, usually the corners of a portal.
+	 * @return The covered fraction of the screen between 0 and 1. Points behind the camera count as covering the whole screen.
+	 */
+	static float ComputeScreenCoverage(const FMatrix& ViewProjectionMatrix, TConstArrayView<FVector> Points);
+
+	/**
+	 * Builds the view matrix of a scene capture, the same way the renderer does: world to camera space,
+	 * followed by the swap from the Unreal axes (X forward, Z up) to the view axes (Z forward, Y up).
+	 *
+	 * @param Location The world location of the capture.
+	 * @param Rotation The world rotation of the capture.
+	 * @return The view matrix.
+	 */
+	static FMatrix MakeViewMatrix(const FVector& Location, const FQuat& Rotation);
+
+	/**
+	 * Replaces the near plane of a reversed-Z perspective projection by an arbitrary plane, so everything on the
+	 * negative side of the plane is removed by the regular depth clipping (Lengyel's oblique near plane).
+	 *
+	 * In clip space the near plane is W - Z >= 0. Replacing the Z column by the W column minus Scale * ClipPlane
+	 * turns that test into Scale * dot(ClipPlane, P) >= 0. Scale is chosen as large as possible while keeping the depth
+	 * of every point inside the frustum at or above 0, which preserves as much depth precision as possible.
+	 *
+	 * @param ProjectionMatrix A reversed-Z perspective projection, as used by the renderer.
+	 * @param ViewSpaceClipPlane The clip plane in view space, points with a positive plane dot are kept.
+	 *        The view origin has to be on the negative side, otherwise the projection is returned unchanged.
+	 * @return The oblique projection matrix.
+	 */
+	static FMatrix MakeObliqueProjection(const FMatrix& ProjectionMatrix, const FPlane& ViewSpaceClipPlane);
+
+	/**
+	 * Tests a portal quad against the planes of a view frustum. The quad is culled when all 4 corners are outside the same plane,
+	 * which is exact for the frustum side planes and conservative only for quads that pass diagonally outside a frustum corner.
+	 *
+	 * @param FrustumPlanes The planes of the frustum, with the normals pointing out of the frustum as in FConvexVolume.
+	 * @param Corners The 4 corners of the quad in world space.
+	 * @return True if the quad may be visible, false if it is completely outside the frustum.
+	 */
+	static bool IsQuadInFrustum(TConstArrayView<FPlane> FrustumPlanes, TConstArrayView<FVector> Corners);
+
+	/**
+	 * Builds the off-axis frustum seen through a portal opening: one plane through the view origin and each edge of the opening,
+	 * and the clip plane of the exit portal, which removes everything behind the portal surface.
+	 *
+	 * @param ViewOrigin The location of the scene capture.
+	 * @param Corners The 4 corners of the exit portal opening, in order around the opening.
+	 * @param ClipPlaneBase A point on the clip plane of the scene capture.
+	 * @param ClipPlaneNormal The normal of the clip plane, pointing to the side that is rendered.
+	 * @param OutPlanes The planes of the frustum, with the normals pointing out of the frustum as in FConvexVolume.
+	 */
+	static void BuildPortalFrustum(const FVector& ViewOrigin, TConstArrayView<FVector> Corners, const FVector& ClipPlaneBase, const FVector& ClipPlaneNormal, FPortalFrustumPlanes& OutPlanes);
+
+	/**
+	 * Culls a batch of bounding spheres against a frustum, 4 spheres at a time.
+	 *
+	 * @param FrustumPlanes The planes of the frustum, with the normals pointing out of the frustum as in FConvexVolume.
+	 * @param Spheres The spheres to cull.
+	 * @param OutVisible Output array the indices of the spheres that intersect the frustum are added to, in increasing order.
+	 */
+	static void CullSpheres(TConstArrayView<FPlane> FrustumPlanes, const FPortalSphereBatch& Spheres, TArray<int32>& OutVisible);
+
+	/**
+	 * Scalar version of CullSpheres, tests the spheres one by one. Kept as reference for the benchmark.
+	 */
+	static void CullSpheresScalar(TConstArrayView<FPlane> FrustumPlanes, const FPortalSphereBatch& Spheres, TArray<int32>& OutVisible);
+
+	/**
+	 * Times CullSpheres against CullSpheresScalar on random spheres standing in for the static meshes of a level,
+	 * seen through a 240 x 120 portal. Does not need a world or a renderer, so it also runs headless with -nullrhi.
+	 *
+	 * @param NumPrimitives The number of spheres.
+	 * @param Iterations The number of times each version culls all spheres.
+	 * @return The visible count and the time per primitive of both versions.
+	 */
+	static FPortalCullingBenchmarkResult BenchmarkCullSpheres(int32 NumPrimitives, int32 Iterations);
+};
@@ -0,0 +1,168 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Struct-of-arrays batch of agent transforms, used to convert many agents through one portal pair at once.
+ * The three arrays always have the same length, entry i of each array belongs to the same agent.
+ */
+struct PORTAL2_API FPortalTransformBatch
+{
+public:
+	TArray<FVector> Positions;
+	TArray<FQuat> Rotations;
+	TArray<FVector> Velocities;
+
+	/**
+	 * Adds an agent transform to the batch.
+	 *
+	 * @return The index of the agent in the batch.
+	 */
+	FORCEINLINE int32 Add(const FVector& Position, const FQuat& Rotation, const FVector& Velocity)
+	{
+		Rotations.Add(Rotation);
+		Velocities.Add(Velocity);
+		return Positions.Add(Position);
+	}
+
+	/**
+	 * Resizes all arrays to the given length, without shrinking the allocations.
+	 */
+	void SetNumUninitialized(int32 Num)
+	{
+		Positions.SetNumUninitialized(Num, EAllowShrinking::No);
+		Rotations.SetNumUninitialized(Num, EAllowShrinking::No);
+		Velocities.SetNumUninitialized(Num, EAllowShrinking::No);
+	}
+
+	/**
+	 * Empties the batch but keeps the allocations, so a batch can be reused every frame.
+	 */
+	void Reset()
+	{
+		Positions.Reset();
+		Rotations.Reset();
+		Velocities.Reset();
+	}
+
+	int32 Num() const { return Positions.Num(); }
+};
+
+/**
+ * Cached conversion from the space of a portal (Reference) to the space of its linked portal (Target).
+ *
+ * Going through a portal means: express the location relative to the reference portal, turn it around the up axis
+ * by 180 degrees (entering the front of one portal means leaving the front of the other), and express it relative to the target portal.
+ * All three steps are composed into a single rotation and matrix when either portal moves,
+ * so every conversion during the tick is a single quaternion or matrix multiply.
+ *
+ * This is the single source of truth for teleporting actors, updating clones and positioning the scene captures.
+ */
+struct PORTAL2_API FPortalPairTransform
+{
+public:
+	FPortalPairTransform();
+
+	/**
+	 * Recomputes the cached conversion. Only has to be called when one of the two portals moves.
+	 *
+	 * @param Reference The transform of the portal that is entered.
+	 * @param Target The transform of the linked portal that is exited.
+	 */
+	void Update(const FTransform& Reference, const FTransform& Target);
+
+	/**
+	 * Converts a world location in front of the reference portal to the matching location at the target portal.
+	 *
+	 * @param Location The world location to convert.
+	 * @return The converted world location.
+	 */
+	FORCEINLINE FVector TransformPosition(const FVector& Location) const
+	{
+		return Matrix.TransformPosition(Location);
+	}
+
+	/**
+	 * Converts a world rotation at the reference portal to the matching rotation at the target portal.
+	 *
+	 * @param Rotation The world rotation to convert.
+	 * @return The converted world rotation.
+	 */
+	FORCEINLINE FQuat TransformRotation(const FQuat& Rotation) const
+	{
+		return Quat * Rotation;
+	}
+
+	/**
+	 * Converts a direction, such as a velocity, from the reference portal to the target portal. Ignores translation.
+	 *
+	 * @param Vector The world direction to convert.
+	 * @return The converted world direction.
+	 */
+	FORCEINLINE FVector TransformVector(const FVector& Vector) const
+	{
+		return Quat.RotateVector(Vector);
+	}
+
+	/**
+	 * Converts a world location at the target portal back to the matching location at the reference portal.
+	 *
+	 * @param Location The world location to convert.
+	 * @return The converted world location.
+	 */
+	FORCEINLINE FVector InverseTransformPosition(const FVector& Location) const
+	{
+		return InverseMatrix.TransformPosition(Location);
+	}
+
+	/**
+	 * Converts a world rotation at the target portal back to the matching rotation at the reference portal.
+	 *
+	 * @param Rotation The world rotation to convert.
+	 * @return The converted world rotation.
+	 */
+	FORCEINLINE FQuat InverseTransformRotation(const FQuat& Rotation) const
+	{
+		return InverseQuat * Rotation;
+	}
+
+	/**
+	 * Converts all positions, rotations and velocities of a batch in a single vectorised pass.
+	 * Produces the same result as calling TransformPosition, TransformRotation and TransformVector for every entry.
+	 *
+	 * @param In The agent transforms in front of the reference portal.
+	 * @param Out The converted transforms at the target portal, resized to the size of In. May not be In.
+	 */
+	void TransformBatch(const FPortalTransformBatch& In, FPortalTransformBatch& Out) const;
+
+	/**
+	 * Scalar version of TransformBatch, converts the entries one by one. Kept as reference for the benchmark.
+	 *
+	 * @param In The agent transforms in front of the reference portal.
+	 * @param Out The converted transforms at the target portal, resized to the size of In. May not be In.
+	 */
+	void TransformBatchScalar(const FPortalTransformBatch& In, FPortalTransformBatch& Out) const;
+
+	const FMatrix& GetMatrix() const { return Matrix; }
+	const FMatrix& GetInverseMatrix() const { return InverseMatrix; }
+	const FQuat& GetQuat() const { return Quat; }
+	const FQuat& GetInverseQuat() const { return InverseQuat; }
+
+private:
+	/** Composed reference to target matrix, rotation and translation */
+	FMatrix Matrix;
+
+	/** Composed target to reference matrix */
+	FMatrix InverseMatrix;
+
+	/** Rotational part of the reference to target conversion */
+	FQuat Quat;
+
+	/** Rotational part of the target to reference conversion */
+	FQuat InverseQuat;
+
+	/** Translational part of the reference to target conversion, used by the batch conversion */
+	FVector Translation;
+};
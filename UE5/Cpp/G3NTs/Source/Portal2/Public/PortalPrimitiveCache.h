@@ -0,0 +1,107 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PortalMath.h"
+#include "Templates/Function.h"
+
+class UPrimitiveComponent;
+
+/**
+ * Cached list of the primitive components in the world, with their bounding spheres in a struct-of-arrays batch.
+ *
+ * The portal captures cull this list against the frustum seen through the portal, and only render the primitives that survive.
+ * The list is filled once when the manager begins play and then kept up to date from actor spawn and destroy events,
+ * the bounds of movable primitives are refreshed once per frame. Primitives registered after their actor was added,
+ * such as meshes added at runtime or particle systems spawned on the world settings, are picked up by the same per frame pass.
+ */
+struct PORTAL2_API FPortalPrimitiveCache
+{
+public:
+	/**
+	 * Adds all registered primitive components of an actor, and tracks the actor for primitives registered later.
+	 */
+	void AddActor(AActor* Actor);
+
+	/**
+	 * Removes all primitive components of an actor, by swapping the last primitive into the freed index.
+	 */
+	void RemoveActor(AActor* Actor);
+
+	/**
+	 * Removes all primitives.
+	 */
+	void Reset();
+
+	/**
+	 * Adds the primitives registered on tracked actors since they were added, re-reads the bounds of the movable primitives,
+	 * and drops primitives that were destroyed without their actor.
+	 */
+	void UpdateMovableBounds();
+
+	/**
+	 * Collects the primitives whose bounding sphere intersects a frustum.
+	 *
+	 * @param FrustumPlanes The planes of the frustum, with the normals pointing out of the frustum as in FConvexVolume.
+	 * @param OutComponents Output array, reset and filled with the visible primitives.
+	 */
+	void Cull(TConstArrayView<FPlane> FrustumPlanes, TArray<TWeakObjectPtr<UPrimitiveComponent>>& OutComponents);
+
+	/**
+	 * Collects the movable primitives whose bounding sphere passes a visibility test, with the bounds of the last UpdateMovableBounds.
+	 *
+	 * @param IsInView Test on the origin and radius of the bounding sphere of a primitive.
+	 * @param OutComponents Output array, reset and filled with the movable primitives that pass the test.
+	 * @param bOutAnyAnimating Set to true if any primitive that passes the test animates without moving, such as a skinned mesh or particle system.
+	 */
+	void GetMovableInView(TFunctionRef<bool(const FVector& Origin, double Radius)> IsInView, TArray<const UPrimitiveComponent*>& OutComponents, bool& bOutAnyAnimating) const;
+
+	/**
+	 * Returns true for primitives whose image changes without their transform changing, such as skinned meshes and particle systems.
+	 */
+	static bool IsAnimating(const UPrimitiveComponent* Component);
+
+	int32 Num() const { return Components.Num(); }
+
+private:
+	/**
+	 * An actor whose primitives are in the cache. Its components are only scanned again when they may have changed.
+	 */
+	struct FTrackedActor
+	{
+		TWeakObjectPtr<AActor> Actor;
+
+		/** Number of components owned by the actor when it was last scanned, a new component changes it */
+		int32 NumComponents = 0;
+
+		/** Whether the actor had primitives that were not registered yet when it was last scanned */
+		bool bHasUnregisteredPrimitives = false;
+	};
+
+	/**
+	 * Scans the tracked actors whose components may have changed since they were last scanned again.
+	 */
+	void AddChangedActors();
+
+	/**
+	 * Removes the primitive at the given index by swapping the last primitive into it.
+	 */
+	void RemoveAtSwap(int32 Index);
+
+	TArray<TWeakObjectPtr<UPrimitiveComponent>> Components;
+	TArray<TObjectKey<UPrimitiveComponent>> Keys; // stays valid after the component is destroyed, unlike the weak pointer
+	TArray<bool> Movable;
+	TArray<bool> Animating;
+	FPortalSphereBatch Spheres;
+	TMap<TObjectKey<UPrimitiveComponent>, int32> ComponentToIndex;
+
+	/** Actors whose primitives are in the cache */
+	TMap<TObjectKey<AActor>, FTrackedActor> TrackedActors;
+
+	/** Indices of the movable primitives, rebuilt by UpdateMovableBounds */
+	TArray<int32> MovableIndices;
+
+	/** Scratch array of the indices that survive the culling */
+	TArray<int32> VisibleIndices;
+};
@@ -0,0 +1,95 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Render target memory of a single portal, as seen by the budget.
+ */
+struct FPortalRenderTargetBudgetEntry
+{
+	/** Index of the portal in the PortalList of the manager */
+	int32 PortalIndex = INDEX_NONE;
+
+	/** How important the portal is, the least important portals are stepped down first. The manager uses the screen coverage */
+	float Importance = 0.f;
+
+	/** Height divided by width of the render targets */
+	double AspectRatio = 1.0;
+
+	/** Fraction of the view the cropped render targets cover on each axis, see APortalV3::CaptureRect */
+	FVector2D CropFraction = FVector2D(1.0);
+
+	/** Resolution tier the portal wants, stepped down by Enforce when over budget */
+	int32 Tier = 0;
+
+	/** Locked entries count towards the total but are never stepped down, used for portals that hold targets but are not captured */
+	bool bLocked = false;
+
+	/** Locked entries that may give up their render targets entirely, used for portals that are not on screen */
+	bool bReleasable = false;
+
+	/** Set by Enforce when the render targets of a releasable entry have to be returned to fit the budget, its Bytes are then 0 */
+	bool bReleased = false;
+
+	/** Memory of the front and back render target at Tier, filled in by Enforce */
+	int64 Bytes = 0;
+};
+
+/**
+ * Keeps the total memory of the portal render targets below a ceiling, by releasing the targets of portals that are not on screen
+ * and lowering the resolution tier of the least important portals.
+ *
+ * Works on plain entries and only uses the tier sizes, it never touches a render target or the RHI,
+ * so the accounting can be run and checked headless.
+ */
+struct PORTAL2_API FPortalRenderTargetBudget
+{
+public:
+	/** Memory ceiling of all portal render targets in bytes, 0 disables the ceiling */
+	int64 BudgetBytes = 0;
+
+	/** Bytes per pixel of the render target format, the portals use RGBA8 */
+	int32 BytesPerPixel = 4;
+
+	/**
+	 * Computes the memory of the front and back render target of a portal.
+	 *
+	 * @param Tier The resolution tier of the portal.
+	 * @param AspectRatio Height divided by width of the render targets.
+	 * @param CropFraction Fraction of the view the render targets cover on each axis.
+	 * @return The memory of both render targets in bytes.
+	 */
+	int64 GetPortalBytes(int32 Tier, double AspectRatio, const FVector2D& CropFraction = FVector2D(1.0)) const;
+
+	/**
+	 * Fills in the memory of every entry. Over budget, the releasable entries are released first, since nobody sees them.
+	 * Then the tiers of the least important unlocked entries are stepped down one at a time until the total fits in the budget,
+	 * or every unlocked entry is at the lowest tier.
+	 *
+	 * @param Entries The portals to account for, the Tier, Bytes and bReleased of the entries are updated.
+	 * @return The total memory of all entries in bytes, may be over budget if the locked entries alone exceed it.
+	 */
+	int64 Enforce(TArrayView<FPortalRenderTargetBudgetEntry> Entries);
+
+	/** Total of the last Enforce call in bytes */
+	int64 GetTotalBytes() const { return TotalBytes; }
+
+	/** Number of tier steps the last Enforce call took to fit the budget */
+	int32 GetNumStepsDown() const { return NumStepsDown; }
+
+	/** Number of entries the last Enforce call released to fit the budget */
+	int32 GetNumReleased() const { return NumReleased; }
+
+private:
+	int64 TotalBytes = 0;
+	int32 NumStepsDown = 0;
+	int32 NumReleased = 0;
+
+	/** Scratch array of the unlocked entries ordered by importance */
+	TArray<int32> SortedEntries;
+
+	/** Scratch array of the releasable entries ordered by memory */
+	TArray<int32> ReleasableEntries;
+};
@@ -0,0 +1,90 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "PortalRenderTargetPool.generated.h"
+
+/**
+ * Pool of render targets for the portal scene captures, owned by the portal manager.
+ *
+ * Portals are destroyed and spawned on every shot. Instead of every portal creating its own pair of render targets,
+ * a portal leases a front and back target from the pool when it is linked and visible, and returns them when it is destroyed.
+ * A returned target is handed to the next lease with the same size and format, without a new GPU allocation.
+ */
+USTRUCT()
+struct PORTAL2_API FPortalRenderTargetPool
+{
+	GENERATED_BODY()
+
+public:
+	/** Maximum number of unused targets kept alive, returning a target beyond this frees the least recently used one */
+	int32 MaxFreeTargets = 8;
+
+	/**
+	 * Leases a render target of the given size and format, reusing a returned target if one matches.
+	 *
+	 * @param Size The size of the render target in pixels.
+	 * @param Format The format of the render target.
+	 * @return The leased render target, to be returned with Release.
+	 */
+	UTextureRenderTarget2D* Acquire(FIntPoint Size, ETextureRenderTargetFormat Format);
+
+	/**
+	 * Returns a leased render target to the pool. Does nothing for targets that were not leased from this pool.
+	 * When the pool is full, the least recently returned unused target is freed to make room.
+	 *
+	 * @param RenderTarget The render target to return.
+	 */
+	void Release(UTextureRenderTarget2D* RenderTarget);
+
+	/**
+	 * Frees all unused render targets. Leased targets stay with the portals that lease them.
+	 */
+	void Reset();
+
+	/** Number of leases served from a returned render target */
+	int32 GetNumHits() const { return NumHits; }
+
+	/** Number of leases that had to create a new render target */
+	int32 GetNumMisses() const { return NumMisses; }
+
+	/**
+	 * Returns the fraction of the leases that were served from a returned render target.
+	 *
+	 * @return The hit rate between 0 and 1, 0 before the first lease.
+	 */
+	float GetHitRate() const;
+
+	/** Number of render targets currently leased */
+	int32 GetNumLeased() const { return LeasedTargets.Num(); }
+
+	/** Number of unused render targets waiting for a lease */
+	int32 GetNumFree() const { return FreeTargets.Num(); }
+
+	/** Estimated GPU memory of all leased and unused render targets, in bytes */
+	int64 GetResidentBytes() const { return ResidentBytes; }
+
+private:
+	/** Unused targets, least recently returned first */
+	UPROPERTY(Transient)
+	TArray<UTextureRenderTarget2D*> FreeTargets;
+
+	UPROPERTY(Transient)
+	TArray<UTextureRenderTarget2D*> LeasedTargets;
+
+	int32 NumHits = 0;
+	int32 NumMisses = 0;
+	int64 ResidentBytes = 0;
+
+	/**
+	 * Frees the GPU resource of a render target that is no longer in the pool, the object is collected by the garbage collector.
+	 */
+	void FreeRenderTarget(UTextureRenderTarget2D* RenderTarget);
+
+	/**
+	 * Estimates the GPU memory of a render target from its size and pixel format.
+	 */
+	static int64 GetTargetBytes(const UTextureRenderTarget2D* RenderTarget);
+};
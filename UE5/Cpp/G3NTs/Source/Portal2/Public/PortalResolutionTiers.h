@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Render target resolution tiers of the portal captures. Tier 0 is the full resolution, higher tiers are smaller.
+ *
+ * The portal material samples the capture in screen space, so a tier is the resolution the capture would have over the whole view.
+ * A portal covering a small part of the screen only needs a fraction of those pixels, and the capture is further cropped
+ * to the rectangle of the screen the portal covers, see APortalV3::CaptureRect.
+ */
+struct PORTAL2_API FPortalResolutionTiers
+{
+	static constexpr int32 NumTiers = 4;
+
+	/**
+	 * Returns the render target width of a tier. The height follows from the aspect ratio of the viewport.
+	 */
+	static int32 GetWidth(int32 Tier);
+
+	/**
+	 * Returns the render target size of a tier.
+	 *
+	 * @param Tier The resolution tier.
+	 * @param AspectRatio Height divided by width of the viewport.
+	 * @return The size of the render target in pixels.
+	 */
+	static FIntPoint GetSize(int32 Tier, double AspectRatio);
+
+	/**
+	 * Returns the render target size of a tier, cropped to a part of the view. Keeps the pixel density of the uncropped size.
+	 *
+	 * @param Tier The resolution tier.
+	 * @param AspectRatio Height divided by width of the viewport.
+	 * @param CropFraction Fraction of the view the render target covers on each axis, 0 to 1.
+	 * @return The size of the render target in pixels.
+	 */
+	static FIntPoint GetSize(int32 Tier, double AspectRatio, const FVector2D& CropFraction);
+
+	/**
+	 * Selects the tier for a portal from its screen coverage, with hysteresis around the tier boundaries.
+	 * Moving to a higher resolution happens as soon as the coverage crosses a boundary, moving to a lower resolution
+	 * only when the coverage is clearly below it, so a portal hovering around a boundary does not reallocate every frame.
+	 *
+	 * @param ScreenCoverage Fraction of the screen covered by the portal, 0 to 1.
+	 * @param CurrentTier The tier the portal currently uses.
+	 * @return The tier the portal should use.
+	 */
+	static int32 SelectTier(float ScreenCoverage, int32 CurrentTier);
+};
@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+/**
+ * Stats of the portal system, shown in game with the "stat Portal" console command.
+ */
+DECLARE_STATS_GROUP(TEXT("Portal"), STATGROUP_Portal, STATCAT_Advanced);
+
+/** Number of primitive components in the cache the portal captures are culled from */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Cached Primitives"), STAT_PortalCachedPrimitives, STATGROUP_Portal, PORTAL2_API);
+
+/** Number of primitives passed to the scene captures this frame after culling against the portal frustums, summed over all captures */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Captured Primitives"), STAT_PortalCapturedPrimitives, STATGROUP_Portal, PORTAL2_API);
+
+/** Number of full world scans (actor iterators over the whole level) done this frame. Only the portal manager begin play scans, should stay zero during gameplay. */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Full World Scans"), STAT_PortalWorldScans, STATGROUP_Portal, PORTAL2_API);
+
+/** Number of portals registered with the portal manager */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Registered Portals"), STAT_PortalRegisteredPortals, STATGROUP_Portal, PORTAL2_API);
+
+/** Number of teleport agents registered with the portal manager */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Registered Agents"), STAT_PortalRegisteredAgents, STATGROUP_Portal, PORTAL2_API);
+
+/** Number of portals and agents that began play before the portal manager, and wait in the portal world subsystem */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Pending Registrations"), STAT_PortalPendingRegistrations, STATGROUP_Portal, PORTAL2_API);
+
+/** Number of portal scene captures this frame */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Captures"), STAT_PortalCaptures, STATGROUP_Portal, PORTAL2_API);
+
+/** Number of visible portals showing an impostor snapshot instead of a live capture */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Impostors"), STAT_PortalImpostors, STATGROUP_Portal, PORTAL2_API);
+
+/** Number of visible portals whose capture was skipped this frame, because nothing seen through them changed */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Captures Skipped Unchanged"), STAT_PortalCapturesSkipped, STATGROUP_Portal, PORTAL2_API);
+
+/** Fraction of the visible portals whose capture was skipped this frame, because nothing seen through them changed */
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Captures Skipped Fraction"), STAT_PortalCapturesSkippedFraction, STATGROUP_Portal, PORTAL2_API);
+
+/** Frames between the camera pose the portal captures were rendered from and the pose presented with them, 0 is in sync. Only updated while the camera moves */
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Capture Latency Frames"), STAT_PortalCaptureLatencyFrames, STATGROUP_Portal, PORTAL2_API);
+
+/** Angle in degrees between the camera rotation the portal captures were rendered from and the presented camera rotation */
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Capture Pose Error Degrees"), STAT_PortalCapturePoseError, STATGROUP_Portal, PORTAL2_API);
+
+/** Number of material parameter and custom primitive data writes of the portals and teleport agents this frame that changed a value */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Parameter Writes"), STAT_PortalMaterialParameterWrites, STATGROUP_Portal, PORTAL2_API);
+
+/** Number of material parameter and custom primitive data writes this frame that were dropped, because the value did not change */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Parameter Writes Suppressed"), STAT_PortalMaterialParameterWritesSuppressed, STATGROUP_Portal, PORTAL2_API);
+
+/** Number of visible portals whose capture was deferred to a later frame by the capture scheduler */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Captures Deferred"), STAT_PortalCapturesDeferred, STATGROUP_Portal, PORTAL2_API);
+
+/** Number of portal render target leases served from the pool since the world started */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Render Target Pool Hits"), STAT_PortalRenderTargetPoolHits, STATGROUP_Portal, PORTAL2_API);
+
+/** Number of portal render target leases that created a new render target since the world started */
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Render Target Pool Misses"), STAT_PortalRenderTargetPoolMisses, STATGROUP_Portal, PORTAL2_API);
+
+/** Fraction of the portal render target leases served from the pool since the world started */
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Render Target Pool Hit Rate"), STAT_PortalRenderTargetPoolHitRate, STATGROUP_Portal, PORTAL2_API);
+
+/** Estimated GPU memory of the leased and unused portal render targets */
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Render Target Pool Memory"), STAT_PortalRenderTargetPoolMemory, STATGROUP_Portal, PORTAL2_API);
+
+/** Render target memory of the portals after the Portal.RenderTargets.BudgetMB ceiling was applied */
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Render Target Budget Memory"), STAT_PortalRenderTargetBudgetMemory, STATGROUP_Portal, PORTAL2_API);
@@ -81,7 +81,7 @@ private:
 	FRebuildCollision RebuildCollision; // Class which a delegate is assigned to. 
 
 	UPROPERTY(EditAnywhere, Category = "Portals")
-	TSubclassOf<AActor> ManagerClass; // Reference to the portal manager class.
+	TSubclassOf<AActor> ManagerClass; // No longer used, the manager is found through the UPortalWorldSubsystem.
 
 protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Portals")
@@ -9,6 +9,9 @@
 #include "Engine/TextureRenderTarget2D.h"
 #include "Components/BoxComponent.h"
 
+#include "PortalPairTransform.h"
+#include "PortalMaterialParameterCache.h"
+
 #include "PortalV3.generated.h"
 
 class USceneCaptureComponent2D;
@@ -16,6 +19,19 @@ class UTextureRenderTarget2D;
 class UMaterialInstanceDynamic;
 class UStaticMeshComponent;
 class UPortalSurface;
+struct FPortalRenderTargetPool;
+
+/** The 4 corners of the portal plane */
+typedef TArray<FVector, TInlineAllocator<4>> FPortalCornerArray;
+
+/**
+ * How the scene capture removes everything between its location and the exit portal.
+ */
+enum class EPortalClipMode : uint8
+{
+	ClipPlane,			// the global clip plane of the scene capture, costs an extra clip distance in every pass
+	ObliqueProjection	// the near plane of the projection is moved onto the exit portal, the clip comes from depth clipping
+};
 
 UCLASS()
 class PORTAL2_API APortalV3 : public AActor
@@ -33,10 +49,47 @@ public:
 	UPortalSurface* PortalSurface;
 	bool bIsOrangePortal;
 
+	/** Dense slot index assigned by the portal manager, used to index the teleport status bits of the agents */
+	int32 PortalSlot;
+
+	/** World time in seconds of the last scene capture, negative if the portal was never captured */
+	double LastCaptureTime = -1.0;
+
+	/** Render target resolution tier, see FPortalResolutionTiers. 0 is the full resolution */
+	int32 ResolutionTier = 0;
+
+	/** Hash of everything visible through the portal at its last render, 0 if the texture targets have no valid content. See APortal3Manager::ComputeCaptureHash */
+	uint32 CaptureHash = 0;
+
+	/** Number of times the portal was rendered, portals seen through other portals add it to their capture hash */
+	uint32 CaptureCount = 0;
+
+	/** World time in seconds of the last render, unlike LastCaptureTime not updated when an unchanged capture is skipped */
+	double LastRenderTime = -1.0;
+
+	/** True while the portal shows a snapshot taken by CaptureImpostor instead of a live capture */
+	bool bShowingImpostor = false;
+
+	/** Frames the portal still counts as in line of sight of the camera, refreshed by every visibility trace that reaches it */
+	int32 LineOfSightFramesLeft = 0;
+
+	/** True while the camera is in front of the portal and the portal is in the view frustum, see APortal3Manager::CheckPortalNeedsUpdate */
+	bool bInCameraView = false;
+
+	/** How the next capture clips the scene at the exit portal, picked by the portal manager before every capture */
+	EPortalClipMode ClipMode = EPortalClipMode::ClipPlane;
+
+	/**
+	 * Rectangle of the screen the capture renders, in normalized device coordinates. Only the pixels under the portal are
+	 * ever shown, so the manager crops the capture to the rectangle the portal covers and the render targets shrink with it.
+	 */
+	FBox2D CaptureRect = FBox2D(FVector2D(-1.0), FVector2D(1.0));
+
 private:
 	UPROPERTY(VisibleAnywhere, Category = "G3NTs|Portal")
 	USceneCaptureComponent2D* SceneCapture; // essential
 
+	/** Front and back texture targets, leased from the render target pool of the portal manager */
 	UPROPERTY(VisibleAnywhere, Transient, Category = "G3NTs|Portal")
 	UTextureRenderTarget2D* PortalTexture; // essential
 
@@ -49,6 +102,9 @@ private:
 	UPROPERTY(VisibleAnywhere, Transient, Category = "G3NTs|Portal")
 	UMaterialInstanceDynamic* DynamicMaterialInstance; // essential
 
+	/** All parameter writes to DynamicMaterialInstance go through here, unchanged values are not written again */
+	FPortalMaterialParameterCache MaterialParameters;
+
 	UPROPERTY(EditAnywhere, Category = "G3NTs|Portal")
 	UMaterialInstance* Material; // essential
 
@@ -64,9 +120,16 @@ private:
 	bool bUsingPrimaryTextureTarget = true; // essential
 	int32 SurfaceId; // essential
 
+	FPortalPairTransform PairTransform; // cached conversion from this portal to the linked portal
+	APortalV3* PairTransformTarget = nullptr; // linked portal the PairTransform was computed for
+	bool bPairTransformDirty = true;
+
+	APortalV3* ImpostorTarget = nullptr; // linked portal the impostor snapshot was taken through
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 private:	
 	/**
@@ -89,6 +152,17 @@ private:
 	 */
 	void DrawBox(UWorld* World, const FVector& WorldOffset, const FColor& Color, float Duration);
 
+	/**
+	 * Gets the size of the texture targets from the current resolution tier, the viewport aspect ratio in OldSize and the CaptureRect.
+	 */
+	FIntPoint GetDesiredTextureSize() const;
+
+	/**
+	 * Bound to the TransformUpdated event of the root component. Invalidates the pair transform of this portal,
+	 * as well as the one of the linked portal, as both depend on the transform of this portal.
+	 */
+	void OnPortalTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
+
 	/**
 	 * Breaks a view projection matrix into its component vectors. 
 	 * Which is then used in the portal material instance to correctly calculate the screen space coordinates.
@@ -124,13 +198,80 @@ public:
 	void UpdateScreenCapture(FVector Position, FQuat Rotation, FMatrix ViewProjectionMatrix, FTransform Target, FMatrix ProjectionMatrix);
 	
 	/**
-	 * Updates the 2 texture targets. If the texture target objects do not yet exist, 
-	 * it creates them and sets their default values. If the texture target objects do exist, 
-	 * checks if the screen size changed, and if so updates the texture size.
+	 * Stores the viewport size the 2 texture targets are sized from. If the size changed,
+	 * the texture targets are leased again with the new size on the next AcquireTextureTargets.
 	 *
 	 * @param Size The new size for the texture target.
 	 */
 	void UpdateTextureTarget(FVector2D Size);
+
+	/**
+	 * Selects the render target resolution tier from the screen coverage of the portal.
+	 * The texture targets are resized on the next AcquireTextureTargets.
+	 *
+	 * @param ScreenCoverage Fraction of the screen covered by the portal, 0 to 1.
+	 * @return True if the tier changed.
+	 */
+	bool UpdateResolutionTier(float ScreenCoverage);
+
+	/**
+	 * Leases a front and back texture target from the pool, sized from the resolution tier and the viewport aspect ratio.
+	 * Does nothing if the portal already leases targets of that size, otherwise the old targets are returned first.
+	 *
+	 * @param Pool The render target pool of the portal manager.
+	 * @return True if new targets were leased, their content is undefined and they need a new capture.
+	 */
+	bool AcquireTextureTargets(FPortalRenderTargetPool& Pool);
+
+	/**
+	 * Returns the leased texture targets to the pool. The portal shows the default texture of its material until it leases new ones.
+	 *
+	 * @param Pool The render target pool of the portal manager.
+	 */
+	void ReleaseTextureTargets(FPortalRenderTargetPool& Pool);
+
+	/**
+	 * Stops the live capture and shows a single low resolution snapshot instead, taken from a canonical viewpoint
+	 * in front of the portal. The material is given the view projection of that viewpoint, so the snapshot stays
+	 * attached to the portal surface from any angle, only without parallax.
+	 *
+	 * @param Pool The render target pool of the portal manager, the snapshot uses the lowest resolution tier.
+	 * @param ViewDistance Distance of the canonical viewpoint in front of the portal.
+	 */
+	void CaptureImpostor(FPortalRenderTargetPool& Pool, double ViewDistance);
+
+	/**
+	 * Switches the scene capture to only render the primitives in its show only list, and returns that list to be filled.
+	 * Used by the portal manager to pass the primitives that survive culling against the portal frustum.
+	 *
+	 * @return The show only list of the scene capture.
+	 */
+	TArray<TWeakObjectPtr<UPrimitiveComponent>>& BeginShowOnlyList();
+
+	/**
+	 * Switches the scene capture back to rendering all scene primitives, and empties the show only list.
+	 */
+	void ClearShowOnlyList();
+
+	/**
+	 * Returns true if the portal shows an impostor snapshot that was taken through its current linked portal.
+	 */
+	bool IsImpostorValid() const { return bShowingImpostor && ImpostorTarget == LinkedPortal; }
+
+	/**
+	 * Returns true if the portal currently leases texture targets from the pool.
+	 */
+	bool HasTextureTargets() const { return PortalTexture != nullptr && PortalTexture2 != nullptr; }
+
+	/**
+	 * Returns the height divided by the width of the texture targets, from the viewport size given to UpdateTextureTarget.
+	 */
+	double GetTextureAspectRatio() const { return OldSize.X > 0.0 ? OldSize.Y / OldSize.X : 1.0; }
+
+	/**
+	 * Returns the fraction of the view the capture covers on each axis, from CaptureRect.
+	 */
+	FVector2D GetCaptureRectFraction() const { return CaptureRect.GetSize() * 0.5; }
 	
 	/**
 	 * Sets the surface data for the portal. The surface data, is a reference to the surface static mesh, 
@@ -150,11 +291,11 @@ public:
 
 	/**
 	 * Gets the coordinates of the bounds of the portal. 
-	 * However, it discards one dimension as the portal plane is a "plane" not a box.
+	 * However, it discards one dimension as the portal plane is a "plane" not a box, so only the 4 corners of the plane are returned.
 	 *
 	 * @return An array of vectors representing the bounds of the portal.
 	 */
-	TArray<FVector> GetPortalBounds();
+	FPortalCornerArray GetPortalBounds() const;
 
 	/**
 	 * Checks if a point is inside the portal collider box.
@@ -163,6 +304,39 @@ public:
 	 * @param Point The point to check.
 	 * @return True if the point is inside the portal, false otherwise.
 	 */
-	bool IsInside(FVector Point);
+	bool IsInside(const FVector& Point) const;
+
+	/**
+	 * Checks if an agent moved through the portal opening from front to back between two locations.
+	 * Unlike IsInside this does not depend on the agent being sampled inside the collider, so fast agents are never missed.
+	 *
+	 * @param Start The location of the agent at the end of the previous frame.
+	 * @param End The current location of the agent.
+	 * @param OutFraction Fraction along the movement at which the portal was crossed.
+	 * @return True if the portal was crossed.
+	 */
+	bool IsCrossedBySegment(const FVector& Start, const FVector& End, double& OutFraction) const;
+
+	/**
+	 * Gets the cached conversion from this portal to the linked portal. The conversion is only recomputed
+	 * when one of the portals moved, or the linked portal changed, since the last call.
+	 * Should only be called when the portal has a linked portal.
+	 *
+	 * @return The conversion from this portal's space to the linked portal's space.
+	 */
+	const FPortalPairTransform& GetPairTransform();
+
+	/**
+	 * Marks the pair transform for recomputation on the next GetPairTransform call.
+	 */
+	void MarkPairTransformDirty() { bPairTransformDirty = true; }
+
+	/**
+	 * Gets the world space axis aligned bounds of the portal collider box.
+	 * Used by the portal manager to insert the portal into its broadphase grid.
+	 *
+	 * @return The axis aligned bounding box enclosing the rotated portal collider.
+	 */
+	FBox GetTeleportBounds() const;
 
 };
@@ -0,0 +1,33 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SceneViewExtension.h"
+
+class APortal3Manager;
+
+/**
+ * Hands the final view of the player to the portal manager, on the game thread right before the view is rendered.
+ *
+ * The manager runs in TG_PostUpdateWork, anything that moves the camera after that is only seen here. It is used to
+ * late latch the portal captures to the pose that is actually presented, and to measure how far behind the captures are.
+ * Only active for the world of the manager.
+ */
+class PORTAL2_API FPortalViewExtension : public FWorldSceneViewExtension
+{
+public:
+	FPortalViewExtension(const FAutoRegister& AutoRegister, UWorld* InWorld, APortal3Manager* InManager);
+
+	virtual void SetupViewFamily(FSceneViewFamily& InViewFamily) override {}
+	virtual void SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView) override {}
+
+	/**
+	 * Passes the view of the player to the portal manager. Scene captures render their own view families through the
+	 * view extensions as well, the portal captures included, those are ignored.
+	 */
+	virtual void BeginRenderViewFamily(FSceneViewFamily& InViewFamily) override;
+
+private:
+	TWeakObjectPtr<APortal3Manager> Manager;
+};
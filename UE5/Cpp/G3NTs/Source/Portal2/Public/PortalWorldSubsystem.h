@@ -0,0 +1,92 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "PortalWorldSubsystem.generated.h"
+
+class APortal3Manager;
+class APortalV3;
+
+/**
+ * Per world access point of the portal system. Any actor or component reaches the portal manager of its own world with
+ * GetWorld()->GetSubsystem<UPortalWorldSubsystem>(), instead of searching the world for the first manager actor.
+ * Every PIE client has its own world, and therefore its own subsystem and manager.
+ *
+ * Portals and teleport agents that begin play before the manager are queued, and handed to the manager as soon as it registers.
+ */
+UCLASS()
+class PORTAL2_API UPortalWorldSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * Registers the portal manager of this world, and hands it all queued portals and agents.
+	 *
+	 * @param InManager The portal manager.
+	 */
+	void SetManager(APortal3Manager* InManager);
+
+	/**
+	 * Unregisters the portal manager of this world, if it is the registered one.
+	 *
+	 * @param InManager The portal manager that ends play.
+	 */
+	void ClearManager(APortal3Manager* InManager);
+
+	/**
+	 * Returns the portal manager of this world, nullptr if there is none (yet).
+	 */
+	APortal3Manager* GetManager() const { return Manager; }
+
+	/**
+	 * Returns true while the manager is spawning clones, see APortal3Manager::GetCloneStatus.
+	 */
+	bool GetCloneStatus() const;
+
+	/**
+	 * Adds an actor with a UTeleportAgent component to the manager, or queues it until the manager registers.
+	 */
+	void RegisterAgent(AActor* Actor);
+
+	/**
+	 * Removes an actor with a UTeleportAgent component from the manager, or from the queue.
+	 */
+	void UnregisterAgent(AActor* Actor);
+
+	/**
+	 * Adds a portal to the manager, or queues it until the manager registers.
+	 */
+	void RegisterPortal(APortalV3* Portal);
+
+	/**
+	 * Removes a portal from the manager, or from the queue.
+	 */
+	void UnregisterPortal(APortalV3* Portal);
+
+	// UTickableWorldSubsystem
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+protected:
+	// UWorldSubsystem
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+	/**
+	 * Hands the queued portals and agents to the manager.
+	 */
+	void FlushPendingRegistrations();
+
+private:
+	UPROPERTY()
+	APortal3Manager* Manager = nullptr;
+
+	UPROPERTY()
+	TArray<AActor*> PendingAgents;
+
+	UPROPERTY()
+	TArray<APortalV3*> PendingPortals;
+};
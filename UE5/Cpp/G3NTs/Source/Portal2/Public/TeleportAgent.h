@@ -4,10 +4,28 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
+#include "PortalMaterialParameterCache.h"
 #include "TeleportAgent.generated.h"
 
 class APortal3Manager;
 class UTP_WeaponComponent;
+class UMeshComponent;
+class UMaterialInstanceDynamic;
+
+/**
+ * An actor attached to the owner of a teleport agent, with the components the portal system needs from it.
+ * Resolved once when the actor is attached, so the per frame code never searches the attachment hierarchy.
+ */
+struct FTeleportAgentAttachment
+{
+	TWeakObjectPtr<AActor> Actor;
+
+	/** Teleport agent of the attached actor, null if it has none */
+	TWeakObjectPtr<UTeleportAgent> Agent;
+
+	/** Weapon component of the attached actor, null if it is not a weapon */
+	TWeakObjectPtr<UTP_WeaponComponent> Weapon;
+};
 
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class PORTAL2_API UTeleportAgent : public UActorComponent
@@ -19,16 +37,47 @@ public:
 	UTeleportAgent();
 
 private:
+	/**
+	 * Per portal "in front of the portal" state, one bit per portal slot.
+	 * Portal slots are small dense indices handed out by the portal manager, see APortalV3::PortalSlot.
+	 */
+	UPROPERTY(VisibleAnywhere, Category = "G3NTs|Portal")
+	uint64 TeleportStatusMask;
+
+	/**
+	 * Meshes of the actor that are clipped at the portal. When the clip plane is passed as custom primitive data,
+	 * the meshes keep their shared materials and still batch with identical actors that are not clipped.
+	 */
 	UPROPERTY(VisibleAnywhere, Category = "G3NTs|Portal")
-	TMap<AActor*, bool> TeleportStatus;
+	TArray<UMeshComponent*> ClipMeshComponents;
 
-	/** Dynamic material instances used for the clipping plane effect */
+	/** Dynamic material instances used for the clipping plane effect, only while the materials do not read custom primitive data */
 	UPROPERTY(VisibleAnywhere, Category = "G3NTs|Portal")
 	TArray<UMaterialInstanceDynamic*> DynamicMaterialInstances;
 
-	/** Material interface used by the actor */
-	UPROPERTY(VisibleAnywhere, Category = "G3NTs|Portal")
-	UMaterialInterface* MaterialInterface;
+	/** Whether the clip plane is passed as custom primitive data, see Portal.Agent.ClipPlaneAsPrimitiveData */
+	bool bClipPlaneAsPrimitiveData;
+
+	/**
+	 * Actors attached to the owner. Kept up to date from the attach and detach notifications, see NotifyActorAttached,
+	 * and from the attachments that already exist when the agent begins play.
+	 */
+	TArray<FTeleportAgentAttachment, TInlineAllocator<2>> Attachments;
+
+	/**
+	 * Clip plane parameters last written, one cache per clipped mesh or dynamic material instance.
+	 * The manager sets the clip plane of an agent in front of a portal every frame, mostly with the same values.
+	 */
+	TArray<FPortalMaterialParameterCache> ClipPlaneParameters;
+
+public:
+	/**
+	 * Custom primitive data layout of the clip plane, the materials of teleport agents read the same indices.
+	 * Position and Normal are 4 floats each, the W is unused. Enabled is 1 while the clip plane is active.
+	 */
+	static constexpr int32 ClipPlanePositionDataIndex = 0;
+	static constexpr int32 ClipPlaneNormalDataIndex = 4;
+	static constexpr int32 ClipPlaneEnabledDataIndex = 8;
 
 public:
 	/** Flag indicating if the actor is controlled by a player */
@@ -88,6 +137,58 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "G3NTs|Portal")
 	bool GetTeleportStatus(AActor* Actor);
 
+	/**
+	 * Sets the teleportation status for the portal occupying the given slot
+	 *
+	 * @param PortalSlot The slot index of the portal
+	 * @param bCanTeleport The new teleport status
+	 */
+	FORCEINLINE void SetTeleportStatusSlot(int32 PortalSlot, bool bCanTeleport)
+	{
+		const uint64 SlotBit = uint64(1) << PortalSlot;
+		TeleportStatusMask = bCanTeleport ? (TeleportStatusMask | SlotBit) : (TeleportStatusMask & ~SlotBit);
+	}
+
+	/**
+	 * Gets the teleportation status for the portal occupying the given slot
+	 *
+	 * @param PortalSlot The slot index of the portal
+	 * @return The teleport status for the portal
+	 */
+	FORCEINLINE bool GetTeleportStatusSlot(int32 PortalSlot) const
+	{
+		return (TeleportStatusMask & (uint64(1) << PortalSlot)) != 0;
+	}
+
+	/**
+	 * Clears the teleportation status of all portals in the given slot mask, used when portals are destroyed
+	 *
+	 * @param SlotMask Mask with a bit set for every portal slot to clear
+	 * @return True if this cleared the last teleport status of the agent, the clip plane and collision then have to be released by the caller
+	 */
+	FORCEINLINE bool ClearTeleportStatus(uint64 SlotMask)
+	{
+		const bool bHadStatus = (TeleportStatusMask & SlotMask) != 0;
+		TeleportStatusMask &= ~SlotMask;
+		return bHadStatus && TeleportStatusMask == 0;
+	}
+
+	/**
+	 * Returns true if the teleport status is set for any portal
+	 */
+	FORCEINLINE bool HasAnyTeleportStatus() const
+	{
+		return TeleportStatusMask != 0;
+	}
+
+	/**
+	 * Returns the teleport status of all portals, one bit per portal slot
+	 */
+	FORCEINLINE uint64 GetTeleportStatusMask() const
+	{
+		return TeleportStatusMask;
+	}
+
 	/**
 	 * Changes the collision settings for the agent
 	 *
@@ -99,4 +200,65 @@ public:
 	 * Resets the collision settings for the agent to the original settings
 	 */
 	void ResetAgentCollision();
+
+	/**
+	 * Adds an actor to the cached attachments of this agent. Does nothing if it is already in there.
+	 *
+	 * @param Actor The actor attached to the owner of this agent
+	 */
+	void AddAttachedActor(AActor* Actor);
+
+	/**
+	 * Removes an actor from the cached attachments of this agent.
+	 *
+	 * @param Actor The actor detached from the owner of this agent
+	 */
+	void RemoveAttachedActor(AActor* Actor);
+
+	/**
+	 * Returns the actors attached to the owner, as cached from the attach and detach notifications
+	 */
+	const TArray<FTeleportAgentAttachment, TInlineAllocator<2>>& GetAttachments() const { return Attachments; }
+
+	/**
+	 * Returns the weapon component of the first attached weapon, nullptr if no weapon is attached
+	 */
+	UTP_WeaponComponent* GetAttachedWeapon() const;
+
+	/**
+	 * Notifies the teleport agent of the parent actor that an actor was attached to it.
+	 * Has to be called by code that attaches actors at runtime, such as UTP_WeaponComponent::AttachWeapon.
+	 *
+	 * @param Actor The actor that was just attached
+	 * @param Parent The actor it was attached to
+	 */
+	static void NotifyActorAttached(AActor* Actor, AActor* Parent);
+
+	/**
+	 * Finds the actor another actor is attached to. Unlike AActor::GetAttachParentActor this also finds attachments
+	 * of components other than the root, such as a weapon that only attaches its mesh to the hand of a character.
+	 *
+	 * @param Actor The actor to find the parent of
+	 * @return The parent actor, nullptr if no component of the actor is attached to another actor
+	 */
+	static AActor* FindAttachParentActor(const AActor* Actor);
+
+	/**
+	 * Notifies the teleport agent of the former parent actor that an actor was detached from it.
+	 *
+	 * @param Actor The actor that was detached
+	 * @param Parent The actor it was attached to
+	 */
+	static void NotifyActorDetached(AActor* Actor, AActor* Parent);
+
+private:
+	/**
+	 * Writes the clip plane to the custom primitive data or the material instances of the clipped meshes of this agent only.
+	 * A disabled clip plane keeps the last plane, only the enabled flag is written.
+	 *
+	 * @param Position The location of the clip plane
+	 * @param Normal The normal of the clip plane, the side it points to stays visible
+	 * @param bEnabled Whether the clip plane is active
+	 */
+	void WriteClipPlane(const FVector& Position, const FVector& Normal, bool bEnabled);
 };
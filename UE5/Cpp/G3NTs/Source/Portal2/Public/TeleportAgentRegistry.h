@@ -0,0 +1,159 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TeleportAgentRegistry.generated.h"
+
+class UTeleportAgent;
+class UPrimitiveComponent;
+
+/**
+ * The type of a teleport agent, determines how the agent is teleported and cloned.
+ * Resolved once when the agent is registered, instead of casting the actor every frame.
+ */
+UENUM()
+enum class ETeleportAgentKind : uint8
+{
+	Player,
+	Projectile,
+	Prop
+};
+
+/**
+ * Stable handle to a teleport agent in the FTeleportAgentRegistry.
+ * The dense index of an agent changes when other agents are removed, the handle does not.
+ * The generation makes sure a handle to a removed agent is never resolved to the agent that reused its slot.
+ */
+struct FTeleportAgentHandle
+{
+	int32 Slot;
+	uint32 Generation;
+
+	FTeleportAgentHandle() : Slot(INDEX_NONE), Generation(0) {}
+
+	FTeleportAgentHandle(int32 InSlot, uint32 InGeneration)
+		: Slot(InSlot), Generation(InGeneration)
+	{}
+
+	bool IsValid() const
+	{
+		return Slot != INDEX_NONE;
+	}
+
+	bool operator==(const FTeleportAgentHandle& Other) const
+	{
+		return Slot == Other.Slot && Generation == Other.Generation;
+	}
+};
+
+/**
+ * Struct-of-arrays registry of all actors that can be teleported.
+ *
+ * Everything the per frame teleport and clone checks need from an agent is cached when the agent is registered,
+ * so the hot loops in the portal manager stream over contiguous arrays and never search the component list of an actor.
+ * Agents are added and removed in O(1), removal swaps the last agent into the free dense index.
+ */
+USTRUCT()
+struct PORTAL2_API FTeleportAgentRegistry
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * Adds an actor to the registry. Does nothing if the actor is already registered.
+	 *
+	 * @param Actor The actor owning the teleport agent component.
+	 * @param TeleportAgent The teleport agent component of the actor.
+	 * @param Kind The type of the agent.
+	 * @return Handle to the registered agent.
+	 */
+	FTeleportAgentHandle Add(AActor* Actor, UTeleportAgent* TeleportAgent, ETeleportAgentKind Kind);
+
+	/**
+	 * Removes an agent from the registry by swapping the last agent into its dense index.
+	 *
+	 * @param Handle Handle to the agent to remove.
+	 * @return True if the agent was removed, false if the handle was stale.
+	 */
+	bool Remove(FTeleportAgentHandle Handle);
+
+	/**
+	 * Removes the agent owned by the given actor from the registry.
+	 *
+	 * @param Actor The actor to remove.
+	 * @return True if the actor was registered and is now removed.
+	 */
+	bool Remove(AActor* Actor);
+
+	/**
+	 * Finds the handle of a registered actor.
+	 *
+	 * @param Actor The actor to look for.
+	 * @return Handle to the agent, invalid if the actor is not registered.
+	 */
+	FTeleportAgentHandle FindHandle(AActor* Actor) const;
+
+	/**
+	 * Resolves a handle to the current dense index of the agent.
+	 *
+	 * @param Handle The handle to resolve.
+	 * @return The dense index, or INDEX_NONE if the handle is stale.
+	 */
+	int32 GetDenseIndex(FTeleportAgentHandle Handle) const;
+
+	/**
+	 * Removes all agents from the registry.
+	 */
+	void Reset();
+
+	/**
+	 * Returns true if the actor is registered.
+	 */
+	bool Contains(AActor* Actor) const { return ActorToSlot.Contains(Actor); }
+
+	/**
+	 * Returns the number of registered agents. Dense indices range from 0 to Num() - 1.
+	 */
+	int32 Num() const { return Actors.Num(); }
+
+	// Dense accessors, used by the per frame loops
+
+	AActor* GetActor(int32 Index) const { return Actors[Index]; }
+	UTeleportAgent* GetAgent(int32 Index) const { return Agents[Index]; }
+	UPrimitiveComponent* GetRootPrimitive(int32 Index) const { return RootPrimitives[Index]; }
+	ETeleportAgentKind GetKind(int32 Index) const { return Kinds[Index]; }
+	const FVector& GetPreviousLocation(int32 Index) const { return PreviousLocations[Index]; }
+	void SetPreviousLocation(int32 Index, const FVector& Location) { PreviousLocations[Index] = Location; }
+
+private:
+	/**
+	 * Slot in the sparse handle array. Points to the dense index of the agent while the slot is in use.
+	 */
+	struct FSlot
+	{
+		int32 DenseIndex = INDEX_NONE;
+		uint32 Generation = 0;
+	};
+
+	// Dense arrays, all indexed by the dense agent index
+
+	UPROPERTY(VisibleAnywhere)
+	TArray<AActor*> Actors;
+
+	UPROPERTY(VisibleAnywhere)
+	TArray<UTeleportAgent*> Agents;
+
+	UPROPERTY()
+	TArray<UPrimitiveComponent*> RootPrimitives;
+
+	TArray<ETeleportAgentKind> Kinds;
+	TArray<FVector> PreviousLocations;
+	TArray<int32> DenseToSlot;
+
+	// Sparse handle storage
+
+	TArray<FSlot> Slots;
+	TArray<int32> FreeSlots;
+	TMap<AActor*, int32> ActorToSlot;
+};
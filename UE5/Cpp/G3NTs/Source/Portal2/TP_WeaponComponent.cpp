@@ -13,6 +13,7 @@
 #include "Engine/LocalPlayer.h"
 #include "MyAnimInstance.h"
 #include "PortalBullet.h"
+#include "TeleportAgent.h"
 #include "Engine/World.h"
 
 // Sets default values for this component's properties
@@ -31,6 +32,8 @@ void UTP_WeaponComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
 		return;
 	}
 
+	UTeleportAgent::NotifyActorDetached(GetOwner(), Character);
+
 	if (APlayerController* PlayerController = Cast<APlayerController>(Character->GetController()))
 	{
 		if (UEnhancedInputLocalPlayerSubsystem* Subsystem = ULocalPlayer::GetSubsystem<UEnhancedInputLocalPlayerSubsystem>(PlayerController->GetLocalPlayer()))
@@ -240,6 +243,9 @@ bool UTP_WeaponComponent::AttachWeapon(APortal2Character* TargetCharacter)
 	FAttachmentTransformRules AttachmentRules(EAttachmentRule::SnapToTarget, true);
 	AttachToComponent(Character->GetMesh1P(), AttachmentRules, FName(TEXT("GripPoint")));
 
+	// the teleport agent of the character caches its attachments, it is not searched for every frame
+	UTeleportAgent::NotifyActorAttached(GetOwner(), Character);
+
 	// add the weapon as an instance component to the character
 	Character->AddInstanceComponent(this);
 